@@ -4,6 +4,8 @@
 #include "utilities/text_utils.h"
 #include "plugins/manager.h"
 #include "syntax/highlighter.h"
+#include "syntax/highlight_cache.h"
+#include "syntax/language_detector.h"
 #include <QFileInfo>
 #include <QTextStream>
 #include <QRegularExpression>
@@ -16,10 +18,10 @@ class EditorCore::DocumentBuffer {
 public:
     QStringList lines;
     QString encoding = "UTF-8";
-    QHash<int, QByteArray> lineHashes; // For change detection
+    QHash<int, quint64> lineHashes; // For change detection, same hash as the highlight cache
     
     void updateHash(int line) {
-        lineHashes[line] = qHash(lines[line]);
+        lineHashes[line] = HighlightCache::hashLine(lines[line]);
     }
 };
 
@@ -121,9 +123,8 @@ bool EditorCore::loadFile(const QString &filePath) {
     m_modified = false;
     endBulkOperation();
 
-    // Auto-detect language
-    QString ext = QFileInfo(filePath).suffix();
-    setLanguage(ext);
+    // Auto-detect language from modeline, shebang, extension and content
+    setLanguage(LanguageDetector::instance()->detect(filePath, content));
 
     emit fileLoaded(filePath);
     qInfo() << "Loaded" << filePath << "in" << timer.elapsed() << "ms";
@@ -154,6 +155,11 @@ bool EditorCore::saveFile(const QString &filePath) {
     return true;
 }
 
+QString EditorCore::currentEncoding() const {
+    QReadLocker locker(&m_docLock);
+    return m_buffer->encoding;
+}
+
 // Text Operations ============================================================
 
 void EditorCore::insertText(int line, int column, const QString &text) {
@@ -54,6 +54,8 @@ public:
     bool saveAs(const QString &filePath);
     QString currentText() const;
     QString currentFilePath() const;
+    // As detected by the last load; saves write this encoding back
+    QString currentEncoding() const;
     bool isModified() const;
     void setModified(bool modified);
 
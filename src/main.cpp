@@ -6,6 +6,7 @@
  */
 
 #include <QApplication>
+#include <QCoreApplication>
 #include <QCommandLineParser>
 #include <QMessageBox>
 #include <QStyleFactory>
@@ -23,6 +24,7 @@
 #include "utilities/logger.h"
 #include "utilities/settings.h"
 #include "utilities/crash_handler.h"
+#include "utilities/batch_converter.h"
 
 // Global pointers for crash handling
 MainWindow* g_mainWindow = nullptr;
@@ -36,7 +38,63 @@ void signalHandler(int signal) {
     exit(signal);
 }
 
+// Batch conversion options, also listed in the editor's --help
+void addConversionOptions(QCommandLineParser& parser) {
+    parser.addOption({"convert-dir",
+        QObject::tr("Convert the text files under <directory> and exit"), QObject::tr("directory")});
+    parser.addOption({"convert-to",
+        QObject::tr("Target encoding for --convert-dir"), QObject::tr("encoding"), "UTF-8"});
+    parser.addOption({"output-dir",
+        QObject::tr("Write converted files under <directory> instead of in place"), QObject::tr("directory")});
+    parser.addOption({"no-backup",
+        QObject::tr("Convert in place without keeping the originals as .bak")});
+}
+
+bool wantsConversion(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        const QByteArray arg(argv[i]);
+        if (arg == "--convert-dir" || arg.startsWith("--convert-dir=")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Headless batch conversion: no display, and not tied to a running editor
+int runConversion(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("MangoEditor");
+    app.setApplicationVersion("2.1.0");
+    app.setOrganizationName("MangoSoft");
+    app.setOrganizationDomain("mangoeditor.org.bd");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("MangoEditor - batch encoding conversion");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    addConversionOptions(parser);
+    parser.process(app);
+
+    BatchConverter::Options options;
+    options.targetEncoding = parser.value("convert-to");
+    options.outputDirectory = parser.value("output-dir");
+    // In place, the originals are kept unless explicitly declined
+    options.backup = options.outputDirectory.isEmpty() && !parser.isSet("no-backup");
+
+    const BatchConverter::Report report = BatchConverter::run(parser.value("convert-dir"), options, nullptr,
+        [](const BatchConverter::Report& progress) {
+            qInfo().noquote() << QString("%1 converted, %2 skipped, %3 failed, %4 MB/s")
+                .arg(progress.converted).arg(progress.skipped).arg(progress.failures.size())
+                .arg(progress.megabytesPerSecond(), 0, 'f', 1);
+        });
+    return report.failures.isEmpty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char *argv[]) {
+    if (wantsConversion(argc, argv)) {
+        return runConversion(argc, argv);
+    }
+
     // High DPI support
     QApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
     QApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
@@ -79,12 +137,6 @@ int main(int argc, char *argv[]) {
         qInfo() << "Loaded translation for locale:" << QLocale::system().name();
     }
 
-    // Show splash screen (min 1.5s)
-    QPixmap splashPix(":/splash.png");
-    QSplashScreen splash(splashPix.scaled(600, 400, Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    splash.show();
-    app.processEvents();
-
     // Load application settings
     SettingsManager settings;
     QString theme = settings.get("ui/theme", "dark").toString();
@@ -104,8 +156,16 @@ int main(int argc, char *argv[]) {
     parser.addOption(newWindowOption);
     parser.addOption(portableOption);
     parser.addOption(safeModeOption);
+    // Handled by runConversion() before the editor starts
+    addConversionOptions(parser);
     parser.process(app);
 
+    // Show splash screen (min 1.5s)
+    QPixmap splashPix(":/splash.png");
+    QSplashScreen splash(splashPix.scaled(600, 400, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    splash.show();
+    app.processEvents();
+
     try {
         // Initialize core components
         EditorCore core;
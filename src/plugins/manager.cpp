@@ -1,7 +1,9 @@
 #include "manager.h"
 #include "interface.h"
+#include "utilities/frame_scheduler.h"
 #include "utilities/logger.h"
 #include <QDir>
+#include <QFileInfo>
 #include <QPluginLoader>
 #include <QCoreApplication>
 #include <QJsonObject>
@@ -42,7 +44,7 @@ void PluginSandbox::run()
 
 // PluginManager Implementation
 PluginManager::PluginManager(EditorCore* core, QObject* parent)
-    : QObject(parent), m_core(core), m_fileWatcher(new QFileSystemWatcher(this)) 
+    : QObject(parent), m_core(core)
 {
     m_pluginSearchPaths = {
         QCoreApplication::applicationDirPath() + "/plugins",
@@ -50,14 +52,16 @@ PluginManager::PluginManager(EditorCore* core, QObject* parent)
         QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/plugins"
     };
     
-    connect(m_fileWatcher, &QFileSystemWatcher::directoryChanged,
-            this, &PluginManager::onPluginDirectoryChanged);
+    connect(FileWatcher::instance(), &FileWatcher::changed,
+            this, &PluginManager::onWatchedPathsChanged);
 }
 
 PluginManager::~PluginManager()
 {
     unloadAllPlugins();
-    m_fileWatcher->deleteLater();
+    for (const auto& path : qAsConst(m_pluginSearchPaths)) {
+        FileWatcher::instance()->unwatchDirectory(path);
+    }
 }
 
 // Plugin Loading Methods
@@ -177,7 +181,9 @@ void PluginManager::initializePlugin(IPlugin* plugin)
 {
     plugin->initialize(m_core);
     plugin->setState(IPlugin::Initialized);
-    QTimer::singleShot(0, this, &PluginManager::updateCommandStates);
+    FrameScheduler::instance()->postCoalesced(FrameScheduler::PluginUi, this,
+                                              QStringLiteral("commandStates"),
+                                              [this]() { updateCommandStates(); });
 }
 
 void PluginManager::unloadAllPlugins()
@@ -351,6 +357,26 @@ void PluginManager::onPluginDirectoryChanged(const QString& path)
     });
 }
 
+void PluginManager::onWatchedPathsChanged(const QVector<FileWatcher::Change>& changes)
+{
+    QStringList directories;
+    {
+        QMutexLocker locker(&m_mutex);
+        directories = m_pluginSearchPaths;
+    }
+
+    // A batch touching many plugin files still reloads each directory once
+    for (const auto& directory : qAsConst(directories)) {
+        const QString cleaned = QDir::cleanPath(QFileInfo(directory).absoluteFilePath());
+        for (const FileWatcher::Change& change : changes) {
+            if (change.path == cleaned || change.path.startsWith(cleaned + '/')) {
+                onPluginDirectoryChanged(directory);
+                break;
+            }
+        }
+    }
+}
+
 void PluginManager::reloadPlugins()
 {
     QMutexLocker locker(&m_mutex);
@@ -401,13 +427,13 @@ void PluginManager::setPluginSearchPaths(const QStringList& paths)
     QMutexLocker locker(&m_mutex);
     
     for (const auto& path : m_pluginSearchPaths) {
-        m_fileWatcher->removePath(path);
+        FileWatcher::instance()->unwatchDirectory(path);
     }
     
     m_pluginSearchPaths = paths;
     
     for (const auto& path : m_pluginSearchPaths) {
-        m_fileWatcher->addPath(path);
+        FileWatcher::instance()->watchDirectory(path);
     }
 }
 
@@ -511,5 +537,9 @@ QVector<PluginCommand> PluginManager::allCommands() const
 // Status Message Forwarding
 void PluginManager::forwardStatusMessage(const QString& msg, int timeout)
 {
-    emit statusMessageRequested(msg, timeout);
+    // Chatty plugins cannot stall typing; the latest message wins
+    FrameScheduler::instance()->postCoalesced(FrameScheduler::PluginUi, this,
+                                              QStringLiteral("statusMessage"), [this, msg, timeout]() {
+        emit statusMessageRequested(msg, timeout);
+    });
 }
@@ -2,12 +2,12 @@
 #define PLUGIN_MANAGER_H
 
 #include "interface.h"
+#include "utilities/file_watcher.h"
 #include <QObject>
 #include <QMap>
 #include <QVector>
 #include <QString>
 #include <QPluginLoader>
-#include <QFileSystemWatcher>
 #include <QThread>
 #include <QMutex>
 #include <QElapsedTimer>
@@ -94,6 +94,7 @@ public slots:
 
 private slots:
     void onPluginDirectoryChanged(const QString& path);
+    void onWatchedPathsChanged(const QVector<FileWatcher::Change>& changes);
     void forwardStatusMessage(const QString& msg, int timeout);
 
 private:
@@ -114,7 +115,6 @@ private:
     QMap<QString, PluginLoadInfo> m_loadHistory;
     QMap<QString, QString> m_blacklist;
     QStringList m_pluginSearchPaths;
-    QFileSystemWatcher* m_fileWatcher;
     mutable QMutex m_mutex;
     bool m_autoReloadEnabled = true;
 };
@@ -0,0 +1,259 @@
+#include "highlight_cache.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrent>
+#include <climits>
+
+namespace {
+const qint64 kDefaultMemoryLimit = 32 * 1024 * 1024;
+// A file is persisted once it has been opened this many times
+const int kPersistMinOpens = 3;
+// Paths whose open counts are kept; beyond this every count is halved and
+// the paths that reach zero are forgotten along with their cache files
+const int kMaxTrackedFiles = 1000;
+const quint32 kCacheMagic = 0x4D484C43; // "MHLC"
+const quint32 kCacheFormatVersion = 2;
+
+int entryCost(const HighlightCache::Entry &entry) {
+    return int(sizeof(HighlightCache::Key) + sizeof(HighlightCache::Entry)) + entry.tokens.memoryUsage()
+        + entry.delimiters.capacity() * int(sizeof(quint32));
+}
+} // namespace
+
+// Singleton instance initialization
+HighlightCache* HighlightCache::m_instance = nullptr;
+QMutex HighlightCache::m_instanceMutex;
+
+HighlightCache* HighlightCache::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+    if (!m_instance) {
+        m_instance = new HighlightCache();
+    }
+    return m_instance;
+}
+
+HighlightCache::HighlightCache()
+    : m_directory(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/highlight_cache")
+{
+    setMemoryLimit(kDefaultMemoryLimit);
+
+    QFile index(m_directory + "/index");
+    if (index.open(QIODevice::ReadOnly)) {
+        QDataStream in(&index);
+        in >> m_openCounts;
+    }
+}
+
+quint64 HighlightCache::hashLine(const QString &text)
+{
+    // FNV-1a over UTF-16 code units
+    quint64 hash = 14695981039346656037ULL;
+    const ushort *data = text.utf16();
+    for (int i = 0; i < text.length(); ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+HighlightCache::Shard &HighlightCache::shardFor(const Key &key)
+{
+    // The high bits: FNV-1a mixes them best
+    return m_shards[(key.lineHash >> 48) % kShardCount];
+}
+
+bool HighlightCache::lookup(const Key &key, Entry &entry)
+{
+    Shard &shard = shardFor(key);
+    QMutexLocker locker(&shard.mutex);
+    const Entry *cached = shard.entries.object(key);
+    if (!cached) {
+        return false;
+    }
+    entry = *cached;
+    return true;
+}
+
+void HighlightCache::insert(const Key &key, const Entry &entry)
+{
+    Shard &shard = shardFor(key);
+    QMutexLocker locker(&shard.mutex);
+    shard.entries.insert(key, new Entry(entry), entryCost(entry));
+}
+
+void HighlightCache::insert(const QVector<QPair<Key, Entry>> &entries)
+{
+    QVector<int> byShard[kShardCount];
+    for (int i = 0; i < entries.size(); ++i) {
+        byShard[&shardFor(entries.at(i).first) - m_shards].append(i);
+    }
+    for (int s = 0; s < kShardCount; ++s) {
+        if (byShard[s].isEmpty()) {
+            continue;
+        }
+        QMutexLocker locker(&m_shards[s].mutex);
+        for (int i : qAsConst(byShard[s])) {
+            const Entry &entry = entries.at(i).second;
+            m_shards[s].entries.insert(entries.at(i).first, new Entry(entry), entryCost(entry));
+        }
+    }
+}
+
+void HighlightCache::clear()
+{
+    for (Shard &shard : m_shards) {
+        QMutexLocker locker(&shard.mutex);
+        shard.entries.clear();
+    }
+}
+
+qint64 HighlightCache::memoryLimit() const
+{
+    qint64 limit = 0;
+    for (const Shard &shard : m_shards) {
+        QMutexLocker locker(&shard.mutex);
+        limit += shard.entries.maxCost();
+    }
+    return limit;
+}
+
+void HighlightCache::setMemoryLimit(qint64 bytes)
+{
+    const int perShard = int(qBound<qint64>(0, bytes / kShardCount, INT_MAX));
+    for (Shard &shard : m_shards) {
+        QMutexLocker locker(&shard.mutex);
+        shard.entries.setMaxCost(perShard);
+    }
+}
+
+qint64 HighlightCache::memoryUsage() const
+{
+    qint64 usage = 0;
+    for (const Shard &shard : m_shards) {
+        QMutexLocker locker(&shard.mutex);
+        usage += shard.entries.totalCost();
+    }
+    return usage;
+}
+
+void HighlightCache::fileOpened(const QString &filePath)
+{
+    QStringList forgotten;
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_openCounts[filePath];
+        while (m_openCounts.size() > kMaxTrackedFiles) {
+            for (auto it = m_openCounts.begin(); it != m_openCounts.end();) {
+                it.value() /= 2;
+                if (it.value() == 0 && it.key() != filePath) {
+                    forgotten.append(it.key());
+                    it = m_openCounts.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    // Opening is on the way to the first screen; the disk work is not
+    QtConcurrent::run([this, filePath, forgotten]() {
+        {
+            // Snapshot taken under the index lock, so a stale count never overwrites a newer one
+            QMutexLocker indexLocker(&m_indexMutex);
+            QHash<QString, int> openCounts;
+            {
+                QMutexLocker locker(&m_mutex);
+                openCounts = m_openCounts;
+            }
+
+            if (!QDir().mkpath(m_directory)) {
+                qWarning() << "Failed to create highlight cache directory:" << m_directory;
+                return;
+            }
+            QSaveFile index(m_directory + "/index");
+            if (index.open(QIODevice::WriteOnly)) {
+                QDataStream out(&index);
+                out << openCounts;
+                index.commit();
+            }
+            for (const QString &path : forgotten) {
+                QFile::remove(cachePath(path));
+            }
+        }
+
+        // Only present if the file was persisted in an earlier session
+        loadFile(filePath);
+    });
+}
+
+QString HighlightCache::cachePath(const QString &filePath) const
+{
+    const QByteArray name = QCryptographicHash::hash(filePath.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return m_directory + "/" + QString::fromLatin1(name) + ".cache";
+}
+
+bool HighlightCache::saveFile(const QString &filePath, const QVector<QPair<Key, Entry>> &entries)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_openCounts.value(filePath) < kPersistMinOpens) {
+            return false;
+        }
+    }
+
+    QSaveFile file(cachePath(filePath));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write highlight cache for" << filePath;
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_15);
+    out << kCacheMagic << kCacheFormatVersion << quint32(entries.size());
+    for (const auto &item : entries) {
+        out << item.first.lineHash << qint32(item.first.entryState) << item.first.languageVersion
+            << item.second.tokens << qint32(item.second.exitState) << item.second.delimiters;
+    }
+    return file.commit();
+}
+
+bool HighlightCache::loadFile(const QString &filePath)
+{
+    QFile file(cachePath(filePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_15);
+    quint32 magic = 0, version = 0, count = 0;
+    in >> magic >> version >> count;
+    if (magic != kCacheMagic || version != kCacheFormatVersion) {
+        qWarning() << "Ignoring incompatible highlight cache for" << filePath;
+        return false;
+    }
+
+    // Read without any lock held, then inserted in one batch
+    QVector<QPair<Key, Entry>> entries;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        Key key;
+        Entry entry;
+        qint32 entryState = 0, exitState = 0;
+        in >> key.lineHash >> entryState >> key.languageVersion >> entry.tokens >> exitState
+           >> entry.delimiters;
+        if (in.status() != QDataStream::Ok) {
+            break;
+        }
+        key.entryState = entryState;
+        entry.exitState = exitState;
+        entries.append(qMakePair(key, entry));
+    }
+    insert(entries);
+    return in.status() == QDataStream::Ok;
+}
@@ -0,0 +1,99 @@
+#ifndef HIGHLIGHT_CACHE_H
+#define HIGHLIGHT_CACHE_H
+
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include "token_stream.h"
+
+/**
+ * @brief Process-wide cache of lexed lines shared by all highlighters
+ *
+ * Entries are keyed by the line's content hash, the lexer state on entry
+ * and the language version, so re-opened files, other tabs showing the same
+ * text and undo/redo all reuse tokens instead of re-running the rules.
+ * Eviction is least-recently-used under a memory cap. Files that are opened
+ * often get their entries written to disk and preloaded on the next open.
+ *
+ * All methods are thread-safe; parallel lexing workers use it directly.
+ * Entries are spread over independently locked shards by line hash, and
+ * workers insert a whole chunk at a time, so they rarely wait on each other.
+ */
+class HighlightCache
+{
+public:
+    struct Key {
+        quint64 lineHash = 0;
+        int entryState = -1;
+        quint64 languageVersion = 0;
+
+        bool operator==(const Key &other) const {
+            return lineHash == other.lineHash
+                && entryState == other.entryState
+                && languageVersion == other.languageVersion;
+        }
+    };
+
+    struct Entry {
+        TokenStream tokens;
+        int exitState = -1;
+        QVector<quint32> delimiters;
+    };
+
+    // Singleton instance access
+    static HighlightCache* instance();
+
+    HighlightCache(const HighlightCache&) = delete;
+    HighlightCache& operator=(const HighlightCache&) = delete;
+
+    // Stable across runs and platforms, unlike qHash()
+    static quint64 hashLine(const QString &text);
+
+    bool lookup(const Key &key, Entry &entry);
+    void insert(const Key &key, const Entry &entry);
+    // Takes each shard's lock once for the whole batch
+    void insert(const QVector<QPair<Key, Entry>> &entries);
+    void clear();
+
+    qint64 memoryLimit() const;
+    void setMemoryLimit(qint64 bytes);
+    qint64 memoryUsage() const;
+
+    // On-disk persistence for frequently opened files. fileOpened() only
+    // counts the open; the index write and preloading run on the pool.
+    void fileOpened(const QString &filePath);
+    bool saveFile(const QString &filePath, const QVector<QPair<Key, Entry>> &entries);
+
+private:
+    HighlightCache();
+
+    static const int kShardCount = 16;
+
+    struct Shard {
+        mutable QMutex mutex;
+        QCache<Key, Entry> entries;
+    };
+
+    Shard &shardFor(const Key &key);
+    QString cachePath(const QString &filePath) const;
+    bool loadFile(const QString &filePath);
+
+    static HighlightCache* m_instance;
+    static QMutex m_instanceMutex;
+
+    Shard m_shards[kShardCount];
+    mutable QMutex m_mutex;  // Guards m_openCounts
+    QMutex m_indexMutex;     // Orders index writes, which run outside m_mutex
+    QHash<QString, int> m_openCounts;
+    QString m_directory;
+};
+
+inline uint qHash(const HighlightCache::Key &key, uint seed = 0)
+{
+    return qHash(key.lineHash, seed) ^ uint(key.entryState) ^ qHash(key.languageVersion, seed);
+}
+
+#endif // HIGHLIGHT_CACHE_H
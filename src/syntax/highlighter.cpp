@@ -1,14 +1,112 @@
 #include "highlighter.h"
+#include "highlight_cache.h"
+#include "utilities/frame_scheduler.h"
 #include "utilities/logger.h"
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QFuture>
 #include <QtConcurrent>
+#include <QTextBlock>
+#include <QTextDocument>
 #include <QToolTip>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Documents smaller than this are cheaper to highlight on the UI thread
+const int kParallelThresholdLines = 4000;
+// Lower bound for the number of lines lexed by one worker task
+const int kMinChunkLines = 512;
+// Rough cache cost of one line; a document that would overflow the cache is
+// lexed without filling it, instead of evicting everything else
+const qint64 kEstimatedEntryBytes = 256;
+// Blocks repainted per scheduler task after a theme change or parallel pass
+const int kSweepBatchBlocks = 50;
+
+quint64 nextLexerGeneration() {
+    static QAtomicInteger<quint64> generation(0);
+    return ++generation;
+}
+
+bool inBlockComment(int state) {
+    return state == 1;
+}
+
+// Inside a fence the block state nests the embedded lexer's state:
+// flag | language index << 8 | (inner state + 1)
+const int kFenceState = 0x10000;
+const int kUnknownFenceLanguage = 0xFF;
+
+bool inFence(int state) {
+    return state >= kFenceState;
+}
+
+// Above that, the opening marker: its length (capped) << 1 | 1 for '~'
+const int kFenceMarkerShift = 17;
+const int kMaxFenceMarkerLength = 63;
+
+int fenceState(int language, int innerState, int marker) {
+    return (marker << kFenceMarkerShift) | kFenceState | (language << 8) | ((innerState + 1) & 0xFF);
+}
+
+int fenceMarker(int state) {
+    return state >> kFenceMarkerShift;
+}
+
+int encodeFenceMarker(const QString &marker) {
+    if (marker.isEmpty()) {
+        return 0;
+    }
+    return (qMin(marker.length(), kMaxFenceMarkerLength) << 1) | (marker.at(0) == QLatin1Char('~') ? 1 : 0);
+}
+
+// No recorded marker (no marker group) closes on any fence end
+bool closesFence(int openMarker, const QString &closer) {
+    if (openMarker == 0) {
+        return true;
+    }
+    const int closerMarker = encodeFenceMarker(closer);
+    return closerMarker != 0 && (closerMarker & 1) == (openMarker & 1)
+        && (closerMarker >> 1) >= (openMarker >> 1);
+}
+
+int fenceLanguage(int state) {
+    return (state >> 8) & 0xFF;
+}
+
+int fenceInnerState(int state) {
+    return (state & 0xFF) - 1;
+}
+
+// -1 (no previous block) and 0 (nothing open) lex identically
+bool equivalentStates(int a, int b) {
+    return qMax(a, 0) == qMax(b, 0);
+}
+
+// Unbalanced delimiters are stored as (column << 8) | character
+const int kMaxDiagnostics = 500;
+// Lines per diagnostics segment; a publish rescans whole segments
+const int kDelimiterSegmentLines = 256;
+
+quint32 encodeDelimiter(int column, QChar ch) {
+    return (quint32(column) << 8) | quint32(ch.unicode() & 0x7F);
+}
+
+int delimiterColumn(quint32 delimiter) {
+    return int(delimiter >> 8);
+}
+
+char delimiterChar(quint32 delimiter) {
+    return char(delimiter & 0xFF);
+}
+} // namespace
 
 SyntaxHighlighter::SyntaxHighlighter(QTextDocument *parent)
-    : QSyntaxHighlighter(parent), m_lastHighlightTime(0)
+    : QSyntaxHighlighter(parent), m_lastHighlightTime(0),
+      m_parallelWatcher(new QFutureWatcher<ChunkResult>(this))
 {
     // Initialize default theme colors
     m_themeColors = {
@@ -21,32 +119,43 @@ SyntaxHighlighter::SyntaxHighlighter(QTextDocument *parent)
         QColor("#FFFFFF")  // background
     };
 
+    updateThemeColors();
     loadDefaultRules();
+    precompilePatterns();
     m_highlightTimer.start();
+
+    connect(m_parallelWatcher, &QFutureWatcher<ChunkResult>::finished,
+            this, &SyntaxHighlighter::mergeParallelResults);
 }
 
 void SyntaxHighlighter::loadLanguage(const QString &language) {
-    QString path = QString(":/syntax/language_defs/%1.json").arg(language);
-    QFile file(path);
-    
-    if (!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "Failed to open language file:" << path;
+    QJsonObject json;
+    if (!readLanguageFile(language, json)) {
         return;
     }
 
-    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-    QJsonObject json = doc.object();
-    file.close();
-
-    m_rules.clear();
+    m_language = LanguageRules();
+    m_language.name = language;
     m_currentLanguage = language;
 
     // Load all syntax components
-    loadKeywords(json);
-    loadStrings(json);
-    loadComments(json);
-    loadHighlightingRules(json);
-    loadSpecialRules(json);
+    loadLanguageRules(json, m_language);
+
+    // Languages that fenced regions switch to; embedding is one level deep
+    m_embeddedLanguages.clear();
+    QStringList embeddedNames = m_language.fenceLanguages.values();
+    embeddedNames.removeDuplicates();
+    for (const QString &name : embeddedNames) {
+        QJsonObject embeddedJson;
+        if (name == language || !readLanguageFile(name, embeddedJson)) {
+            continue;
+        }
+        LanguageRules embedded;
+        embedded.name = name;
+        loadLanguageRules(embeddedJson, embedded);
+        embedded.fenceStart = QRegularExpression();
+        m_embeddedLanguages.append(embedded);
+    }
     
     // Load theme if specified in language file
     if (json.contains("theme")) {
@@ -57,50 +166,263 @@ void SyntaxHighlighter::loadLanguage(const QString &language) {
     emit languageLoaded(language);
 }
 
+bool SyntaxHighlighter::readLanguageFile(const QString &language, QJsonObject &json) {
+    QString path = QString(":/syntax/language_defs/%1.json").arg(language);
+    QFile file(path);
+    
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open language file:" << path;
+        return false;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    json = doc.object();
+    file.close();
+    return true;
+}
+
+void SyntaxHighlighter::loadLanguageRules(const QJsonObject &json, LanguageRules &language) {
+    loadKeywords(json, language);
+    loadStrings(json, language);
+    loadComments(json, language);
+    loadBrackets(json, language);
+    loadHighlightingRules(json, language);
+    loadSpecialRules(json, language);
+    loadEmbeddedLanguages(json, language);
+}
+
 void SyntaxHighlighter::highlightBlock(const QString &text) {
     m_highlightTimer.restart();
 
-    // Apply all highlighting rules
-    for (const HighlightRule &rule : qAsConst(m_rules)) {
-        QRegularExpressionMatchIterator it = rule.pattern.globalMatch(text);
-        while (it.hasNext()) {
-            QRegularExpressionMatch match = it.next();
-            setFormat(match.capturedStart(rule.captureGroup),
-                     match.capturedLength(rule.captureGroup),
-                     rule.format);
+    const int previousState = previousBlockState();
+    auto *data = static_cast<HighlightBlockData *>(currentBlockUserData());
+    markDiagnosticsDirty(currentBlock().blockNumber());
+
+    if (!data || !data->isValidFor(text, previousState, m_lexer->generation)) {
+        // A parallel pass is about to deliver tokens for this block, or it
+        // was appended by a streaming load. Blocks the user edited since the
+        // pass started are lexed right away; the pass leaves them alone.
+        const bool pendingPass = m_parallelPending
+            && (m_parallelRevision < 0 || document()->revision() == m_parallelRevision);
+        const bool streamed = m_streaming && currentBlock().position() > m_streamBoundary.position();
+        if (pendingPass || streamed) {
+            setCurrentBlockState(previousState);
+            return;
+        }
+
+        if (!data) {
+            data = new HighlightBlockData;
+            setCurrentBlockUserData(data);
         }
+        const TokenStream previousTokens = data->tokens;
+        data->exitState = tokenizeLine(*m_lexer, text, previousState, data->tokens, data->delimiters,
+                                       data->degraded);
+        data->textHash = qHash(text);
+        data->entryState = previousState;
+        data->generation = m_lexer->generation;
+        if (data->tokens != previousTokens) {
+            emit tokensChanged(currentBlock().blockNumber(), currentBlock().blockNumber());
+        }
+    }
+
+    applyTokens(data->tokens);
+    data->formatEpoch = m_formatEpoch;
+    setCurrentBlockState(data->exitState);
+    scheduleDiagnostics();
+
+    // Reported once per burst of blocks rather than for every block
+    m_pendingHighlightNs += m_highlightTimer.nsecsElapsed();
+    FrameScheduler::instance()->postCoalesced(FrameScheduler::Highlighting, this, QStringLiteral("performance"), [this]() {
+        m_lastHighlightTime = m_pendingHighlightNs / 1000000;
+        m_pendingHighlightNs = 0;
+        emit highlightingPerformance(m_lastHighlightTime);
+    });
+}
+
+void SyntaxHighlighter::applyTokens(const TokenStream &tokens) {
+    for (int i = 0; i < tokens.size(); ++i) {
+        setFormat(tokens.start(i), tokens.length(i), m_formats.format(tokens.tokenClass(i)));
     }
+}
+
+const TokenStream *SyntaxHighlighter::tokensForBlock(const QTextBlock &block) const {
+    auto *data = static_cast<HighlightBlockData *>(block.userData());
+    if (!data || data->generation != m_lexer->generation) {
+        return nullptr;
+    }
+    return &data->tokens;
+}
+
+const FormatTable &SyntaxHighlighter::formatTable() const {
+    return m_formats;
+}
 
-    // Apply custom rules
-    for (const HighlightRule &rule : qAsConst(m_customRules)) {
-        QRegularExpressionMatchIterator it = rule.pattern.globalMatch(text);
-        while (it.hasNext()) {
-            QRegularExpressionMatch match = it.next();
-            setFormat(match.capturedStart(rule.captureGroup),
-                     match.capturedLength(rule.captureGroup),
-                     rule.format);
+int SyntaxHighlighter::tokenizeLine(const LexerSnapshot &lexer, const QString &text,
+                                    int previousState, TokenStream &tokens,
+                                    QVector<quint32> &delimiters, bool &degraded,
+                                    CacheBatch *batch) {
+    HighlightCache *cache = HighlightCache::instance();
+    const HighlightCache::Key key{HighlightCache::hashLine(text), previousState, lexer.languageVersion};
+    HighlightCache::Entry entry;
+    degraded = false;
+    if (cache->lookup(key, entry)) {
+        tokens = entry.tokens;
+        delimiters = entry.delimiters;
+        return entry.exitState;
+    }
+
+    // One scratch buffer per worker thread, reused for every line
+    static thread_local TokenStream::Builder builder;
+    builder.reset(text.length());
+
+    entry.exitState = lexLine(lexer, text, previousState, builder, degraded);
+    scanDelimiters(lexer, text, builder, entry.delimiters);
+    entry.tokens = builder.build();
+    // A line lexed under load would stay plain for every later lookup
+    // under the same language version, in this session and the next
+    if (!degraded) {
+        if (batch) {
+            batch->append(qMakePair(key, entry));
+        } else {
+            cache->insert(key, entry);
         }
     }
 
-    // Handle multi-line constructs
-    handleMultiLine(text);
+    tokens = entry.tokens;
+    delimiters = entry.delimiters;
+    return entry.exitState;
+}
+
+void SyntaxHighlighter::scanDelimiters(const LexerSnapshot &lexer, const QString &text,
+                                       const TokenStream::Builder &builder,
+                                       QVector<quint32> &delimiters) {
+    delimiters.clear();
+    const TokenStream::ClassId *classes = builder.classes();
+    const QChar *chars = text.constData();
+
+    for (int column = 0; column < text.length(); ++column) {
+        const ushort ch = chars[column].unicode();
+        if (ch >= 128 || lexer.delimiterKinds[ch] == LexerSnapshot::NoDelimiter
+            || lexer.opaqueClasses.testBit(classes[column])) {
+            continue;
+        }
+
+        // Pairs closed on the same line cancel out; only the unbalanced rest is kept
+        if (lexer.delimiterKinds[ch] == LexerSnapshot::CloseDelimiter && !delimiters.isEmpty()
+            && delimiterChar(delimiters.last()) == lexer.matchingOpen[ch]) {
+            delimiters.removeLast();
+        } else {
+            delimiters.append(encodeDelimiter(column, chars[column]));
+        }
+    }
+}
+
+int SyntaxHighlighter::lexLine(const LexerSnapshot &lexer, const QString &text,
+                               int previousState, TokenStream::Builder &builder, bool &degraded) {
+    if (!lexer.fenceStart.pattern().isEmpty()) {
+        if (inFence(previousState)) {
+            const QRegularExpressionMatch end = lexer.fenceEnd.match(text);
+            if (end.hasMatch()
+                && closesFence(fenceMarker(previousState), end.captured(lexer.fenceMarkerGroup))) {
+                builder.paint(0, text.length(), lexer.fenceClass);
+                return 0;
+            }
+
+            const int language = fenceLanguage(previousState);
+            if (language >= lexer.embedded.size()) {
+                // No lexer for this info string: plain code
+                builder.paint(0, text.length(), lexer.fenceClass);
+                return previousState;
+            }
+            const int innerState = lexLine(*lexer.embedded.at(language), text,
+                                           fenceInnerState(previousState), builder, degraded);
+            return fenceState(language, innerState, fenceMarker(previousState));
+        }
+
+        QRegularExpressionMatch fence = lexer.fenceStart.match(text);
+        if (fence.hasMatch()) {
+            builder.paint(0, text.length(), lexer.fenceClass);
+            const QString info = fence.captured(lexer.fenceInfoGroup).toLower();
+            const int marker = lexer.fenceMarkerGroup > 0
+                ? encodeFenceMarker(fence.captured(lexer.fenceMarkerGroup)) : 0;
+            return fenceState(lexer.fenceLanguages.value(info, kUnknownFenceLanguage), -1, marker);
+        }
+    }
+
+    // Rules are applied in order; later tokens override earlier ones.
+    // Most rules cannot match most lines, so the prefilter skips them
+    // (or the columns before their first candidate) without running the regex.
+    // A rule that hits its step or time limit leaves the rest of the line plain.
+    const RulePrefilter::LineProfile profile = RulePrefilter::profile(text);
+    QElapsedTimer ruleTimer;
+    for (int i = 0; i < lexer.rules.size(); ++i) {
+        const LexerSnapshot::Rule &rule = lexer.rules.at(i);
+        if (lexer.profile->isDisabled(i)) {
+            degraded = true;
+            continue;
+        }
+        const int from = rule.prefilter.firstCandidate(text, profile);
+        if (from < 0) {
+            continue;
+        }
+
+        ruleTimer.start();
+        int matches = 0;
+        const bool completed = RuleProfiler::forEachMatch(rule.pattern, text, from,
+            [&](const QRegularExpressionMatch &match) {
+                builder.paint(match.capturedStart(rule.captureGroup),
+                              match.capturedLength(rule.captureGroup),
+                              rule.tokenClass);
+            }, &matches);
+        lexer.profile->record(i, ruleTimer.nsecsElapsed(), matches, !completed);
+        if (!completed) {
+            degraded = true;
+        }
+    }
+
+    // Multi-line comments always win over single-line rules
+    if (lexer.blockCommentStart.pattern().isEmpty()) {
+        return previousState;
+    }
+
+    int state = 0;
+    int startIndex = 0;
+    int startLength = 0;
+    if (!inBlockComment(previousState)) {
+        QRegularExpressionMatch start = lexer.blockCommentStart.match(text);
+        startIndex = start.hasMatch() ? start.capturedStart() : -1;
+        startLength = start.capturedLength();
+    }
+
+    while (startIndex >= 0) {
+        QRegularExpressionMatch end = lexer.blockCommentEnd.match(text, startIndex + startLength);
+        int commentLength = 0;
+
+        if (!end.hasMatch()) {
+            state = 1;
+            commentLength = text.length() - startIndex;
+        } else {
+            commentLength = end.capturedEnd() - startIndex;
+        }
+
+        builder.paint(startIndex, commentLength, lexer.blockCommentClass);
+        if (state == 1) {
+            break;
+        }
 
-    // Check for syntax errors
-    SyntaxError error = checkSyntaxErrors(text);
-    if (error != NoError) {
-        emit syntaxErrorDetected(error, 0);
+        QRegularExpressionMatch start = lexer.blockCommentStart.match(
+            text, startIndex + qMax(commentLength, 1));
+        startIndex = start.hasMatch() ? start.capturedStart() : -1;
+        startLength = start.capturedLength();
     }
 
-    m_lastHighlightTime = m_highlightTimer.elapsed();
-    emit highlightingPerformance(m_lastHighlightTime);
+    return state;
 }
 
-void SyntaxHighlighter::loadKeywords(const QJsonObject &json) {
+void SyntaxHighlighter::loadKeywords(const QJsonObject &json, LanguageRules &language) {
     if (!json.contains("keywords")) return;
     
     QJsonObject keywords = json["keywords"].toObject();
-    QTextCharFormat format;
-    format.setForeground(m_themeColors.keyword);
 
     QStringList keywordTypes = {"primary", "secondary", "operators"};
     for (const QString &type : keywordTypes) {
@@ -109,61 +431,101 @@ void SyntaxHighlighter::loadKeywords(const QJsonObject &json) {
             for (const QString &word : words) {
                 HighlightRule rule;
                 rule.pattern = QRegularExpression(QString("\\b%1\\b").arg(word));
-                rule.format = format;
-                m_rules.append(rule);
+                rule.role = TokenStyle::Keyword;
+                language.rules.append(rule);
             }
         }
     }
 }
 
-void SyntaxHighlighter::loadStrings(const QJsonObject &json) {
+void SyntaxHighlighter::loadStrings(const QJsonObject &json, LanguageRules &language) {
     if (!json.contains("strings")) return;
     
     QJsonObject strings = json["strings"].toObject();
-    QTextCharFormat format;
-    format.setForeground(m_themeColors.string);
 
+    const bool escapes = strings.contains("escape_chars");
     QStringList delimiters = strings["delimiters"].toVariant().toStringList();
     for (const QString &delim : delimiters) {
         HighlightRule rule;
         QString pattern = QString("%1[^%1]*%1").arg(QRegularExpression::escape(delim));
+        if (escapes && delim.length() == 1) {
+            // An escaped delimiter does not end the string
+            pattern = QString("%1(?:[^%1\\\\]|\\\\.)*%1").arg(QRegularExpression::escape(delim));
+        }
         rule.pattern = QRegularExpression(pattern);
-        rule.format = format;
-        m_rules.append(rule);
+        rule.role = TokenStyle::String;
+        language.rules.append(rule);
+
+        // Stray quotes are reported as unclosed strings, unless strings may span lines
+        if (delim.length() == 1 && delim.at(0).unicode() < 128 && !strings["multi_line"].toBool()
+            && !(delim == "`" && strings["template_literals"].toBool())) {
+            language.quoteChars.append(delim);
+        }
     }
 
     if (strings["f_strings"].toBool()) {
         HighlightRule fStringRule;
         fStringRule.pattern = QRegularExpression(R"(f[\"'][^\"']*\{[^}]*\}[^\"']*[\"'])");
-        fStringRule.format = format;
-        m_rules.append(fStringRule);
+        fStringRule.role = TokenStyle::String;
+        language.rules.append(fStringRule);
     }
 }
 
-void SyntaxHighlighter::loadComments(const QJsonObject &json) {
+void SyntaxHighlighter::loadComments(const QJsonObject &json, LanguageRules &language) {
     if (!json.contains("comments")) return;
     
     QJsonObject comments = json["comments"].toObject();
     QTextCharFormat format;
-    format.setForeground(m_themeColors.comment);
     format.setFontItalic(true);
 
     if (comments.contains("line")) {
         HighlightRule rule;
-        rule.pattern = QRegularExpression(QString("%1.*").arg(comments["line"].toString()));
+        rule.pattern = QRegularExpression(QString("%1.*").arg(QRegularExpression::escape(comments["line"].toString())));
         rule.format = format;
-        m_rules.append(rule);
+        rule.role = TokenStyle::Comment;
+        language.rules.append(rule);
     }
 
     if (comments.contains("block")) {
         QJsonObject block = comments["block"].toObject();
-        m_blockCommentStart = QRegularExpression(block["start"].toString());
-        m_blockCommentEnd = QRegularExpression(block["end"].toString());
-        m_blockCommentFormat = format;
+        language.blockCommentStart = QRegularExpression(QRegularExpression::escape(block["start"].toString()));
+        language.blockCommentEnd = QRegularExpression(QRegularExpression::escape(block["end"].toString()));
+        language.blockCommentStyle.role = TokenStyle::Comment;
+        language.blockCommentStyle.overrides = format;
     }
 }
 
-void SyntaxHighlighter::loadHighlightingRules(const QJsonObject &json) {
+void SyntaxHighlighter::loadBrackets(const QJsonObject &json, LanguageRules &language) {
+    if (!json.contains("brackets")) return;
+
+    for (const QString &pair : json["brackets"].toVariant().toStringList()) {
+        if (pair.length() != 2 || pair.at(0).unicode() >= 128 || pair.at(1).unicode() >= 128) {
+            qWarning() << "Ignoring invalid bracket pair:" << pair;
+            continue;
+        }
+        language.bracketPairs.append(pair);
+    }
+}
+
+void SyntaxHighlighter::loadEmbeddedLanguages(const QJsonObject &json, LanguageRules &language) {
+    if (!json.contains("embedded_languages")) return;
+
+    QJsonObject embedded = json["embedded_languages"].toObject();
+    language.fenceStart = QRegularExpression(embedded["fence_start"].toString());
+    language.fenceEnd = QRegularExpression(embedded["fence_end"].toString());
+    language.fenceInfoGroup = embedded.value("info_group").toInt(0);
+    language.fenceMarkerGroup = embedded.value("marker_group").toInt(0);
+    language.fenceStyle = createStyleFromJson(embedded["style"].toObject());
+
+    QJsonObject languages = embedded["languages"].toObject();
+    for (const QString &name : languages.keys()) {
+        for (const QString &alias : languages[name].toVariant().toStringList()) {
+            language.fenceLanguages.insert(alias.toLower(), name);
+        }
+    }
+}
+
+void SyntaxHighlighter::loadHighlightingRules(const QJsonObject &json, LanguageRules &language) {
     if (!json.contains("highlighting_rules")) return;
     
     for (const QJsonValue &ruleValue : json["highlighting_rules"].toArray()) {
@@ -173,14 +535,15 @@ void SyntaxHighlighter::loadHighlightingRules(const QJsonObject &json) {
         rule.pattern = QRegularExpression(ruleObj["pattern"].toString());
         rule.captureGroup = ruleObj.value("capture_group").toInt(0);
         
-        QJsonObject style = ruleObj["style"].toObject();
-        rule.format = createFormatFromStyle(style);
+        TokenStyle style = createStyleFromJson(ruleObj["style"].toObject());
+        rule.format = style.overrides;
+        rule.role = style.role;
         
-        m_rules.append(rule);
+        language.rules.append(rule);
     }
 }
 
-void SyntaxHighlighter::loadSpecialRules(const QJsonObject &json) {
+void SyntaxHighlighter::loadSpecialRules(const QJsonObject &json, LanguageRules &language) {
     if (!json.contains("special_rules")) return;
     
     QJsonObject specials = json["special_rules"].toObject();
@@ -191,29 +554,31 @@ void SyntaxHighlighter::loadSpecialRules(const QJsonObject &json) {
         rule.pattern = QRegularExpression(ruleObj["pattern"].toString());
         rule.captureGroup = ruleObj.value("capture_group").toInt(0);
         
-        QJsonObject style = ruleObj["style"].toObject();
-        rule.format = createFormatFromStyle(style);
+        TokenStyle style = createStyleFromJson(ruleObj["style"].toObject());
+        rule.format = style.overrides;
+        rule.role = style.role;
         
-        m_rules.append(rule);
+        language.rules.append(rule);
     }
 }
 
-QTextCharFormat SyntaxHighlighter::createFormatFromStyle(const QJsonObject &style) {
-    QTextCharFormat format;
+TokenStyle SyntaxHighlighter::createStyleFromJson(const QJsonObject &style) {
+    TokenStyle tokenStyle;
+    QTextCharFormat &format = tokenStyle.overrides;
     
     // Priority 1: Explicit color from JSON
     if (style.contains("color")) {
         format.setForeground(QColor(style["color"].toString()));
     }
-    // Priority 2: Theme color based on type
+    // Priority 2: Theme color based on type, resolved by the format table
     else if (style.contains("type")) {
         QString type = style["type"].toString();
-        if (type == "keyword") format.setForeground(m_themeColors.keyword);
-        else if (type == "string") format.setForeground(m_themeColors.string);
-        else if (type == "comment") format.setForeground(m_themeColors.comment);
-        else if (type == "number") format.setForeground(m_themeColors.number);
-        else if (type == "function") format.setForeground(m_themeColors.function);
-        else if (type == "type") format.setForeground(m_themeColors.type);
+        if (type == "keyword") tokenStyle.role = TokenStyle::Keyword;
+        else if (type == "string") tokenStyle.role = TokenStyle::String;
+        else if (type == "comment") tokenStyle.role = TokenStyle::Comment;
+        else if (type == "number") tokenStyle.role = TokenStyle::Number;
+        else if (type == "function") tokenStyle.role = TokenStyle::Function;
+        else if (type == "type") tokenStyle.role = TokenStyle::Type;
     }
     
     if (style.contains("background")) {
@@ -227,34 +592,7 @@ QTextCharFormat SyntaxHighlighter::createFormatFromStyle(const QJsonObject &styl
         else if (fontStyle == "underline") format.setUnderlineStyle(QTextCharFormat::SingleUnderline);
     }
     
-    return format;
-}
-
-void SyntaxHighlighter::handleMultiLine(const QString &text) {
-    if (m_blockCommentStart.pattern().isEmpty()) return;
-
-    setCurrentBlockState(previousBlockState());
-
-    int startIndex = 0;
-    if (previousBlockState() != 1) {
-        startIndex = text.indexOf(m_blockCommentStart);
-    }
-
-    while (startIndex >= 0) {
-        QRegularExpressionMatch match = m_blockCommentEnd.match(text, startIndex);
-        int endIndex = match.capturedStart();
-        int commentLength = 0;
-
-        if (endIndex == -1) {
-            setCurrentBlockState(1);
-            commentLength = text.length() - startIndex;
-        } else {
-            commentLength = endIndex - startIndex + match.capturedLength();
-        }
-
-        setFormat(startIndex, commentLength, m_blockCommentFormat);
-        startIndex = text.indexOf(m_blockCommentStart, startIndex + commentLength);
-    }
+    return tokenStyle;
 }
 
 void SyntaxHighlighter::loadDefaultRules() {
@@ -265,7 +603,7 @@ void SyntaxHighlighter::loadDefaultRules() {
     
     rule.pattern = QRegularExpression(".");
     rule.format = defaultFormat;
-    m_rules.append(rule);
+    m_language.rules.append(rule);
 }
 
 void SyntaxHighlighter::setTheme(const QString &themeName) {
@@ -282,10 +620,58 @@ void SyntaxHighlighter::setTheme(const QString &themeName) {
     file.close();
 
     m_currentTheme = themeName;
-    rehighlight();
+
+    // Token streams do not depend on colors: repaint without re-lexing
+    repaintStaleBlocks();
     emit themeChanged(themeName);
 }
 
+void SyntaxHighlighter::repaintStaleBlocks() {
+    // What is on screen first, the rest in frame-budgeted batches
+    refreshFormats(m_visibleFirst, m_visibleLast);
+    const bool sweeping = m_sweepBlock >= 0;
+    m_sweepBlock = 0;
+    if (!sweeping) {
+        FrameScheduler::instance()->post(FrameScheduler::Highlighting, this,
+                                         [this]() { sweepStaleFormats(); });
+    }
+}
+
+void SyntaxHighlighter::setVisibleBlocks(int firstBlock, int lastBlock) {
+    m_visibleFirst = firstBlock;
+    m_visibleLast = lastBlock;
+    refreshFormats(firstBlock, lastBlock);
+}
+
+void SyntaxHighlighter::refreshFormats(int firstBlock, int lastBlock) {
+    QTextDocument *doc = document();
+    if (!doc) return;
+
+    QTextBlock block = doc->findBlockByNumber(firstBlock);
+    for (int number = firstBlock; block.isValid() && number <= lastBlock; ++number, block = block.next()) {
+        auto *data = static_cast<HighlightBlockData *>(block.userData());
+        if (!data || data->formatEpoch != m_formatEpoch) {
+            rehighlightBlock(block);
+        }
+    }
+}
+
+void SyntaxHighlighter::sweepStaleFormats() {
+    QTextDocument *doc = document();
+    if (!doc || m_sweepBlock < 0) return;
+
+    const int lastBlock = m_sweepBlock + kSweepBatchBlocks - 1;
+    refreshFormats(m_sweepBlock, lastBlock);
+    m_sweepBlock = lastBlock + 1;
+
+    if (m_sweepBlock < doc->blockCount()) {
+        FrameScheduler::instance()->post(FrameScheduler::Highlighting, this,
+                                         [this]() { sweepStaleFormats(); });
+    } else {
+        m_sweepBlock = -1;
+    }
+}
+
 void SyntaxHighlighter::loadTheme(const QJsonObject &json) {
     if (json.contains("colors")) {
         QJsonObject colors = json["colors"].toObject();
@@ -301,15 +687,17 @@ void SyntaxHighlighter::loadTheme(const QJsonObject &json) {
 }
 
 void SyntaxHighlighter::updateThemeColors() {
-    for (auto &rule : m_rules) {
-        if (rule.format.foreground().color() == QColor("#569CD6")) {
-            rule.format.setForeground(m_themeColors.keyword);
-        }
-        // Update other color mappings similarly...
-    }
-    
-    // Update block comment format
-    m_blockCommentFormat.setForeground(m_themeColors.comment);
+    // Indexed by TokenStyle::Role; class ids and token streams stay valid
+    QVector<QColor> roleColors(TokenStyle::RoleCount);
+    roleColors[TokenStyle::Keyword] = m_themeColors.keyword;
+    roleColors[TokenStyle::String] = m_themeColors.string;
+    roleColors[TokenStyle::Comment] = m_themeColors.comment;
+    roleColors[TokenStyle::Number] = m_themeColors.number;
+    roleColors[TokenStyle::Function] = m_themeColors.function;
+    roleColors[TokenStyle::Type] = m_themeColors.type;
+
+    m_formats.setRoleColors(roleColors);
+    ++m_formatEpoch;
 }
 
 void SyntaxHighlighter::reloadCurrentLanguage() {
@@ -321,19 +709,230 @@ void SyntaxHighlighter::reloadCurrentLanguage() {
     }
 }
 
-SyntaxHighlighter::SyntaxError SyntaxHighlighter::checkSyntaxErrors(const QString &text) const {
-    if (!m_blockCommentStart.pattern().isEmpty() && 
-        text.contains(m_blockCommentStart) && 
-        !text.contains(m_blockCommentEnd)) {
-        return UnclosedComment;
+const SyntaxHighlighter::Diagnostics &SyntaxHighlighter::diagnostics() const {
+    return m_diagnostics;
+}
+
+void SyntaxHighlighter::scheduleDiagnostics() {
+    FrameScheduler::instance()->postCoalesced(FrameScheduler::Highlighting, this, QStringLiteral("diagnostics"),
+                                              [this]() { publishDiagnostics(); });
+}
+
+// Keeps the segments in step with the document. Called first for the block
+// where an edit starts, which is where lines were inserted or removed.
+void SyntaxHighlighter::markDiagnosticsDirty(int line) {
+    if (m_delimiterSegments.isEmpty()) {
+        return; // Built on the next publish
     }
 
-    // Add more syntax checks here
-    return NoError;
+    const int delta = document()->blockCount() - m_segmentedBlockCount;
+    int index = delimiterSegmentAt(line);
+    if (delta > 0) {
+        m_delimiterSegments[index].lineCount += delta;
+    } else if (delta < 0) {
+        // The removed lines followed this one
+        int remaining = -delta;
+        int offset = line - m_delimiterSegments.at(index).firstLine + 1;
+        for (int i = index; remaining > 0 && i < m_delimiterSegments.size(); ++i, offset = 0) {
+            DelimiterSegment &segment = m_delimiterSegments[i];
+            const int removed = qMin(remaining, qMax(0, segment.lineCount - offset));
+            segment.lineCount -= removed;
+            segment.dirty = true;
+            remaining -= removed;
+        }
+        if (remaining > 0) {
+            m_delimiterSegments.clear();
+            return;
+        }
+        auto empty = [](const DelimiterSegment &segment) { return segment.lineCount == 0; };
+        m_delimiterSegments.erase(std::remove_if(m_delimiterSegments.begin() + index,
+                                                 m_delimiterSegments.end(), empty),
+                                  m_delimiterSegments.end());
+        if (m_delimiterSegments.isEmpty()) {
+            return;
+        }
+    }
+    if (delta != 0) {
+        m_segmentedBlockCount += delta;
+        for (int i = qMax(1, index); i < m_delimiterSegments.size(); ++i) {
+            const DelimiterSegment &previous = m_delimiterSegments.at(i - 1);
+            m_delimiterSegments[i].firstLine = previous.firstLine + previous.lineCount;
+        }
+        index = delimiterSegmentAt(line);
+    }
+    m_delimiterSegments[index].dirty = true;
+}
+
+void SyntaxHighlighter::resetDelimiterSegments(int blockCount) {
+    m_delimiterSegments.clear();
+    for (int first = 0; first < blockCount; first += kDelimiterSegmentLines) {
+        DelimiterSegment segment;
+        segment.firstLine = first;
+        segment.lineCount = qMin(kDelimiterSegmentLines, blockCount - first);
+        m_delimiterSegments.append(segment);
+    }
+    m_segmentedBlockCount = blockCount;
+    m_segmentedGeneration = m_lexer->generation;
+}
+
+int SyntaxHighlighter::delimiterSegmentAt(int line) const {
+    auto after = std::upper_bound(m_delimiterSegments.begin(), m_delimiterSegments.end(), line,
+                                  [](int line, const DelimiterSegment &segment) {
+                                      return line < segment.firstLine;
+                                  });
+    return qMax(0, int(after - m_delimiterSegments.begin()) - 1);
+}
+
+// Matches the delimiters inside the segment; block is left after its last line
+void SyntaxHighlighter::scanDelimiterSegment(QTextBlock &block, DelimiterSegment &segment) const {
+    const LexerSnapshot &lexer = *m_lexer;
+    segment.errors.clear();
+    segment.closes.clear();
+    segment.opens.clear();
+    segment.commentRunStart = -1;
+
+    for (int line = 0; line < segment.lineCount && block.isValid(); ++line, block = block.next()) {
+        if (!inBlockComment(block.userState())) {
+            segment.commentRunStart = -1;
+        } else if (segment.commentRunStart < 0) {
+            segment.commentRunStart = line;
+        }
+
+        auto *data = static_cast<HighlightBlockData *>(block.userData());
+        if (!data || data->generation != lexer.generation) {
+            continue; // Not lexed with the current rules yet
+        }
+
+        for (quint32 delimiter : qAsConst(data->delimiters)) {
+            const char ch = delimiterChar(delimiter);
+            const int column = delimiterColumn(delimiter);
+            switch (lexer.delimiterKinds[uchar(ch)]) {
+            case LexerSnapshot::QuoteDelimiter:
+                if (segment.errors.size() < kMaxDiagnostics) {
+                    segment.errors.append({UnclosedString, line, column});
+                }
+                break;
+            case LexerSnapshot::OpenDelimiter:
+                segment.opens.append({line, column, ch});
+                break;
+            case LexerSnapshot::CloseDelimiter:
+                if (segment.opens.isEmpty()) {
+                    segment.closes.append({line, column, ch});
+                    break;
+                }
+                if (segment.opens.last().ch != lexer.matchingOpen[uchar(ch)]
+                    && segment.errors.size() < kMaxDiagnostics) {
+                    segment.errors.append({UnmatchedDelimiter, line, column});
+                }
+                segment.opens.removeLast();
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    segment.dirty = false;
+}
+
+void SyntaxHighlighter::publishDiagnostics() {
+    QTextDocument *doc = document();
+    if (!doc || m_parallelPending) return;
+
+    const LexerSnapshot &lexer = *m_lexer;
+    if (m_delimiterSegments.isEmpty() || m_segmentedBlockCount != doc->blockCount()
+        || m_segmentedGeneration != lexer.generation) {
+        resetDelimiterSegments(doc->blockCount());
+    }
+
+    // Rescan what changed, splitting segments that grew by insertions
+    QTextBlock block;
+    int blockLine = -1;
+    for (int i = 0; i < m_delimiterSegments.size(); ++i) {
+        if (!m_delimiterSegments.at(i).dirty) {
+            continue;
+        }
+        if (m_delimiterSegments.at(i).lineCount > 2 * kDelimiterSegmentLines) {
+            DelimiterSegment rest;
+            rest.firstLine = m_delimiterSegments.at(i).firstLine + kDelimiterSegmentLines;
+            rest.lineCount = m_delimiterSegments.at(i).lineCount - kDelimiterSegmentLines;
+            m_delimiterSegments[i].lineCount = kDelimiterSegmentLines;
+            m_delimiterSegments.insert(i + 1, rest);
+        }
+        DelimiterSegment &segment = m_delimiterSegments[i];
+        if (blockLine != segment.firstLine) {
+            block = doc->findBlockByNumber(segment.firstLine);
+        }
+        scanDelimiterSegment(block, segment);
+        blockLine = segment.firstLine + segment.lineCount;
+    }
+
+    // Match the per-segment leftovers across the whole document
+    QVector<SegmentDelimiter> open;
+    QVector<SyntaxDiagnostic> items;
+    auto report = [&items](SyntaxError error, int line, int column) {
+        if (items.size() < kMaxDiagnostics) {
+            items.append({error, line, column});
+        }
+    };
+    for (const DelimiterSegment &segment : qAsConst(m_delimiterSegments)) {
+        for (const SyntaxDiagnostic &error : segment.errors) {
+            report(error.error, segment.firstLine + error.line, error.column);
+        }
+        for (const SegmentDelimiter &close : segment.closes) {
+            if (open.isEmpty() || open.last().ch != lexer.matchingOpen[uchar(close.ch)]) {
+                report(UnmatchedDelimiter, segment.firstLine + close.line, close.column);
+            }
+            if (!open.isEmpty()) {
+                open.removeLast();
+            }
+        }
+        for (const SegmentDelimiter &delimiter : segment.opens) {
+            open.append({segment.firstLine + delimiter.line, delimiter.column, delimiter.ch});
+        }
+    }
+    for (const SegmentDelimiter &delimiter : qAsConst(open)) {
+        report(UnmatchedDelimiter, delimiter.line, delimiter.column);
+    }
+
+    // Final state at EOF: report where a still-open block comment started
+    int commentLine = -1;
+    for (int i = m_delimiterSegments.size() - 1; i >= 0; --i) {
+        const DelimiterSegment &segment = m_delimiterSegments.at(i);
+        if (segment.commentRunStart < 0) {
+            break;
+        }
+        commentLine = segment.firstLine + segment.commentRunStart;
+        if (segment.commentRunStart > 0) {
+            break;
+        }
+    }
+    if (commentLine >= 0) {
+        block = doc->findBlockByNumber(commentLine);
+        int column = 0;
+        if (const TokenStream *tokens = tokensForBlock(block)) {
+            for (int i = tokens->size() - 1; i >= 0; --i) {
+                if (tokens->tokenClass(i) == lexer.blockCommentClass) {
+                    column = tokens->start(i);
+                    break;
+                }
+            }
+        }
+        report(UnclosedComment, commentLine, column);
+    }
+
+    std::sort(items.begin(), items.end(), [](const SyntaxDiagnostic &a, const SyntaxDiagnostic &b) {
+        return a.line != b.line ? a.line < b.line : a.column < b.column;
+    });
+
+    m_diagnostics.version++;
+    m_diagnostics.documentRevision = doc->revision();
+    m_diagnostics.items = items;
+    emit diagnosticsUpdated(m_diagnostics);
 }
 
 void SyntaxHighlighter::addCustomRule(const HighlightRule &rule) {
     m_customRules.append(rule);
+    precompilePatterns();
     rehighlight();
 }
 
@@ -343,36 +942,316 @@ void SyntaxHighlighter::removeCustomRule(const QRegularExpression &pattern) {
             return rule.pattern.pattern() == pattern.pattern();
         });
     m_customRules.erase(it, m_customRules.end());
+    precompilePatterns();
     rehighlight();
 }
 
 void SyntaxHighlighter::clearCustomRules() {
     m_customRules.clear();
+    precompilePatterns();
     rehighlight();
 }
 
 void SyntaxHighlighter::precompilePatterns() {
-    for (auto &rule : m_rules) {
-        rule.pattern.optimize();
+    // Publish a fresh snapshot; running workers keep their old one alive
+    m_formats.clear();
+    QSharedPointer<LexerSnapshot> lexer = buildSnapshot(m_language, m_customRules);
+
+    // Embedded lexers share the class id space of the host
+    quint64 version = lexer->languageVersion;
+    for (const LanguageRules &embedded : qAsConst(m_embeddedLanguages)) {
+        QSharedPointer<LexerSnapshot> embeddedLexer = buildSnapshot(embedded, QVector<HighlightRule>());
+        version = (version ^ embeddedLexer->languageVersion) * 1099511628211ULL;
+        lexer->embedded.append(embeddedLexer);
     }
-    for (auto &rule : m_customRules) {
-        rule.pattern.optimize();
+    for (auto it = m_language.fenceLanguages.cbegin(); it != m_language.fenceLanguages.cend(); ++it) {
+        for (int i = 0; i < m_embeddedLanguages.size(); ++i) {
+            if (m_embeddedLanguages.at(i).name == it.value()) {
+                lexer->fenceLanguages.insert(it.key(), i);
+                break;
+            }
+        }
     }
-    m_blockCommentStart.optimize();
-    m_blockCommentEnd.optimize();
+
+    lexer->generation = nextLexerGeneration();
+    lexer->languageVersion = version;
+    m_lexer = lexer;
 }
 
-void SyntaxHighlighter::highlightInParallel(const QString &text) {
-    QFuture<void> future = QtConcurrent::map(m_rules, [this, &text](HighlightRule &rule) {
-        QRegularExpressionMatchIterator it = rule.pattern.globalMatch(text);
-        while (it.hasNext()) {
-            QRegularExpressionMatch match = it.next();
-            setFormat(match.capturedStart(rule.captureGroup),
-                     match.capturedLength(rule.captureGroup),
-                     rule.format);
+QSharedPointer<SyntaxHighlighter::LexerSnapshot> SyntaxHighlighter::buildSnapshot(
+    const LanguageRules &language, const QVector<HighlightRule> &customRules) {
+    auto lexer = QSharedPointer<LexerSnapshot>::create();
+    lexer->opaqueClasses.resize(256);
+
+    QStringList patterns;
+    for (const HighlightRule &rule : language.rules + customRules) {
+        const TokenStyle style{rule.role, rule.format};
+        const TokenStream::ClassId tokenClass = m_formats.intern(style);
+        QRegularExpression pattern = RuleProfiler::guardedPattern(rule.pattern);
+        pattern.optimize();
+        lexer->rules.append({pattern, rule.captureGroup, tokenClass, RulePrefilter::fromPattern(rule.pattern)});
+        patterns.append(rule.pattern.pattern());
+        if (rule.role == TokenStyle::String || rule.role == TokenStyle::Comment) {
+            lexer->opaqueClasses.setBit(tokenClass);
         }
-    });
-    future.waitForFinished();
+    }
+
+    lexer->blockCommentStart = language.blockCommentStart;
+    lexer->blockCommentEnd = language.blockCommentEnd;
+    lexer->blockCommentStart.optimize();
+    lexer->blockCommentEnd.optimize();
+    lexer->blockCommentClass = m_formats.intern(language.blockCommentStyle);
+    lexer->opaqueClasses.setBit(lexer->blockCommentClass);
+    lexer->opaqueClasses.clearBit(TokenStream::PlainText);
+
+    for (const QString &pair : language.bracketPairs) {
+        const ushort open = pair.at(0).unicode();
+        const ushort close = pair.at(1).unicode();
+        lexer->delimiterKinds[open] = LexerSnapshot::OpenDelimiter;
+        lexer->delimiterKinds[close] = LexerSnapshot::CloseDelimiter;
+        lexer->matchingOpen[close] = char(open);
+    }
+    for (const QChar &quote : language.quoteChars) {
+        lexer->delimiterKinds[quote.unicode()] = LexerSnapshot::QuoteDelimiter;
+    }
+
+    if (!language.fenceStart.pattern().isEmpty()) {
+        lexer->fenceStart = language.fenceStart;
+        lexer->fenceEnd = language.fenceEnd;
+        lexer->fenceStart.optimize();
+        lexer->fenceEnd.optimize();
+        lexer->fenceInfoGroup = language.fenceInfoGroup;
+        lexer->fenceMarkerGroup = language.fenceMarkerGroup;
+        lexer->fenceClass = m_formats.intern(language.fenceStyle);
+    }
+
+    lexer->languageVersion = computeLanguageVersion(language, customRules);
+    lexer->profile = RuleProfiler::instance()->profile(
+        language.name.isEmpty() ? QStringLiteral("plain") : language.name, lexer->languageVersion, patterns);
+    return lexer;
+}
+
+quint64 SyntaxHighlighter::computeLanguageVersion(const LanguageRules &language,
+                                                  const QVector<HighlightRule> &customRules) {
+    // Everything that influences lexer output, including the class id order
+    QByteArray description;
+    QDataStream out(&description, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_15);
+    for (const HighlightRule &rule : language.rules + customRules) {
+        out << rule.pattern.pattern() << qint32(rule.pattern.patternOptions())
+            << qint32(rule.captureGroup) << quint8(rule.role) << rule.format;
+    }
+    out << language.blockCommentStart.pattern() << language.blockCommentEnd.pattern()
+        << quint8(language.blockCommentStyle.role) << language.blockCommentStyle.overrides
+        << language.bracketPairs << language.quoteChars
+        << language.fenceStart.pattern() << language.fenceEnd.pattern() << qint32(language.fenceInfoGroup)
+        << qint32(language.fenceMarkerGroup)
+        << quint8(language.fenceStyle.role) << language.fenceStyle.overrides << language.fenceLanguages;
+
+    const QByteArray digest = QCryptographicHash::hash(description, QCryptographicHash::Sha1);
+    quint64 version = 0;
+    std::memcpy(&version, digest.constData(), sizeof(version));
+    return version;
+}
+
+void SyntaxHighlighter::persistTokens(const QString &filePath) const {
+    QTextDocument *doc = document();
+    if (!doc || filePath.isEmpty()) return;
+
+    QVector<QPair<HighlightCache::Key, HighlightCache::Entry>> entries;
+    entries.reserve(doc->blockCount());
+    for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+        auto *data = static_cast<HighlightBlockData *>(block.userData());
+        if (!data || data->generation != m_lexer->generation || data->degraded) {
+            continue;
+        }
+        const HighlightCache::Key key{HighlightCache::hashLine(block.text()), data->entryState,
+                                      m_lexer->languageVersion};
+        entries.append(qMakePair(key, HighlightCache::Entry{data->tokens, data->exitState, data->delimiters}));
+    }
+    HighlightCache::instance()->saveFile(filePath, entries);
+}
+
+void SyntaxHighlighter::loadTextInParallel(const QString &text) {
+    QTextDocument *doc = document();
+    if (!doc) return;
+
+    // Suppress the synchronous per-block pass triggered by setPlainText()
+    m_parallelPending = text.count(QLatin1Char('\n')) >= kParallelThresholdLines;
+    m_parallelRevision = -1;
+    doc->setPlainText(text);
+    if (m_parallelPending) {
+        rehighlightInParallel();
+    }
+}
+
+void SyntaxHighlighter::beginStreamingLoad(const QString &firstChunk) {
+    loadTextInParallel(firstChunk);
+    // Appended blocks are skipped by highlightBlock() until the final pass
+    m_streamBoundary = QTextCursor(document());
+    m_streamBoundary.movePosition(QTextCursor::End);
+    m_streamBoundary.setKeepPositionOnInsert(true);
+    m_streaming = true;
+}
+
+void SyntaxHighlighter::finishStreamingLoad() {
+    m_streaming = false;
+    m_streamBoundary = QTextCursor();
+    rehighlightInParallel();
+}
+
+bool SyntaxHighlighter::isParallelPassRunning() const {
+    return m_parallelWatcher->isRunning();
+}
+
+void SyntaxHighlighter::rehighlightInParallel() {
+    QTextDocument *doc = document();
+    if (!doc) return;
+
+    if (doc->blockCount() < kParallelThresholdLines) {
+        m_parallelPending = false;
+        rehighlight();
+        return;
+    }
+
+    if (m_parallelWatcher->isRunning()) {
+        m_parallelWatcher->cancel();
+        m_parallelWatcher->waitForFinished();
+    }
+
+    m_parallelTimer.start();
+    m_parallelPending = true;
+    m_parallelRevision = doc->revision();
+
+    // QTextDocument is not thread-safe: copy the (implicitly shared) line texts
+    m_parallelLines.clear();
+    m_parallelLines.reserve(doc->blockCount());
+    for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+        m_parallelLines.append(block.text());
+    }
+
+    // Several chunks per worker so that uneven lines still balance out
+    const int workers = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+    const int lineCount = m_parallelLines.size();
+    const int chunkLines = qMax(kMinChunkLines, lineCount / (workers * 4) + 1);
+
+    QVector<QPair<int, int>> chunks;
+    for (int first = 0; first < lineCount; first += chunkLines) {
+        chunks.append(qMakePair(first, qMin(chunkLines, lineCount - first)));
+    }
+
+    const bool fillCache =
+        lineCount * kEstimatedEntryBytes <= HighlightCache::instance()->memoryLimit();
+    QSharedPointer<const LexerSnapshot> lexer = m_lexer;
+    QStringList lines = m_parallelLines;
+    std::function<ChunkResult(const QPair<int, int> &)> lex =
+        [lexer, lines, fillCache](const QPair<int, int> &chunk) {
+            return lexChunk(*lexer, lines, chunk.first, chunk.second, fillCache);
+        };
+    m_parallelWatcher->setFuture(QtConcurrent::mapped(chunks, lex));
+}
+
+SyntaxHighlighter::ChunkResult SyntaxHighlighter::lexChunk(const LexerSnapshot &lexer,
+                                                           const QStringList &lines,
+                                                           int firstLine, int lineCount,
+                                                           bool fillCache) {
+    ChunkResult result;
+    result.firstLine = firstLine;
+    result.generation = lexer.generation;
+    // Speculate that every chunk starts outside any comment or fence;
+    // mergeParallelResults() re-lexes lines where that guess was wrong
+    result.entryState = -1;
+    result.tokens.resize(lineCount);
+    result.exitStates.resize(lineCount);
+    result.delimiters.resize(lineCount);
+    result.degraded.resize(lineCount);
+
+    // Inserted once per chunk, so workers do not contend for the cache per line
+    CacheBatch batch;
+    int state = result.entryState;
+    for (int i = 0; i < lineCount; ++i) {
+        state = tokenizeLine(lexer, lines.at(firstLine + i), state, result.tokens[i],
+                             result.delimiters[i], result.degraded[i], &batch);
+        result.exitStates[i] = state;
+    }
+    if (fillCache) {
+        HighlightCache::instance()->insert(batch);
+    }
+    return result;
+}
+
+void SyntaxHighlighter::mergeParallelResults() {
+    QTextDocument *doc = document();
+    QStringList lines;
+    lines.swap(m_parallelLines);
+
+    if (!doc || m_parallelWatcher->isCanceled()) {
+        m_parallelPending = false;
+        return;
+    }
+
+    // If the user edited meanwhile, blocks are matched by text and the rest
+    // is left to highlightBlock()
+    const bool unchanged = doc->revision() == m_parallelRevision;
+    const QSharedPointer<const LexerSnapshot> lexer = m_lexer;
+    QList<ChunkResult> results = m_parallelWatcher->future().results();
+    if (!results.isEmpty() && results.first().generation != lexer->generation) {
+        // Rules changed while the workers ran; their class ids are stale
+        results.clear();
+    }
+
+    QTextBlock block = doc->begin();
+    int state = -1;
+    for (const ChunkResult &chunk : results) {
+        for (int i = 0; i < chunk.exitStates.size() && block.isValid(); ++i, block = block.next()) {
+            const QString &text = lines.at(chunk.firstLine + i);
+            if (!unchanged && block.text() != text) {
+                state = -1;
+                continue;
+            }
+
+            const int speculated = i == 0 ? chunk.entryState : chunk.exitStates.at(i - 1);
+            auto *data = static_cast<HighlightBlockData *>(block.userData());
+            if (!data) {
+                data = new HighlightBlockData;
+                block.setUserData(data);
+            }
+
+            if (equivalentStates(speculated, state)) {
+                data->tokens = chunk.tokens.at(i);
+                data->exitState = chunk.exitStates.at(i);
+                data->delimiters = chunk.delimiters.at(i);
+                data->degraded = chunk.degraded.at(i);
+            } else {
+                // Wrong guess: fix up until the states converge again
+                data->exitState = tokenizeLine(*lexer, text, state, data->tokens, data->delimiters,
+                                               data->degraded);
+            }
+            data->textHash = qHash(text);
+            data->entryState = state;
+            data->generation = lexer->generation;
+            data->formatEpoch = 0; // Not painted yet
+            state = data->exitState;
+            // Blocks may be painted out of order, so their states must be final
+            block.setUserState(state);
+        }
+    }
+
+    // Every block now carries valid tokens; painting them is budgeted per frame
+    m_parallelPending = false;
+    m_delimiterSegments.clear();
+    emit tokensChanged(0, doc->blockCount() - 1);
+    repaintStaleBlocks();
+    scheduleDiagnostics();
+    emit parallelHighlightFinished(m_parallelTimer.elapsed());
+}
+
+QVector<RuleProfiler::LanguageMetrics> SyntaxHighlighter::ruleMetrics() const {
+    QVector<RuleProfiler::LanguageMetrics> metrics{m_lexer->profile->metrics()};
+    for (const auto &embedded : m_lexer->embedded) {
+        metrics.append(embedded->profile->metrics());
+    }
+    return metrics;
 }
 
 qint64 SyntaxHighlighter::lastHighlightTime() const {
@@ -7,8 +7,19 @@
 #include <QVector>
 #include <QJsonObject>
 #include <QFuture>
+#include <QFutureWatcher>
 #include <QElapsedTimer>
 #include <QMap>
+#include <QHash>
+#include <QSharedPointer>
+#include <QTextBlockUserData>
+#include <QTextCursor>
+#include <QBitArray>
+#include <QPair>
+#include "highlight_cache.h"
+#include "rule_prefilter.h"
+#include "rule_profiler.h"
+#include "token_stream.h"
 
 class SyntaxHighlighter : public QSyntaxHighlighter
 {
@@ -17,8 +28,9 @@ class SyntaxHighlighter : public QSyntaxHighlighter
 public:
     struct HighlightRule {
         QRegularExpression pattern;
-        QTextCharFormat format;
+        QTextCharFormat format; // Explicit properties, win over the theme
         int captureGroup = 0;
+        TokenStyle::Role role = TokenStyle::NoRole;
     };
 
     struct ThemeColors {
@@ -31,10 +43,73 @@ public:
         QColor background;
     };
 
-    struct HighlightCache {
-        int position;
-        int length;
-        QTextCharFormat format;
+    /**
+     * @brief Rules read from one language definition file
+     *
+     * Loading only fills this struct, so the same code compiles the current
+     * language and the languages embedded in it (e.g. markdown code fences).
+     */
+    struct LanguageRules {
+        QString name;
+        QVector<HighlightRule> rules;
+        QRegularExpression blockCommentStart;
+        QRegularExpression blockCommentEnd;
+        TokenStyle blockCommentStyle;
+        QStringList bracketPairs;
+        QString quoteChars;
+
+        // Fenced regions lexed with another language, keyed by info string
+        QRegularExpression fenceStart;
+        QRegularExpression fenceEnd;
+        int fenceInfoGroup = 0;
+        // Captures the marker in both patterns; a fence only ends on the
+        // character that opened it, repeated at least as often
+        int fenceMarkerGroup = 0;
+        TokenStyle fenceStyle;
+        QMap<QString, QString> fenceLanguages;
+    };
+
+    /**
+     * @brief Immutable copy of the compiled rules used for lexing
+     *
+     * Rebuilt by precompilePatterns(). Worker threads only ever read from a
+     * snapshot, so the UI thread is free to load another language while a
+     * parallel pass is still running.
+     */
+    struct LexerSnapshot {
+        struct Rule {
+            QRegularExpression pattern;
+            int captureGroup = 0;
+            TokenStream::ClassId tokenClass = TokenStream::PlainText;
+            RulePrefilter prefilter;
+        };
+
+        QVector<Rule> rules;
+        QRegularExpression blockCommentStart;
+        QRegularExpression blockCommentEnd;
+        TokenStream::ClassId blockCommentClass = TokenStream::PlainText;
+
+        // Embedded languages, nested into the block state while inside a fence
+        QRegularExpression fenceStart;
+        QRegularExpression fenceEnd;
+        int fenceInfoGroup = 0;
+        int fenceMarkerGroup = 0;
+        TokenStream::ClassId fenceClass = TokenStream::PlainText;
+        QVector<QSharedPointer<const LexerSnapshot>> embedded;
+        QHash<QString, int> fenceLanguages;
+
+        // Diagnostics: delimiters are ignored inside these (string/comment) classes
+        enum DelimiterKind : quint8 { NoDelimiter, OpenDelimiter, CloseDelimiter, QuoteDelimiter };
+        QBitArray opaqueClasses;
+        quint8 delimiterKinds[128] = {};
+        char matchingOpen[128] = {};
+
+        // Cost counters and timeout state, one entry per rule
+        QSharedPointer<RuleProfiler::LanguageProfile> profile;
+
+        quint64 generation = 0;
+        // Content hash of the rules, stable across instances and sessions
+        quint64 languageVersion = 0;
     };
 
     explicit SyntaxHighlighter(QTextDocument *parent = nullptr);
@@ -47,6 +122,28 @@ public:
 
     // Performance monitoring
     qint64 lastHighlightTime() const;
+    // Per-rule cost of the current language and the languages embedded in it
+    QVector<RuleProfiler::LanguageMetrics> ruleMetrics() const;
+
+    // Fills rules from a language definition; also used by the rule fuzzer
+    static void loadLanguageRules(const QJsonObject &json, LanguageRules &language);
+
+    // Token output, shared with the minimap, folding and outline
+    const TokenStream *tokensForBlock(const QTextBlock &block) const;
+    const FormatTable &formatTable() const;
+
+    // Writes this document's tokens to the shared cache's disk store
+    void persistTokens(const QString &filePath) const;
+
+    // Parallel highlighting for large documents
+    void loadTextInParallel(const QString &text);
+    bool isParallelPassRunning() const;
+
+    // Streaming loads: the first chunk is highlighted right away, chunks
+    // appended later are lexed in one parallel pass when the load finishes.
+    // Edits to the first chunk meanwhile are highlighted as usual.
+    void beginStreamingLoad(const QString &firstChunk);
+    void finishStreamingLoad();
 
     // Custom rule management
     void addCustomRule(const HighlightRule &rule);
@@ -58,55 +155,187 @@ public:
         NoError,
         UnclosedString,
         UnclosedComment,
-        InvalidSyntax
+        InvalidSyntax,
+        UnmatchedDelimiter
+    };
+
+    struct SyntaxDiagnostic {
+        SyntaxError error = NoError;
+        int line = 0;
+        int column = 0;
+    };
+
+    // Published once per highlight pass; version increases with every publish
+    struct Diagnostics {
+        quint64 version = 0;
+        int documentRevision = -1;
+        QVector<SyntaxDiagnostic> items;
     };
-    SyntaxError checkSyntaxErrors(const QString &text) const;
+    const Diagnostics &diagnostics() const;
 
 signals:
     void highlightingPerformance(qint64 milliseconds);
     void languageLoaded(const QString &language);
     void themeChanged(const QString &theme);
-    void syntaxErrorDetected(SyntaxError error, int position);
+    void diagnosticsUpdated(const SyntaxHighlighter::Diagnostics &diagnostics);
+    // Blocks whose tokens were re-lexed with a different result
+    void tokensChanged(int firstBlock, int lastBlock);
+    void parallelHighlightFinished(qint64 milliseconds);
 
 public slots:
     void precompilePatterns();
-    void highlightInParallel(const QString &text);
+    void rehighlightInParallel();
+    void setVisibleBlocks(int firstBlock, int lastBlock);
 
 protected:
     void highlightBlock(const QString &text) override;
 
 private:
+    // Result of lexing a contiguous range of lines on a worker thread
+    struct ChunkResult {
+        int firstLine = 0;
+        int entryState = -1;
+        quint64 generation = 0;
+        QVector<TokenStream> tokens;
+        QVector<int> exitStates;
+        QVector<QVector<quint32>> delimiters;
+        QVector<bool> degraded;
+    };
+
+    // A delimiter with its line relative to the segment that holds it
+    struct SegmentDelimiter {
+        int line;
+        int column;
+        char ch;
+    };
+
+    // Delimiter summary of a run of consecutive lines. Everything that can be
+    // decided inside the run is in errors; closes found nothing open in the
+    // run and opens are still open at its end, both left to the combine step.
+    struct DelimiterSegment {
+        int firstLine = 0;
+        int lineCount = 0;
+        bool dirty = true;
+        QVector<SyntaxDiagnostic> errors;
+        QVector<SegmentDelimiter> closes;
+        QVector<SegmentDelimiter> opens;
+        int commentRunStart = -1; // Where a block comment open at the end starts
+    };
+
+    typedef QVector<QPair<HighlightCache::Key, HighlightCache::Entry>> CacheBatch;
+
+    // Lexing (thread-safe, operates on a snapshot only). Lines lexed with a
+    // rule skipped (time limit hit or disabled) are degraded and not cached.
+    // With a batch, new entries are collected there instead of inserted.
+    static int tokenizeLine(const LexerSnapshot &lexer, const QString &text,
+                            int previousState, TokenStream &tokens,
+                            QVector<quint32> &delimiters, bool &degraded,
+                            CacheBatch *batch = nullptr);
+    static int lexLine(const LexerSnapshot &lexer, const QString &text,
+                       int previousState, TokenStream::Builder &builder, bool &degraded);
+    static ChunkResult lexChunk(const LexerSnapshot &lexer, const QStringList &lines,
+                                int firstLine, int lineCount, bool fillCache);
+    static void scanDelimiters(const LexerSnapshot &lexer, const QString &text,
+                               const TokenStream::Builder &builder, QVector<quint32> &delimiters);
+    void mergeParallelResults();
+    void scheduleDiagnostics();
+    void publishDiagnostics();
+    void markDiagnosticsDirty(int line);
+    void resetDelimiterSegments(int blockCount);
+    int delimiterSegmentAt(int line) const;
+    void scanDelimiterSegment(QTextBlock &block, DelimiterSegment &segment) const;
+    void applyTokens(const TokenStream &tokens);
+    void refreshFormats(int firstBlock, int lastBlock);
+    void repaintStaleBlocks();
+    void sweepStaleFormats();
+
     // Language loading methods
+    static bool readLanguageFile(const QString &language, QJsonObject &json);
     void loadDefaultRules();
-    void loadKeywords(const QJsonObject &json);
-    void loadStrings(const QJsonObject &json);
-    void loadComments(const QJsonObject &json);
-    void loadHighlightingRules(const QJsonObject &json);
-    void loadSpecialRules(const QJsonObject &json);
+    static void loadKeywords(const QJsonObject &json, LanguageRules &language);
+    static void loadStrings(const QJsonObject &json, LanguageRules &language);
+    static void loadComments(const QJsonObject &json, LanguageRules &language);
+    static void loadBrackets(const QJsonObject &json, LanguageRules &language);
+    static void loadHighlightingRules(const QJsonObject &json, LanguageRules &language);
+    static void loadSpecialRules(const QJsonObject &json, LanguageRules &language);
+    static void loadEmbeddedLanguages(const QJsonObject &json, LanguageRules &language);
     void loadTheme(const QJsonObject &json);
 
     // Helper methods
-    QTextCharFormat createFormatFromStyle(const QJsonObject &style);
-    void handleMultiLine(const QString &text);
+    static TokenStyle createStyleFromJson(const QJsonObject &style);
     void updateThemeColors();
-    void cacheHighlighting(const QString &text);
+    QSharedPointer<LexerSnapshot> buildSnapshot(const LanguageRules &language,
+                                                const QVector<HighlightRule> &customRules);
+    static quint64 computeLanguageVersion(const LanguageRules &language,
+                                          const QVector<HighlightRule> &customRules);
 
     // Member variables
-    QVector<HighlightRule> m_rules;
+    LanguageRules m_language;
+    QVector<LanguageRules> m_embeddedLanguages;
     QVector<HighlightRule> m_customRules;
-    QVector<HighlightCache> m_cache;
+    FormatTable m_formats;
     QString m_currentLanguage;
     QString m_currentTheme;
     ThemeColors m_themeColors;
     qint64 m_lastHighlightTime;
 
-    // Multi-line comment handling
-    QRegularExpression m_blockCommentStart;
-    QRegularExpression m_blockCommentEnd;
-    QTextCharFormat m_blockCommentFormat;
+    // Diagnostics: segments are rescanned only where highlightBlock() ran
+    // since the last publish, then combined
+    Diagnostics m_diagnostics;
+    QVector<DelimiterSegment> m_delimiterSegments;
+    int m_segmentedBlockCount = 0;
+    quint64 m_segmentedGeneration = 0;
+
+    // Theme switching: blocks painted with an older epoch are re-applied,
+    // visible ones first, the rest in small batches
+    quint32 m_formatEpoch = 0;
+    int m_visibleFirst = 0;
+    int m_visibleLast = -1;
+    int m_sweepBlock = -1;
 
     // Performance tracking
     QElapsedTimer m_highlightTimer;
+    qint64 m_pendingHighlightNs = 0;
+
+    // Parallel pass state
+    QSharedPointer<const LexerSnapshot> m_lexer;
+    QFutureWatcher<ChunkResult> *m_parallelWatcher;
+    QElapsedTimer m_parallelTimer;
+    QStringList m_parallelLines;
+    int m_parallelRevision = -1;
+    bool m_parallelPending = false;
+
+    // Streaming load state: blocks after the boundary block are left to the
+    // final pass. The cursor stays put on appends and moves with edits above.
+    QTextCursor m_streamBoundary;
+    bool m_streaming = false;
+};
+
+/**
+ * @brief Per-block lexer output attached to each QTextBlock
+ *
+ * Lets highlightBlock() reuse tokens computed elsewhere (e.g. by a parallel
+ * pass) as long as the text, the entry state and the rule set still match.
+ */
+class HighlightBlockData : public QTextBlockUserData
+{
+public:
+    TokenStream tokens;
+    uint textHash = 0;
+    int entryState = -1;
+    int exitState = -1;
+    quint64 generation = 0;
+    quint32 formatEpoch = 0;
+    // Delimiters left unbalanced by this line, see SyntaxHighlighter::scanDelimiters()
+    QVector<quint32> delimiters;
+    // Lexed with a rule skipped; never persisted
+    bool degraded = false;
+
+    bool isValidFor(const QString &text, int previousState, quint64 lexerGeneration) const {
+        return generation == lexerGeneration
+            && entryState == previousState
+            && textHash == qHash(text);
+    }
 };
 
 #endif // HIGHLIGHTER_H
@@ -0,0 +1,306 @@
+#include "language_detector.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+
+namespace {
+// Characters looked at for shebangs, modelines and token scoring
+const int kSampleChars = 4096;
+// Modelines are only honoured near the start or end of a file
+const int kModelineLines = 5;
+// Without a matching extension, the best language must clearly win
+const double kMinTokenScore = 3.0;
+const double kMinScoreRatio = 1.5;
+const int kMaxLanguages = 32;
+const int kMaxCachedPaths = 4096;
+
+bool isTokenStart(ushort ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+bool isTokenChar(ushort ch) {
+    return isTokenStart(ch) || (ch >= '0' && ch <= '9');
+}
+
+// "python3.11" -> "python"
+QString stripVersion(QString program) {
+    while (!program.isEmpty() && (program.back().isDigit() || program.back() == QLatin1Char('.'))) {
+        program.chop(1);
+    }
+    return program;
+}
+
+QStringList stringList(const QJsonValue &value) {
+    return value.toVariant().toStringList();
+}
+} // namespace
+
+// Singleton instance initialization
+LanguageDetector* LanguageDetector::m_instance = nullptr;
+QMutex LanguageDetector::m_instanceMutex;
+
+LanguageDetector* LanguageDetector::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+    if (!m_instance) {
+        m_instance = new LanguageDetector();
+    }
+    return m_instance;
+}
+
+LanguageDetector::LanguageDetector()
+{
+    loadDefinitions();
+}
+
+void LanguageDetector::loadDefinitions()
+{
+    const QDir directory(":/syntax/language_defs");
+    for (const QString &fileName : directory.entryList({"*.json"}, QDir::Files, QDir::Name)) {
+        if (m_languages.size() == kMaxLanguages) {
+            qWarning() << "Too many language definitions for detection, ignoring" << fileName;
+            break;
+        }
+
+        QFile file(directory.filePath(fileName));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Failed to open language file:" << file.fileName();
+            continue;
+        }
+        const QJsonObject json = QJsonDocument::fromJson(file.readAll()).object();
+        const QJsonObject detection = json["detection"].toObject();
+        const int index = m_languages.size();
+
+        Language language;
+        language.name = QFileInfo(fileName).completeBaseName();
+        for (const QString &extension : stringList(json["file_extensions"])) {
+            const QString suffix = extension.mid(extension.startsWith('.') ? 1 : 0).toLower();
+            language.extensions.append(suffix);
+            m_extensions[suffix].append(index);
+        }
+        for (const QString &interpreter : stringList(detection["interpreters"])) {
+            language.interpreters.append(stripVersion(interpreter));
+        }
+        language.aliases = stringList(detection["aliases"]);
+        language.aliases.append(language.name);
+        language.aliases.append(json["name"].toString().toLower());
+
+        // Keywords and hint tokens vote for every language that has them
+        QStringList tokens = stringList(detection["tokens"]);
+        const QJsonObject keywords = json["keywords"].toObject();
+        for (auto it = keywords.constBegin(); it != keywords.constEnd(); ++it) {
+            if (it.key() != "operators") {
+                tokens += stringList(it.value());
+            }
+        }
+        for (const QString &token : qAsConst(tokens)) {
+            m_tokenLanguages[token] |= quint32(1) << index;
+        }
+
+        m_languages.append(language);
+    }
+}
+
+QString LanguageDetector::detect(const QString &filePath, QStringView content)
+{
+    const QFileInfo info(filePath);
+    const qint64 size = info.size();
+    const QDateTime modified = info.lastModified();
+
+    QMutexLocker locker(&m_mutex);
+    auto cached = m_cache.constFind(filePath);
+    if (cached != m_cache.constEnd() && cached->size == size && cached->modified == modified) {
+        return cached->language;
+    }
+
+    // Modelines may also sit at the very end of the file
+    const QStringView head = content.left(kSampleChars);
+    int language = fromModeline(head);
+    if (language < 0 && content.size() > kSampleChars) {
+        language = fromModeline(content.right(kSampleChars));
+    }
+    if (language < 0) {
+        language = fromShebang(head);
+    }
+    if (language < 0) {
+        const QVector<int> candidates = m_extensions.value(info.suffix().toLower());
+        language = candidates.size() == 1 ? candidates.first() : fromTokens(head, candidates);
+    }
+
+    const QString name = language >= 0 ? m_languages.at(language).name : QString();
+    if (m_cache.size() >= kMaxCachedPaths) {
+        m_cache.clear();
+    }
+    m_cache.insert(filePath, {size, modified, name});
+    return name;
+}
+
+void LanguageDetector::forget(const QString &filePath)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.remove(filePath);
+}
+
+QStringList LanguageDetector::languages() const
+{
+    QMutexLocker locker(&m_mutex);
+    QStringList names;
+    for (const Language &language : m_languages) {
+        names.append(language.name);
+    }
+    return names;
+}
+
+int LanguageDetector::fromModeline(QStringView content) const
+{
+    // vim: set ft=python:   /   -*- mode: c++ -*-   /   -*- python -*-
+    static const QRegularExpression vim(QStringLiteral("\\b(?:vi|vim|ex)(?:[<=>]?\\d+)?:.*?\\b(?:ft|filetype|syntax)=([\\w+#.-]+)"));
+    static const QRegularExpression emacs(QStringLiteral("-\\*-(?:.*?\\bmode:\\s*([\\w+#.-]+)|\\s*([\\w+#.-]+)\\s*-\\*-)"));
+
+    QVector<QStringView> lines;
+    int start = 0;
+    while (start < content.size() && lines.size() < kModelineLines) {
+        int end = int(content.indexOf(QLatin1Char('\n'), start));
+        if (end < 0) end = int(content.size());
+        lines.append(content.mid(start, end - start));
+        start = end + 1;
+    }
+    int end = int(content.size());
+    for (int i = 0; i < kModelineLines && end > 0; ++i) {
+        const int newline = int(content.lastIndexOf(QLatin1Char('\n'), end - 1));
+        lines.append(content.mid(newline + 1, end - newline - 1));
+        end = newline;
+    }
+
+    for (const QStringView &line : qAsConst(lines)) {
+        const bool hasVim = line.contains(QLatin1String("vi")) || line.contains(QLatin1String("ex:"));
+        if (!hasVim && !line.contains(QLatin1String("-*-"))) {
+            continue;
+        }
+        const QString text = line.toString();
+        QRegularExpressionMatch match = vim.match(text);
+        if (!match.hasMatch()) {
+            match = emacs.match(text);
+        }
+        if (match.hasMatch()) {
+            const QString name = match.captured(1).isEmpty() ? match.captured(2) : match.captured(1);
+            const int language = languageForName(name.toLower());
+            if (language >= 0) {
+                return language;
+            }
+        }
+    }
+    return -1;
+}
+
+int LanguageDetector::fromShebang(QStringView content) const
+{
+    if (!content.startsWith(QLatin1String("#!"))) {
+        return -1;
+    }
+
+    const int newline = int(content.indexOf(QLatin1Char('\n')));
+    const QStringList words = content.mid(2, newline < 0 ? -1 : newline - 2).toString()
+                                  .split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+    if (words.isEmpty()) {
+        return -1;
+    }
+
+    // "#!/usr/bin/env -S VAR=1 python3" runs the first plain word after env
+    QString program = QFileInfo(words.first()).fileName();
+    if (program == "env") {
+        program.clear();
+        for (int i = 1; i < words.size(); ++i) {
+            if (!words.at(i).startsWith('-') && !words.at(i).contains('=')) {
+                program = QFileInfo(words.at(i)).fileName();
+                break;
+            }
+        }
+    }
+    program = stripVersion(program);
+
+    for (int i = 0; i < m_languages.size(); ++i) {
+        if (m_languages.at(i).interpreters.contains(program)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int LanguageDetector::fromTokens(QStringView content, const QVector<int> &candidates) const
+{
+    double scores[kMaxLanguages] = {};
+    const QChar *data = content.data();
+    const int length = int(content.size());
+
+    int i = 0;
+    while (i < length) {
+        const ushort ch = data[i].unicode();
+        const int start = i;
+        // Preprocessor directives and annotations keep their prefix
+        if ((ch == '#' || ch == '@') && i + 1 < length && isTokenStart(data[i + 1].unicode())) {
+            ++i;
+        } else if (!isTokenStart(ch)) {
+            ++i;
+            continue;
+        }
+        ++i;
+        while (i < length && isTokenChar(data[i].unicode())) {
+            ++i;
+        }
+
+        // fromRawData avoids copying each token just for the lookup
+        const auto it = m_tokenLanguages.constFind(QString::fromRawData(data + start, i - start));
+        if (it == m_tokenLanguages.constEnd()) {
+            continue;
+        }
+        const quint32 mask = *it;
+        const double weight = 1.0 / qPopulationCount(mask);
+        for (int language = 0; language < m_languages.size(); ++language) {
+            if (mask & (quint32(1) << language)) {
+                scores[language] += weight;
+            }
+        }
+    }
+
+    // An extension shared by several definitions only needs the best of them
+    if (!candidates.isEmpty()) {
+        int best = candidates.first();
+        for (int language : candidates) {
+            if (scores[language] > scores[best]) {
+                best = language;
+            }
+        }
+        return best;
+    }
+
+    int best = -1;
+    double second = 0;
+    for (int language = 0; language < m_languages.size(); ++language) {
+        if (best < 0 || scores[language] > scores[best]) {
+            second = best < 0 ? 0 : scores[best];
+            best = language;
+        } else if (scores[language] > second) {
+            second = scores[language];
+        }
+    }
+    if (best < 0 || scores[best] < kMinTokenScore || scores[best] < second * kMinScoreRatio) {
+        return -1; // Plain text, e.g. logs
+    }
+    return best;
+}
+
+int LanguageDetector::languageForName(const QString &name) const
+{
+    for (int i = 0; i < m_languages.size(); ++i) {
+        if (m_languages.at(i).aliases.contains(name)) {
+            return i;
+        }
+    }
+    return -1;
+}
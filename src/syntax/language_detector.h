@@ -0,0 +1,70 @@
+#ifndef LANGUAGE_DETECTOR_H
+#define LANGUAGE_DETECTOR_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QVector>
+
+/**
+ * @brief Picks the language definition for a file from its name and content
+ *
+ * Checked in order of confidence: an editor modeline (vim/emacs), a shebang,
+ * the file_extensions of the language definitions, and finally a token
+ * frequency model over the first few KB, built from each definition's
+ * keywords and "detection" tokens. The model also breaks ties between
+ * definitions that claim the same extension.
+ *
+ * Results are cached per path until the file's size or modification time
+ * changes. All methods are thread-safe.
+ */
+class LanguageDetector
+{
+public:
+    // Singleton instance access
+    static LanguageDetector* instance();
+
+    LanguageDetector(const LanguageDetector&) = delete;
+    LanguageDetector& operator=(const LanguageDetector&) = delete;
+
+    // Language definition name (e.g. "python"), or empty for plain text
+    QString detect(const QString &filePath, QStringView content);
+    void forget(const QString &filePath);
+    QStringList languages() const;
+
+private:
+    struct Language {
+        QString name;
+        QStringList extensions;   // Lower case, without the dot
+        QStringList interpreters; // Shebang program names, version suffix stripped
+        QStringList aliases;      // Modeline and info string names
+    };
+
+    struct CachedResult {
+        qint64 size = -1;
+        QDateTime modified;
+        QString language;
+    };
+
+    LanguageDetector();
+
+    void loadDefinitions();
+    int fromModeline(QStringView content) const;
+    int fromShebang(QStringView content) const;
+    int fromTokens(QStringView content, const QVector<int> &candidates) const;
+    int languageForName(const QString &name) const;
+
+    mutable QMutex m_mutex;
+    QVector<Language> m_languages;
+    QHash<QString, QVector<int>> m_extensions; // Extension -> languages claiming it
+    QHash<QString, quint32> m_tokenLanguages;  // Token -> bit per language
+    QHash<QString, CachedResult> m_cache;
+
+    static LanguageDetector* m_instance;
+    static QMutex m_instanceMutex;
+};
+
+#endif // LANGUAGE_DETECTOR_H
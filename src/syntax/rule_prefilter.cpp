@@ -0,0 +1,465 @@
+#include "rule_prefilter.h"
+#include <QtAlgorithms>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+struct Analysis {
+    RulePrefilter::CharSet firstChars;
+    bool known = false;    // firstChars covers every possible first character
+    QString literal;       // Every match starts with this
+    bool anchored = false; // Every match starts at column 0
+};
+
+/**
+ * Recursive descent over the subset of PCRE syntax used by language files.
+ * Only the start of each alternative is analysed; the rest is skipped.
+ */
+class PatternAnalyzer
+{
+public:
+    PatternAnalyzer(const QString &pattern, QRegularExpression::PatternOptions options)
+        : m_pattern(pattern),
+          m_unicode(options & QRegularExpression::UseUnicodePropertiesOption),
+          m_multiline(options & QRegularExpression::MultilineOption) {}
+
+    bool analyze(Analysis &result) {
+        result = alternation(true);
+        // A stray ')' means we lost track of the structure
+        return m_pos == m_pattern.size();
+    }
+
+private:
+    bool atEnd() const { return m_pos >= m_pattern.size(); }
+    ushort peek(int offset = 0) const {
+        const int pos = m_pos + offset;
+        return pos < m_pattern.size() ? m_pattern.at(pos).unicode() : 0;
+    }
+
+    Analysis alternation(bool topLevel) {
+        Analysis result = branch(topLevel);
+        while (!atEnd() && peek() == '|') {
+            ++m_pos;
+            const Analysis other = branch(topLevel);
+            result.known = result.known && other.known;
+            result.firstChars.bits[0] |= other.firstChars.bits[0];
+            result.firstChars.bits[1] |= other.firstChars.bits[1];
+            result.firstChars.nonAscii |= other.firstChars.nonAscii;
+            result.literal.clear();
+            result.anchored = result.anchored && other.anchored;
+        }
+        return result;
+    }
+
+    Analysis branch(bool topLevel) {
+        Analysis result;
+
+        // Assertions that do not consume characters
+        while (!atEnd()) {
+            if (peek() == '\\' && (peek(1) == 'b' || peek(1) == 'B')) {
+                m_pos += 2;
+            } else if (peek() == '^' && topLevel && !m_multiline) {
+                result.anchored = true;
+                ++m_pos;
+            } else {
+                break;
+            }
+        }
+
+        const int atomStart = m_pos;
+        Analysis first;
+        int firstLiteral = -1;
+        if (!atom(first, firstLiteral)) {
+            m_pos = atomStart;
+        } else {
+            const int min = quantifier();
+            if (min != 0) {
+                result.firstChars = first.firstChars;
+                result.known = true;
+                result.literal = first.literal;
+
+                // Extend a literal first character with the literal run after it
+                while (min < 0 && firstLiteral >= 0 && !atEnd()) {
+                    const int ch = literalChar();
+                    if (ch < 0) {
+                        break;
+                    }
+                    const int repeat = quantifier();
+                    if (repeat == 0) {
+                        break;
+                    }
+                    result.literal.append(QChar(ch));
+                    if (repeat > 0) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        skipBranch();
+        return result;
+    }
+
+    // Parses one atom at the current position; false if it is not understood
+    bool atom(Analysis &result, int &literal) {
+        const ushort c = peek();
+        if (c == '(') {
+            if (peek(1) == '?') {
+                if (peek(2) != ':') {
+                    return false; // Lookaround, named groups, inline options
+                }
+                m_pos += 3;
+            } else {
+                ++m_pos;
+            }
+            result = alternation(false);
+            if (atEnd() || peek() != ')') {
+                return false;
+            }
+            ++m_pos;
+            return result.known;
+        }
+
+        if (c == '[') {
+            if (!charClass(result.firstChars)) {
+                return false;
+            }
+            result.known = true;
+            return true;
+        }
+
+        if (c == '\\' && escapeSet(peek(1), result.firstChars)) {
+            m_pos += 2;
+            result.known = true;
+            return true;
+        }
+
+        literal = literalChar();
+        if (literal < 0) {
+            return false;
+        }
+        result.firstChars.insert(ushort(literal));
+        result.literal = QChar(literal);
+        result.known = true;
+        return true;
+    }
+
+    // Consumes a single literal character, or returns -1 and consumes nothing
+    int literalChar() {
+        const ushort c = peek();
+        if (c == '\\') {
+            const ushort escaped = peek(1);
+            int ch = -1;
+            if (escaped == 't') ch = '\t';
+            else if (escaped == 'n') ch = '\n';
+            else if (escaped == 'r') ch = '\r';
+            else if (escaped && !QChar(escaped).isLetterOrNumber()) ch = escaped;
+            if (ch >= 0) {
+                m_pos += 2;
+            }
+            return ch;
+        }
+        if (atEnd() || (c < 128 && std::strchr("[()|.^$*+?{", c))) {
+            return -1;
+        }
+        ++m_pos;
+        return c;
+    }
+
+    // Consumes a quantifier and returns its minimum, or -1 if there is none
+    int quantifier() {
+        int min = -1;
+        const ushort c = peek();
+        if (c == '?' || c == '*') {
+            min = 0;
+            ++m_pos;
+        } else if (c == '+') {
+            min = 1;
+            ++m_pos;
+        } else if (c == '{') {
+            int pos = m_pos + 1;
+            int digits = 0;
+            int value = 0;
+            while (pos < m_pattern.size() && m_pattern.at(pos).isDigit()) {
+                value = qMin(value * 10 + m_pattern.at(pos).digitValue(), 1000);
+                ++pos;
+                ++digits;
+            }
+            if (pos < m_pattern.size() && m_pattern.at(pos) == QLatin1Char(',')) {
+                ++pos;
+                while (pos < m_pattern.size() && m_pattern.at(pos).isDigit()) {
+                    ++pos;
+                    ++digits;
+                }
+            }
+            if (digits == 0 || pos >= m_pattern.size() || m_pattern.at(pos) != QLatin1Char('}')) {
+                return -1; // Not a quantifier, PCRE reads '{' literally
+            }
+            m_pos = pos + 1;
+            min = value;
+        } else {
+            return -1;
+        }
+
+        // Lazy and possessive forms have the same minimum
+        if (peek() == '?' || peek() == '+') {
+            ++m_pos;
+        }
+        return min;
+    }
+
+    bool charClass(RulePrefilter::CharSet &set) {
+        ++m_pos;
+        if (peek() == '^') {
+            return false; // Negated classes match almost anything
+        }
+        if (peek() == ']') {
+            set.insert(']');
+            ++m_pos;
+        }
+
+        while (!atEnd() && peek() != ']') {
+            int low = -1;
+            if (!classMember(set, low)) {
+                return false;
+            }
+            if (low >= 0 && peek() == '-' && peek(1) && peek(1) != ']') {
+                ++m_pos;
+                RulePrefilter::CharSet unused;
+                int high = -1;
+                if (!classMember(unused, high) || high < low) {
+                    return false;
+                }
+                for (int ch = low; ch <= high && ch < 128; ++ch) {
+                    set.insert(ushort(ch));
+                }
+                if (high >= 128) {
+                    set.nonAscii = true;
+                }
+            } else if (low >= 0) {
+                set.insert(ushort(low));
+            }
+        }
+
+        if (atEnd()) {
+            return false;
+        }
+        ++m_pos;
+        return true;
+    }
+
+    // One class member: either a set escape (added to set) or a single character
+    bool classMember(RulePrefilter::CharSet &set, int &single) {
+        single = -1;
+        const ushort c = peek();
+        if (c == '[') {
+            return false; // POSIX classes
+        }
+        if (c != '\\') {
+            single = c;
+            ++m_pos;
+            return true;
+        }
+
+        const ushort escaped = peek(1);
+        if (escapeSet(escaped, set)) {
+            m_pos += 2;
+            return true;
+        }
+        single = literalChar();
+        return single >= 0;
+    }
+
+    bool escapeSet(ushort escaped, RulePrefilter::CharSet &set) const {
+        if (escaped == 'd' || escaped == 'w') {
+            for (ushort ch = '0'; ch <= '9'; ++ch) set.insert(ch);
+            if (escaped == 'w') {
+                for (ushort ch = 'a'; ch <= 'z'; ++ch) set.insert(ch);
+                for (ushort ch = 'A'; ch <= 'Z'; ++ch) set.insert(ch);
+                set.insert('_');
+            }
+            set.nonAscii |= m_unicode;
+            return true;
+        }
+        if (escaped == 's') {
+            for (const char ch : {' ', '\t', '\n', '\v', '\f', '\r'}) set.insert(ushort(ch));
+            set.nonAscii = true; // NBSP and friends, depending on options
+            return true;
+        }
+        return false;
+    }
+
+    // Advances to the '|' or ')' ending the current alternative
+    void skipBranch() {
+        int depth = 0;
+        while (!atEnd()) {
+            const ushort c = peek();
+            if (c == '\\') {
+                m_pos += 2;
+                continue;
+            }
+            if (c == '[') {
+                skipClass();
+                continue;
+            }
+            if (c == '(') {
+                ++depth;
+            } else if (c == ')') {
+                if (depth == 0) return;
+                --depth;
+            } else if (c == '|' && depth == 0) {
+                return;
+            }
+            ++m_pos;
+        }
+        m_pos = qMin(m_pos, int(m_pattern.size()));
+    }
+
+    void skipClass() {
+        ++m_pos;
+        if (peek() == '^') ++m_pos;
+        if (peek() == ']') ++m_pos;
+        while (!atEnd()) {
+            const ushort c = peek();
+            if (c == '\\') {
+                m_pos += 2;
+            } else if (c == '[' && peek(1) == ':') {
+                const int end = m_pattern.indexOf(QLatin1String(":]"), m_pos + 2);
+                m_pos = end < 0 ? m_pattern.size() : end + 2;
+            } else if (c == ']') {
+                ++m_pos;
+                return;
+            } else {
+                ++m_pos;
+            }
+        }
+        m_pos = qMin(m_pos, int(m_pattern.size()));
+    }
+
+    const QString m_pattern;
+    const bool m_unicode;
+    const bool m_multiline;
+    int m_pos = 0;
+};
+} // namespace
+
+int RulePrefilter::CharSet::count() const {
+    return int(qPopulationCount(bits[0]) + qPopulationCount(bits[1]));
+}
+
+RulePrefilter::LineProfile RulePrefilter::profile(QStringView text) {
+    LineProfile profile;
+    const QChar *data = text.data();
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        profile.insert(data[i].unicode());
+    }
+    return profile;
+}
+
+RulePrefilter RulePrefilter::fromPattern(const QRegularExpression &pattern) {
+    RulePrefilter filter;
+    const QRegularExpression::PatternOptions options = pattern.patternOptions();
+    if (!pattern.isValid() || (options & QRegularExpression::ExtendedPatternSyntaxOption)
+        || pattern.pattern().contains(QLatin1String("\\Q"))) {
+        return filter;
+    }
+
+    Analysis analysis;
+    if (!PatternAnalyzer(pattern.pattern(), options).analyze(analysis)) {
+        return filter;
+    }
+
+    filter.m_anchored = analysis.anchored;
+    if (analysis.known) {
+        CharSet &first = filter.m_firstChars;
+        first = analysis.firstChars;
+        if (options & QRegularExpression::CaseInsensitiveOption) {
+            for (ushort ch = 'a'; ch <= 'z'; ++ch) {
+                const ushort upper = ushort(ch - 'a' + 'A');
+                if (first.contains(ch) || first.contains(upper)) {
+                    first.insert(ch);
+                    first.insert(upper);
+                }
+            }
+            // KELVIN SIGN and LONG S fold to k and s
+            first.nonAscii |= first.contains('k') || first.contains('s');
+        }
+        filter.m_hasFirstChars = true;
+
+        if (!first.nonAscii && first.count() <= kMaxScanChars) {
+            for (ushort ch = 0; ch < 128; ++ch) {
+                if (first.contains(ch)) {
+                    filter.m_scanChars[filter.m_scanCount++] = ch;
+                }
+            }
+        }
+    }
+
+    // Case-insensitive literals would need Unicode folding; the first set is enough
+    if (!(options & QRegularExpression::CaseInsensitiveOption)) {
+        filter.m_literal = analysis.literal;
+        for (const QChar &ch : qAsConst(filter.m_literal)) {
+            filter.m_literalChars.insert(ch.unicode());
+        }
+    }
+    return filter;
+}
+
+int RulePrefilter::firstCandidate(QStringView text, const LineProfile &profile) const {
+    if (m_hasFirstChars && !m_firstChars.intersects(profile)) {
+        return -1;
+    }
+    if (!m_literalChars.isSubsetOf(profile)) {
+        return -1;
+    }
+
+    if (m_anchored) {
+        if (m_hasFirstChars && (text.isEmpty() || !m_firstChars.contains(text.at(0).unicode()))) {
+            return -1;
+        }
+        return text.startsWith(m_literal) ? 0 : -1;
+    }
+    if (!m_literal.isEmpty()) {
+        return int(text.indexOf(m_literal));
+    }
+    if (m_scanCount > 0) {
+        return findFirstOf(text);
+    }
+    return 0;
+}
+
+int RulePrefilter::findFirstOf(QStringView text) const {
+    const ushort *data = reinterpret_cast<const ushort *>(text.data());
+    const int length = int(text.size());
+    int i = 0;
+
+#ifdef __SSE2__
+    // Compare 8 UTF-16 units against every scan character at once
+    __m128i needles[kMaxScanChars];
+    for (int k = 0; k < m_scanCount; ++k) {
+        needles[k] = _mm_set1_epi16(short(m_scanChars[k]));
+    }
+    for (; i + 8 <= length; i += 8) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i hits = _mm_cmpeq_epi16(chunk, needles[0]);
+        for (int k = 1; k < m_scanCount; ++k) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chunk, needles[k]));
+        }
+        const uint mask = uint(_mm_movemask_epi8(hits));
+        if (mask) {
+            return i + int(qCountTrailingZeroBits(mask)) / 2;
+        }
+    }
+#endif
+
+    for (; i < length; ++i) {
+        for (int k = 0; k < m_scanCount; ++k) {
+            if (data[i] == m_scanChars[k]) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
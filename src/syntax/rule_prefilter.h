@@ -0,0 +1,77 @@
+#ifndef RULE_PREFILTER_H
+#define RULE_PREFILTER_H
+
+#include <QRegularExpression>
+#include <QString>
+#include <QStringView>
+
+/**
+ * @brief Cheap test that rules out lines a highlighting rule cannot match
+ *
+ * When a language is compiled, each rule's pattern is analysed for the set of
+ * characters a match can start with and for a literal every match starts with
+ * (e.g. "[[" or "R\"" or a keyword). While lexing, one pass over the line
+ * records which characters it contains; rules whose first characters or
+ * literal cannot occur are skipped without running the regex, and the others
+ * start matching at the first candidate position instead of column 0.
+ *
+ * The analysis is conservative: anything it does not understand (lookaround,
+ * optional leading atoms, inline options...) disables the filter for that
+ * rule, which then always runs as before.
+ */
+class RulePrefilter
+{
+public:
+    // ASCII characters as a bitmap, everything else as a single flag
+    struct CharSet {
+        quint64 bits[2] = {0, 0};
+        bool nonAscii = false;
+
+        void insert(ushort ch) {
+            if (ch < 128) {
+                bits[ch >> 6] |= quint64(1) << (ch & 63);
+            } else {
+                nonAscii = true;
+            }
+        }
+        bool contains(ushort ch) const {
+            return ch < 128 ? (bits[ch >> 6] >> (ch & 63)) & 1 : nonAscii;
+        }
+        bool intersects(const CharSet &other) const {
+            return (bits[0] & other.bits[0]) || (bits[1] & other.bits[1])
+                || (nonAscii && other.nonAscii);
+        }
+        bool isSubsetOf(const CharSet &other) const {
+            return (bits[0] & ~other.bits[0]) == 0 && (bits[1] & ~other.bits[1]) == 0
+                && (!nonAscii || other.nonAscii);
+        }
+        int count() const;
+    };
+
+    // Characters present in one line, computed once and shared by all rules
+    using LineProfile = CharSet;
+    static LineProfile profile(QStringView text);
+
+    // A default-constructed prefilter accepts every line at column 0
+    RulePrefilter() = default;
+    static RulePrefilter fromPattern(const QRegularExpression &pattern);
+
+    // Column to start matching at, or -1 if the rule cannot match this line
+    int firstCandidate(QStringView text, const LineProfile &profile) const;
+
+private:
+    int findFirstOf(QStringView text) const;
+
+    CharSet m_firstChars;
+    bool m_hasFirstChars = false;
+    QString m_literal;      // Every match starts with this
+    CharSet m_literalChars;
+    bool m_anchored = false; // Can only match at column 0
+
+    // Small first-character sets are located with a vector compare
+    static constexpr int kMaxScanChars = 4;
+    ushort m_scanChars[kMaxScanChars] = {};
+    int m_scanCount = 0;
+};
+
+#endif // RULE_PREFILTER_H
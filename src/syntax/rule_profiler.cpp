@@ -0,0 +1,175 @@
+#include "rule_profiler.h"
+#include <QDebug>
+#include <QElapsedTimer>
+
+namespace {
+// PCRE backtracking steps per match attempt; ordinary rules stay far below
+const int kMatchLimit = 200000;
+// Time one rule may spend on one line before the rest of the line is skipped
+const qint64 kLineBudgetNs = 5 * 1000 * 1000;
+// Timed-out lines after which a rule is disabled for the session
+const quint64 kMaxTimeouts = 3;
+} // namespace
+
+// RuleProfiler::LanguageProfile ==============================================
+
+RuleProfiler::LanguageProfile::LanguageProfile(const QString &language, quint64 languageVersion,
+                                               const QStringList &patterns)
+    : m_language(language),
+      m_languageVersion(languageVersion),
+      m_patterns(patterns),
+      m_counters(new Counters[size_t(patterns.size())])
+{
+}
+
+bool RuleProfiler::LanguageProfile::isDisabled(int rule) const
+{
+    return m_counters[rule].disabled.loadRelaxed() != 0;
+}
+
+void RuleProfiler::LanguageProfile::record(int rule, qint64 nanoseconds, int matches, bool timedOut)
+{
+    Counters &counters = m_counters[rule];
+    counters.lines.fetchAndAddRelaxed(1);
+    counters.matches.fetchAndAddRelaxed(quint64(matches));
+    counters.totalNs.fetchAndAddRelaxed(nanoseconds);
+
+    qint64 previousMax = counters.maxNs.loadRelaxed();
+    while (nanoseconds > previousMax && !counters.maxNs.testAndSetRelaxed(previousMax, nanoseconds)) {
+        previousMax = counters.maxNs.loadRelaxed();
+    }
+
+    if (timedOut && counters.timeouts.fetchAndAddRelaxed(1) + 1 >= kMaxTimeouts
+        && counters.disabled.testAndSetRelaxed(0, 1)) {
+        qWarning() << "Disabling highlighting rule after repeated timeouts:" << m_language
+                   << m_patterns.at(rule);
+    }
+}
+
+void RuleProfiler::LanguageProfile::reset()
+{
+    for (int i = 0; i < m_patterns.size(); ++i) {
+        Counters &counters = m_counters[i];
+        counters.lines.storeRelaxed(0);
+        counters.matches.storeRelaxed(0);
+        counters.totalNs.storeRelaxed(0);
+        counters.maxNs.storeRelaxed(0);
+        counters.timeouts.storeRelaxed(0);
+        counters.disabled.storeRelaxed(0);
+    }
+}
+
+RuleProfiler::LanguageMetrics RuleProfiler::LanguageProfile::metrics() const
+{
+    LanguageMetrics metrics;
+    metrics.language = m_language;
+    metrics.languageVersion = m_languageVersion;
+    metrics.rules.reserve(m_patterns.size());
+    for (int i = 0; i < m_patterns.size(); ++i) {
+        const Counters &counters = m_counters[i];
+        RuleMetrics rule;
+        rule.pattern = m_patterns.at(i);
+        rule.lines = counters.lines.loadRelaxed();
+        rule.matches = counters.matches.loadRelaxed();
+        rule.totalNs = counters.totalNs.loadRelaxed();
+        rule.maxNs = counters.maxNs.loadRelaxed();
+        rule.timeouts = counters.timeouts.loadRelaxed();
+        rule.disabled = counters.disabled.loadRelaxed() != 0;
+        metrics.rules.append(rule);
+    }
+    return metrics;
+}
+
+// RuleProfiler ===============================================================
+
+// Singleton instance initialization
+RuleProfiler* RuleProfiler::m_instance = nullptr;
+QMutex RuleProfiler::m_instanceMutex;
+
+RuleProfiler* RuleProfiler::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+    if (!m_instance) {
+        m_instance = new RuleProfiler();
+    }
+    return m_instance;
+}
+
+QSharedPointer<RuleProfiler::LanguageProfile> RuleProfiler::profile(const QString &language,
+                                                                    quint64 languageVersion,
+                                                                    const QStringList &patterns)
+{
+    QMutexLocker locker(&m_mutex);
+    QSharedPointer<LanguageProfile> &profile = m_profiles[qMakePair(language, languageVersion)];
+    if (!profile) {
+        profile = QSharedPointer<LanguageProfile>::create(language, languageVersion, patterns);
+    }
+    return profile;
+}
+
+QVector<RuleProfiler::LanguageMetrics> RuleProfiler::metrics() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVector<LanguageMetrics> metrics;
+    for (const auto &profile : m_profiles) {
+        metrics.append(profile->metrics());
+    }
+    return metrics;
+}
+
+void RuleProfiler::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    for (const auto &profile : qAsConst(m_profiles)) {
+        profile->reset();
+    }
+}
+
+QRegularExpression RuleProfiler::guardedPattern(const QRegularExpression &pattern)
+{
+    return QRegularExpression(QStringLiteral("(*LIMIT_MATCH=%1)").arg(kMatchLimit) + pattern.pattern(),
+                              pattern.patternOptions());
+}
+
+bool RuleProfiler::forEachMatch(const QRegularExpression &pattern, const QString &text, int from,
+                                const std::function<void(const QRegularExpressionMatch &)> &onMatch,
+                                int *matches)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int offset = from;
+    while (offset <= text.length()) {
+        const QRegularExpressionMatch match = pattern.match(text, offset);
+        if (!match.hasMatch()) {
+            // An invalid result without a match means PCRE gave up at the step limit
+            return match.isValid();
+        }
+
+        onMatch(match);
+        if (matches) {
+            ++*matches;
+        }
+
+        // Empty matches paint nothing; resume behind them, never inside a surrogate pair
+        offset = match.capturedEnd() > match.capturedStart() ? match.capturedEnd() : match.capturedEnd() + 1;
+        if (offset < text.length() && text.at(offset).isLowSurrogate()) {
+            ++offset;
+        }
+
+        if (timer.nsecsElapsed() > kLineBudgetNs) {
+            return false;
+        }
+    }
+    return true;
+}
+
+qint64 RuleProfiler::lineBudgetNs()
+{
+    return kLineBudgetNs;
+}
+
+int RuleProfiler::matchLimit()
+{
+    return kMatchLimit;
+}
@@ -0,0 +1,112 @@
+#ifndef RULE_PROFILER_H
+#define RULE_PROFILER_H
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QRegularExpression>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+#include <memory>
+
+/**
+ * @brief Per-rule cost accounting and runaway guard for highlighting rules
+ *
+ * Every compiled rule runs with a PCRE step limit, and the matches of one rule
+ * on one line share a time budget. A rule that hits either limit leaves the
+ * rest of that line unpainted (plain text) instead of freezing the UI thread.
+ * After repeated timeouts the rule is disabled for the session.
+ *
+ * Time, lines and matches are recorded per rule and per language and can be
+ * read through metrics(). All methods are thread-safe.
+ */
+class RuleProfiler
+{
+public:
+    struct RuleMetrics {
+        QString pattern;
+        quint64 lines = 0;     // Lines the rule's regex ran on
+        quint64 matches = 0;
+        qint64 totalNs = 0;
+        qint64 maxNs = 0;      // Slowest single line
+        quint64 timeouts = 0;  // Lines cut short by the step or time limit
+        bool disabled = false; // Disabled after repeated timeouts
+    };
+
+    struct LanguageMetrics {
+        QString language;
+        quint64 languageVersion = 0;
+        QVector<RuleMetrics> rules;
+    };
+
+    /**
+     * @brief Counters for the rules of one language version
+     *
+     * Shared by every lexer snapshot compiled from the same rules and updated
+     * concurrently by the parallel lexing workers.
+     */
+    class LanguageProfile
+    {
+    public:
+        LanguageProfile(const QString &language, quint64 languageVersion, const QStringList &patterns);
+
+        bool isDisabled(int rule) const;
+        void record(int rule, qint64 nanoseconds, int matches, bool timedOut);
+        void reset();
+        LanguageMetrics metrics() const;
+
+    private:
+        struct Counters {
+            QAtomicInteger<quint64> lines;
+            QAtomicInteger<quint64> matches;
+            QAtomicInteger<qint64> totalNs;
+            QAtomicInteger<qint64> maxNs;
+            QAtomicInteger<quint64> timeouts;
+            QAtomicInt disabled;
+        };
+
+        const QString m_language;
+        const quint64 m_languageVersion;
+        const QStringList m_patterns;
+        std::unique_ptr<Counters[]> m_counters;
+    };
+
+    // Singleton instance access
+    static RuleProfiler* instance();
+
+    RuleProfiler(const RuleProfiler&) = delete;
+    RuleProfiler& operator=(const RuleProfiler&) = delete;
+
+    QSharedPointer<LanguageProfile> profile(const QString &language, quint64 languageVersion,
+                                            const QStringList &patterns);
+    QVector<LanguageMetrics> metrics() const;
+
+    // Clears all counters and re-enables disabled rules
+    void reset();
+
+    // Guard: the pattern with a PCRE step limit prepended
+    static QRegularExpression guardedPattern(const QRegularExpression &pattern);
+
+    // Calls onMatch for each match from column `from` on; false if a limit stopped it early
+    static bool forEachMatch(const QRegularExpression &pattern, const QString &text, int from,
+                             const std::function<void(const QRegularExpressionMatch &)> &onMatch,
+                             int *matches = nullptr);
+
+    static qint64 lineBudgetNs();
+    static int matchLimit();
+
+private:
+    RuleProfiler() = default;
+
+    static RuleProfiler* m_instance;
+    static QMutex m_instanceMutex;
+
+    mutable QMutex m_mutex;
+    QHash<QPair<QString, quint64>, QSharedPointer<LanguageProfile>> m_profiles;
+};
+
+#endif // RULE_PROFILER_H
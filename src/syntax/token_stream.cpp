@@ -0,0 +1,177 @@
+#include "token_stream.h"
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const int kMaxRunLength = 0xFFFF;
+// Formats beyond the id range fall back to plain text
+const int kMaxFormats = 256;
+} // namespace
+
+// TokenStream::Builder =======================================================
+
+void TokenStream::Builder::reset(int lineLength) {
+    m_classes.fill(PlainText, lineLength);
+}
+
+void TokenStream::Builder::paint(int start, int length, ClassId tokenClass) {
+    const int lineLength = m_classes.size();
+    const int begin = qBound(0, start, lineLength);
+    const int end = qBound(begin, start + length, lineLength);
+    if (begin < end) {
+        std::memset(m_classes.data() + begin, tokenClass, size_t(end - begin));
+    }
+}
+
+TokenStream TokenStream::Builder::build() {
+    QVector<quint32> &runStarts = m_runStarts;
+    QVector<quint16> &runLengths = m_runLengths;
+    QVector<ClassId> &runClasses = m_runClasses;
+    runStarts.resize(0);
+    runLengths.resize(0);
+    runClasses.resize(0);
+
+    const ClassId *classes = m_classes.constData();
+    const int lineLength = m_classes.size();
+    int column = 0;
+    while (column < lineLength) {
+        const ClassId current = classes[column];
+        int end = column + 1;
+        while (end < lineLength && classes[end] == current && end - column < kMaxRunLength) {
+            ++end;
+        }
+        if (current != PlainText) {
+            runStarts.append(quint32(column));
+            runLengths.append(quint16(end - column));
+            runClasses.append(current);
+        }
+        column = end;
+    }
+
+    TokenStream stream;
+    stream.m_size = runStarts.size();
+    if (stream.m_size == 0) {
+        return stream;
+    }
+
+    const int n = stream.m_size;
+    stream.m_data.resize(n * int(sizeof(quint32) + sizeof(quint16) + sizeof(ClassId)));
+    char *out = stream.m_data.data();
+    std::memcpy(out, runStarts.constData(), n * sizeof(quint32));
+    std::memcpy(out + n * sizeof(quint32), runLengths.constData(), n * sizeof(quint16));
+    std::memcpy(out + n * (sizeof(quint32) + sizeof(quint16)), runClasses.constData(), n * sizeof(ClassId));
+    return stream;
+}
+
+// TokenStream ================================================================
+
+const quint32 *TokenStream::starts() const {
+    return reinterpret_cast<const quint32 *>(m_data.constData());
+}
+
+const quint16 *TokenStream::lengths() const {
+    return reinterpret_cast<const quint16 *>(m_data.constData() + m_size * sizeof(quint32));
+}
+
+const TokenStream::ClassId *TokenStream::classes() const {
+    return reinterpret_cast<const ClassId *>(
+        m_data.constData() + m_size * (sizeof(quint32) + sizeof(quint16)));
+}
+
+TokenStream::ClassId TokenStream::classAt(int column) const {
+    const quint32 *begin = starts();
+    const quint32 *it = std::upper_bound(begin, begin + m_size, quint32(qMax(column, 0)));
+    if (it == begin) {
+        return PlainText;
+    }
+    const int index = int(it - begin) - 1;
+    return column < start(index) + length(index) ? tokenClass(index) : PlainText;
+}
+
+int TokenStream::memoryUsage() const {
+    return int(sizeof(TokenStream)) + m_data.capacity();
+}
+
+bool TokenStream::operator==(const TokenStream &other) const {
+    return m_size == other.m_size && m_data == other.m_data;
+}
+
+QDataStream &operator<<(QDataStream &out, const TokenStream &tokens) {
+    out << qint32(tokens.m_size) << tokens.m_data;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, TokenStream &tokens) {
+    qint32 size = 0;
+    QByteArray data;
+    in >> size >> data;
+
+    const int bytesPerToken = int(sizeof(quint32) + sizeof(quint16) + sizeof(TokenStream::ClassId));
+    if (size < 0 || data.size() != size * bytesPerToken) {
+        in.setStatus(QDataStream::ReadCorruptData);
+        tokens = TokenStream();
+        return in;
+    }
+    tokens.m_size = size;
+    tokens.m_data = data;
+    return in;
+}
+
+// FormatTable ================================================================
+
+FormatTable::FormatTable()
+    : m_roleColors(TokenStyle::RoleCount)
+{
+    clear();
+}
+
+TokenStream::ClassId FormatTable::intern(const TokenStyle &style) {
+    for (int i = 0; i < m_styles.size(); ++i) {
+        if (m_styles.at(i) == style) {
+            return TokenStream::ClassId(i);
+        }
+    }
+
+    if (m_styles.size() >= kMaxFormats) {
+        qWarning() << "Format table full, highlighting rule falls back to plain text";
+        return TokenStream::PlainText;
+    }
+
+    m_styles.append(style);
+    m_formats.append(resolve(style));
+    return TokenStream::ClassId(m_styles.size() - 1);
+}
+
+const QTextCharFormat &FormatTable::format(TokenStream::ClassId id) const {
+    return id < m_formats.size() ? m_formats.at(id) : m_formats.at(TokenStream::PlainText);
+}
+
+const TokenStyle &FormatTable::style(TokenStream::ClassId id) const {
+    return id < m_styles.size() ? m_styles.at(id) : m_styles.at(TokenStream::PlainText);
+}
+
+void FormatTable::clear() {
+    m_styles.clear();
+    m_formats.clear();
+    m_styles.append(TokenStyle()); // PlainText
+    m_formats.append(QTextCharFormat());
+}
+
+void FormatTable::setRoleColors(const QVector<QColor> &colors) {
+    m_roleColors = colors;
+    m_roleColors.resize(TokenStyle::RoleCount);
+    for (int i = 0; i < m_styles.size(); ++i) {
+        m_formats[i] = resolve(m_styles.at(i));
+    }
+}
+
+QTextCharFormat FormatTable::resolve(const TokenStyle &style) const {
+    QTextCharFormat format;
+    const QColor &color = m_roleColors.at(style.role);
+    if (style.role != TokenStyle::NoRole && color.isValid()) {
+        format.setForeground(color);
+    }
+    format.merge(style.overrides);
+    return format;
+}
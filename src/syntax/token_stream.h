@@ -0,0 +1,139 @@
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+#include <QByteArray>
+#include <QColor>
+#include <QDataStream>
+#include <QTextCharFormat>
+#include <QVector>
+
+/**
+ * @brief Highlighting result for one line as a compact struct-of-arrays
+ *
+ * Tokens are sorted, non-overlapping runs of (start, length, class id) that
+ * live in a single allocation: all starts, then all lengths, then all class
+ * ids (7 bytes per token). Plain text is not stored. The class id indexes a
+ * FormatTable, so no QTextCharFormat is kept per range.
+ *
+ * The stream is immutable once built and implicitly shared, which makes it
+ * cheap to hand to the minimap, folding and outline.
+ */
+class TokenStream
+{
+public:
+    using ClassId = quint8;
+    static constexpr ClassId PlainText = 0;
+
+    /**
+     * @brief Turns ordered, possibly overlapping paint operations into runs
+     *
+     * Later paints win, matching the semantics of repeated setFormat() calls.
+     * A builder can be reused for many lines to avoid reallocations.
+     */
+    class Builder
+    {
+    public:
+        void reset(int lineLength);
+        void paint(int start, int length, ClassId tokenClass);
+        TokenStream build();
+
+        // Class painted so far at each column of the current line
+        const ClassId *classes() const { return m_classes.constData(); }
+
+    private:
+        QVector<ClassId> m_classes;
+
+        // Scratch space for build(), kept to avoid per-line allocations
+        QVector<quint32> m_runStarts;
+        QVector<quint16> m_runLengths;
+        QVector<ClassId> m_runClasses;
+    };
+
+    TokenStream() = default;
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+
+    int start(int index) const { return int(starts()[index]); }
+    int length(int index) const { return int(lengths()[index]); }
+    ClassId tokenClass(int index) const { return classes()[index]; }
+
+    // Token class covering the given column (PlainText if none)
+    ClassId classAt(int column) const;
+
+    // Approximate heap footprint, used for cache accounting
+    int memoryUsage() const;
+
+    bool operator==(const TokenStream &other) const;
+    bool operator!=(const TokenStream &other) const { return !(*this == other); }
+
+    friend QDataStream &operator<<(QDataStream &out, const TokenStream &tokens);
+    friend QDataStream &operator>>(QDataStream &in, TokenStream &tokens);
+
+private:
+    const quint32 *starts() const;
+    const quint16 *lengths() const;
+    const ClassId *classes() const;
+
+    QByteArray m_data;
+    int m_size = 0;
+};
+
+/**
+ * @brief Theme-independent description of how a token class is drawn
+ *
+ * The role selects a theme color slot; overrides carry properties given
+ * explicitly by the language file or a custom rule and win over the theme.
+ */
+struct TokenStyle {
+    enum Role : quint8 {
+        NoRole,
+        Keyword,
+        String,
+        Comment,
+        Number,
+        Function,
+        Type,
+        RoleCount
+    };
+
+    Role role = NoRole;
+    QTextCharFormat overrides;
+
+    bool operator==(const TokenStyle &other) const {
+        return role == other.role && overrides == other.overrides;
+    }
+};
+
+/**
+ * @brief Interned mapping from token class ids to character formats
+ *
+ * Class 0 is always plain text. Identical styles share one id, so a
+ * language typically needs a few dozen entries at most. Ids only depend on
+ * the styles, never on theme colors: a theme change rebuilds the formats
+ * in place and every token stream stays valid.
+ */
+class FormatTable
+{
+public:
+    FormatTable();
+
+    // Returns the id of an equal style, adding one if needed
+    TokenStream::ClassId intern(const TokenStyle &style);
+    const QTextCharFormat &format(TokenStream::ClassId id) const;
+    const TokenStyle &style(TokenStream::ClassId id) const;
+    int size() const { return m_styles.size(); }
+    void clear();
+
+    // Recomputes all formats from new theme colors, indexed by role
+    void setRoleColors(const QVector<QColor> &colors);
+
+private:
+    QTextCharFormat resolve(const TokenStyle &style) const;
+
+    QVector<TokenStyle> m_styles;
+    QVector<QTextCharFormat> m_formats;
+    QVector<QColor> m_roleColors;
+};
+
+#endif // TOKEN_STREAM_H
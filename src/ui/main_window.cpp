@@ -2,10 +2,14 @@
 #include "ui_main_window.h"
 #include "editor_core.h"
 #include "syntax/highlighter.h"
+#include "minimap.h"
+#include "status_bar.h"
+#include "tab_system.h"
 #include "utilities/settings.h"
 #include "plugins/plugin_manager.h"
 #include "version_control/git_integration.h"
 #include "debugger/debug_interface.h"
+#include "utilities/batch_converter.h"
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QStatusBar>
@@ -14,6 +18,9 @@
 #include <QDockWidget>
 #include <QInputDialog>
 #include <QShortcut>
+#include <QPushButton>
+#include <QDir>
+#include <QFileInfo>
 
 MainWindow::MainWindow(EditorCore* core, QWidget *parent)
     : QMainWindow(parent),
@@ -66,6 +73,7 @@ void MainWindow::setupMenuBar()
     fileMenu->addAction(tr("&Open..."), this, &MainWindow::openDocument, QKeySequence::Open);
     fileMenu->addAction(tr("&Save"), this, &MainWindow::saveDocument, QKeySequence::Save);
     fileMenu->addAction(tr("Save &As..."), this, &MainWindow::saveAsDocument, QKeySequence::SaveAs);
+    fileMenu->addAction(tr("Save A&ll"), this, &MainWindow::saveAllDocuments);
     fileMenu->addSeparator();
     
     // Project submenu
@@ -74,6 +82,8 @@ void MainWindow::setupMenuBar()
     projectMenu->addAction(tr("Open Project..."), this, &MainWindow::openProject);
     projectMenu->addAction(tr("Close Project"), this, &MainWindow::closeProject);
     
+    fileMenu->addSeparator();
+    fileMenu->addAction(tr("Convert &Folder to Unicode..."), this, &MainWindow::convertFolderToUnicode);
     fileMenu->addSeparator();
     fileMenu->addAction(tr("E&xit"), this, &QMainWindow::close, QKeySequence::Quit);
 
@@ -177,16 +187,10 @@ void MainWindow::setupToolBars()
 
 void MainWindow::setupStatusBar()
 {
-    statusBar()->showMessage(tr("Ready"));
-    
-    // Line/column indicator
-    m_lineColLabel = new QLabel(this);
-    statusBar()->addPermanentWidget(m_lineColLabel);
-    updateLineColDisplay(1, 1);
-    
-    // File encoding indicator
-    m_encodingLabel = new QLabel("UTF-8", this);
-    statusBar()->addPermanentWidget(m_encodingLabel);
+    // Line/column, encoding and the load progress bar come with StatusBar
+    m_statusBar = new StatusBar(this);
+    setStatusBar(m_statusBar);
+    m_statusBar->showMessage(tr("Ready"));
     
     // VCS branch indicator
     m_vcsBranchLabel = new QLabel(this);
@@ -205,7 +209,18 @@ void MainWindow::setupEditor()
     
     // Set up syntax highlighter
     m_highlighter = new SyntaxHighlighter(ui->editor->document());
-    
+
+    // Tell the highlighter what is on screen so theme changes repaint it first
+    connect(ui->editor, &QPlainTextEdit::updateRequest, this, [this]() {
+        const int first = ui->editor->cursorForPosition(QPoint(0, 0)).blockNumber();
+        const int last = ui->editor->cursorForPosition(
+            QPoint(0, ui->editor->viewport()->height())).blockNumber();
+        m_highlighter->setVisibleBlocks(first, last);
+    });
+
+    // Minimap, rasterized from the highlighter's tokens
+    m_minimap = new Minimap(ui->editor, m_highlighter);
+
     // Line numbers
     ui->lineNumberArea->setEditor(ui->editor);
     
@@ -215,15 +230,28 @@ void MainWindow::setupEditor()
 
 void MainWindow::setupTabSystem()
 {
-    m_tabWidget = new QTabWidget(this);
-    m_tabWidget->setTabsClosable(true);
-    m_tabWidget->setMovable(true);
+    // Closable and movable tabs; TabSystem handles close requests itself
+    m_tabSystem = new TabSystem(m_core, this, false);
+    m_tabWidget = m_tabSystem;
     setCentralWidget(m_tabWidget);
     
-    // Add initial editor tab
-    m_tabWidget->addTab(ui->editor, tr("Untitled"));
-    connect(m_tabWidget, &QTabWidget::tabCloseRequested, this, &MainWindow::closeTab);
+    // The initial editor stays ours: the highlighter, minimap and debugger use
+    // it for the window's lifetime, so closing its tab must not delete it
+    m_tabSystem->addExternalEditor(ui->editor, tr("Untitled"));
     connect(m_tabWidget, &QTabWidget::currentChanged, this, &MainWindow::tabChanged);
+
+    // Streaming loads report through the status bar progress bar
+    connect(m_tabSystem, &TabSystem::loadStarted, this, [this](const QString& path, int maximum) {
+        m_statusBar->showMessage(tr("Loading %1...").arg(QFileInfo(path).fileName()));
+        m_statusBar->showProgressBar(maximum);
+    });
+    connect(m_tabSystem, &TabSystem::loadProgress, m_statusBar, &StatusBar::updateProgress);
+    connect(m_tabSystem, &TabSystem::loadFinished, this, [this](const QString& path, bool success) {
+        m_statusBar->hideProgressBar();
+        m_statusBar->showMessage(success ? tr("Loaded %1").arg(QFileInfo(path).fileName())
+                                         : tr("Failed to load %1").arg(QFileInfo(path).fileName()),
+                                 3000);
+    });
 }
 
 void MainWindow::setupDockWidgets()
@@ -419,3 +447,69 @@ void MainWindow::onBreakpointHit(const QString& file, int line)
         item->setText(2, var.value);
     }
 }
+
+void MainWindow::convertFolderToUnicode()
+{
+    const QString directory = QFileDialog::getExistingDirectory(this, tr("Convert Folder to Unicode"));
+    if (directory.isEmpty()) {
+        return;
+    }
+
+    // Rewrites a whole tree, so never without asking; in place always keeps backups
+    QMessageBox question(QMessageBox::Warning, tr("Convert Folder to Unicode"),
+                         tr("Convert every text file under %1 to UTF-8?").arg(QDir::toNativeSeparators(directory)),
+                         QMessageBox::Cancel, this);
+    QPushButton* toFolder = question.addButton(tr("Write to Another Folder..."), QMessageBox::AcceptRole);
+    QPushButton* inPlace = question.addButton(tr("Convert in Place (Keep .bak)"), QMessageBox::DestructiveRole);
+    question.setDefaultButton(toFolder);
+    question.exec();
+
+    BatchConverter::Options options;
+    if (question.clickedButton() == toFolder) {
+        options.outputDirectory = QFileDialog::getExistingDirectory(this, tr("Output Folder"));
+        if (options.outputDirectory.isEmpty()) {
+            return;
+        }
+        if (QDir(options.outputDirectory).absolutePath() == QDir(directory).absolutePath()) {
+            QMessageBox::warning(this, tr("Convert Folder to Unicode"),
+                                 tr("The output folder must differ from the folder being converted."));
+            return;
+        }
+    } else if (question.clickedButton() == inPlace) {
+        options.backup = true;
+    } else {
+        return;
+    }
+
+    // Runs in the background; the converter reports from its worker threads
+    BatchConverter* converter = new BatchConverter(this);
+    connect(converter, &BatchConverter::progress, this, [this](const BatchConverter::Report& report) {
+        statusBar()->showMessage(tr("Converting: %1 of %2 files, %3 MB/s")
+                                 .arg(report.converted + report.skipped + report.failures.size())
+                                 .arg(report.scanned)
+                                 .arg(report.megabytesPerSecond(), 0, 'f', 1));
+    });
+    connect(converter, &BatchConverter::finished, this, [this, converter](const BatchConverter::Report& report) {
+        statusBar()->clearMessage();
+        QString summary = tr("%1 files converted, %2 skipped in %3 s (%4 files/s).")
+                              .arg(report.converted)
+                              .arg(report.skipped)
+                              .arg(report.elapsedMs / 1000.0, 0, 'f', 1)
+                              .arg(report.filesPerSecond(), 0, 'f', 0);
+        if (!report.failures.isEmpty()) {
+            summary += QLatin1Char('\n') + tr("%n file(s) failed, first: %1", "", report.failures.size())
+                                             .arg(report.failures.first().path);
+            QMessageBox::warning(this, tr("Convert Folder to Unicode"), summary);
+        } else {
+            QMessageBox::information(this, tr("Convert Folder to Unicode"), summary);
+        }
+        converter->deleteLater();
+    });
+    converter->start(directory, options);
+}
+
+void MainWindow::saveAllDocuments()
+{
+    // Every modified tab in one background submission, each in its own encoding
+    m_tabSystem->saveAllTabs();
+}
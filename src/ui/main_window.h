@@ -24,6 +24,10 @@ namespace Ui {
 class MainWindow;
 }
 
+class Minimap;
+class StatusBar;
+class TabSystem;
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -50,6 +54,7 @@ private slots:
     void newProject();
     void openProject();
     void closeProject();
+    void convertFolderToUnicode();
 
     // Edit operations
     void undo();
@@ -131,12 +136,13 @@ private:
     Ui::MainWindow* ui;
     EditorCore* m_core;
     SyntaxHighlighter* m_highlighter;
+    Minimap* m_minimap;
     SearchHighlighter* m_searchHighlighter;
-    QLabel* m_lineColLabel;
-    QLabel* m_encodingLabel;
+    StatusBar* m_statusBar;
     QLabel* m_vcsBranchLabel;
     QLabel* m_debugStatusLabel;
     QTabWidget* m_tabWidget;
+    TabSystem* m_tabSystem;
 
     // Menus
     QMenu* m_fileMenu;
@@ -0,0 +1,315 @@
+#include "minimap.h"
+#include "syntax/highlighter.h"
+#include "utilities/frame_scheduler.h"
+#include <QAbstractScrollArea>
+#include <QFutureWatcher>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPlainTextEdit>
+#include <QScrollBar>
+#include <QTextBlock>
+#include <QtConcurrent>
+#include <algorithm>
+
+namespace {
+const int kMinimapWidth = 110;
+// One pixel row per line plus a gap, one pixel column per character
+const int kLinePixels = 2;
+const int kTabWidth = 4;
+// Tiles kept around the view; 48 tiles cover ~12k lines at ~55 KB each
+const int kMaxCachedTiles = 48;
+// Token colors are dimmed so the minimap does not compete with the text
+const int kTokenAlpha = 170;
+
+// setViewportMargins() is protected; a pointer to it taken in a derived
+// class may be called on any scroll area
+struct ViewportMargins : QAbstractScrollArea
+{
+    static void setRight(QAbstractScrollArea *area, int right)
+    {
+        QMargins margins = area->viewportMargins();
+        margins.setRight(right);
+        auto set = static_cast<void (QAbstractScrollArea::*)(const QMargins &)>(
+            &ViewportMargins::setViewportMargins);
+        (area->*set)(margins);
+    }
+};
+} // namespace
+
+Minimap::Minimap(QPlainTextEdit *editor, SyntaxHighlighter *highlighter)
+    : QWidget(editor),
+      m_editor(editor),
+      m_highlighter(highlighter),
+      m_lineCount(editor->document()->blockCount())
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setCursor(Qt::PointingHandCursor);
+
+    connect(editor->document(), &QTextDocument::contentsChange, this, &Minimap::onContentsChange);
+    connect(highlighter, &SyntaxHighlighter::tokensChanged, this, &Minimap::onTokensChanged);
+    connect(highlighter, &SyntaxHighlighter::themeChanged, this, &Minimap::onFormatsChanged);
+    connect(highlighter, &SyntaxHighlighter::languageLoaded, this, &Minimap::onFormatsChanged);
+
+    QScrollBar *bar = editor->verticalScrollBar();
+    connect(bar, &QScrollBar::valueChanged, this, QOverload<>::of(&QWidget::update));
+    connect(bar, &QScrollBar::rangeChanged, this, QOverload<>::of(&QWidget::update));
+
+    // The viewport ends where the minimap starts, so no text is drawn under it
+    ViewportMargins::setRight(editor, kMinimapWidth);
+    // The viewport, not the editor: its geometry is final by the time it hears
+    editor->viewport()->installEventFilter(this);
+    rebuildPalette();
+    updateGeometryFromEditor();
+}
+
+QSize Minimap::sizeHint() const
+{
+    return QSize(kMinimapWidth, 0);
+}
+
+bool Minimap::eventFilter(QObject *watched, QEvent *event)
+{
+    if (m_editor && watched == m_editor->viewport()
+        && (event->type() == QEvent::Resize || event->type() == QEvent::Move)) {
+        // The width is fixed, so the tiles stay valid
+        updateGeometryFromEditor();
+    }
+    return QWidget::eventFilter(watched, event);
+}
+
+void Minimap::updateGeometryFromEditor()
+{
+    // In the right viewport margin, between the text and the scroll bar
+    const QRect viewport = m_editor->viewport()->geometry();
+    setGeometry(viewport.right() + 1, viewport.top(), kMinimapWidth, viewport.height());
+}
+
+int Minimap::firstShownLine() const
+{
+    // Scrolls proportionally with the editor once the document is taller than the minimap
+    const int shownLines = height() / kLinePixels;
+    const QScrollBar *bar = m_editor->verticalScrollBar();
+    if (m_lineCount <= shownLines || bar->maximum() <= 0) {
+        return 0;
+    }
+    return int(qint64(bar->value()) * (m_lineCount - shownLines) / bar->maximum());
+}
+
+void Minimap::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), m_editor->palette().color(QPalette::Base).darker(105));
+
+    const int firstLine = firstShownLine();
+    const int lastLine = qMin(m_lineCount - 1, firstLine + height() / kLinePixels);
+    for (int tile = firstLine / kTileLines; tile <= lastLine / kTileLines; ++tile) {
+        Tile &entry = m_tiles[tile];
+        // Stale images stay up until their replacement arrives
+        if (!entry.image.isNull()) {
+            painter.drawImage(0, (tile * kTileLines - firstLine) * kLinePixels, entry.image);
+        }
+        if (entry.revision != entry.imageRevision && !entry.pending) {
+            requestTile(tile);
+        }
+    }
+
+    // The part of the document visible in the editor
+    const QScrollBar *bar = m_editor->verticalScrollBar();
+    const QRect slider(0, (bar->value() - firstLine) * kLinePixels,
+                       width(), qMax(1, bar->pageStep()) * kLinePixels);
+    painter.fillRect(slider, QColor(128, 128, 128, 60));
+
+    evictTiles();
+}
+
+void Minimap::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton) {
+        scrollEditorTo(event->pos().y());
+    }
+}
+
+void Minimap::mouseMoveEvent(QMouseEvent *event)
+{
+    if (event->buttons() & Qt::LeftButton) {
+        scrollEditorTo(event->pos().y());
+    }
+}
+
+void Minimap::scrollEditorTo(int y)
+{
+    QScrollBar *bar = m_editor->verticalScrollBar();
+    const int line = firstShownLine() + y / kLinePixels;
+    bar->setValue(line - bar->pageStep() / 2);
+}
+
+void Minimap::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved)
+    const QTextDocument *doc = m_editor->document();
+    const int firstLine = doc->findBlock(position).blockNumber();
+    const int lineCount = doc->blockCount();
+
+    if (lineCount != m_lineCount) {
+        // Every later line moved
+        m_lineCount = lineCount;
+        markDirtyFrom(firstLine);
+    } else {
+        markDirty(firstLine, doc->findBlock(position + charsAdded).blockNumber());
+    }
+    scheduleRepaint();
+}
+
+void Minimap::onTokensChanged(int firstBlock, int lastBlock)
+{
+    markDirty(firstBlock, lastBlock);
+    scheduleRepaint();
+}
+
+void Minimap::onFormatsChanged()
+{
+    rebuildPalette();
+    markDirtyFrom(0);
+    scheduleRepaint();
+}
+
+void Minimap::markDirty(int firstLine, int lastLine)
+{
+    const int lastTile = qMax(firstLine, lastLine) / kTileLines;
+    for (int tile = firstLine / kTileLines; tile <= lastTile; ++tile) {
+        auto it = m_tiles.find(tile);
+        if (it != m_tiles.end()) {
+            ++it->revision;
+        }
+    }
+}
+
+void Minimap::markDirtyFrom(int firstLine)
+{
+    const int firstTile = firstLine / kTileLines;
+    for (auto it = m_tiles.begin(); it != m_tiles.end(); ++it) {
+        if (it.key() >= firstTile) {
+            ++it->revision;
+        }
+    }
+}
+
+void Minimap::scheduleRepaint()
+{
+    // Bursts of edits and re-lexed blocks collapse into one repaint per frame
+    FrameScheduler::instance()->postCoalesced(FrameScheduler::Decorations, this, QStringLiteral("minimap"),
+                                              [this]() { update(); });
+}
+
+void Minimap::rebuildPalette()
+{
+    const QColor plain = m_editor->palette().color(QPalette::Text);
+    m_plainColor = qPremultiply(qRgba(plain.red(), plain.green(), plain.blue(), kTokenAlpha / 2));
+
+    const FormatTable &formats = m_highlighter->formatTable();
+    m_palette.resize(formats.size());
+    for (int id = 0; id < formats.size(); ++id) {
+        const QBrush foreground = formats.format(TokenStream::ClassId(id)).foreground();
+        const QColor color = foreground.style() == Qt::NoBrush ? plain : foreground.color();
+        m_palette[id] = qPremultiply(qRgba(color.red(), color.green(), color.blue(), kTokenAlpha));
+    }
+}
+
+void Minimap::requestTile(int tile)
+{
+    // Formats are interned lazily, so the table may have grown since the last rebuild
+    if (m_palette.size() != m_highlighter->formatTable().size()) {
+        rebuildPalette();
+    }
+
+    Tile &entry = m_tiles[tile];
+    TileJob job;
+    job.revision = entry.revision;
+    job.width = width();
+    job.palette = m_palette;
+    job.plainColor = m_plainColor;
+    job.lines.reserve(kTileLines);
+    job.tokens.reserve(kTileLines);
+
+    QTextBlock block = m_editor->document()->findBlockByNumber(tile * kTileLines);
+    for (int i = 0; i < kTileLines && block.isValid(); ++i, block = block.next()) {
+        const TokenStream *tokens = m_highlighter->tokensForBlock(block);
+        job.lines.append(block.text());
+        job.tokens.append(tokens ? *tokens : TokenStream());
+    }
+
+    entry.pending = true;
+    auto *watcher = new QFutureWatcher<QImage>(this);
+    const quint64 revision = job.revision;
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, tile, revision]() {
+        watcher->deleteLater();
+        auto it = m_tiles.find(tile);
+        if (it == m_tiles.end()) {
+            return;
+        }
+        it->image = watcher->result();
+        it->imageRevision = revision;
+        it->pending = false;
+        // Repainting re-requests the tile if it changed again meanwhile
+        scheduleRepaint();
+    });
+    watcher->setFuture(QtConcurrent::run(&Minimap::rasterize, job));
+}
+
+void Minimap::evictTiles()
+{
+    if (m_tiles.size() <= kMaxCachedTiles) {
+        return;
+    }
+
+    // Drop the tiles farthest from the view. Tiles still being rasterized stay,
+    // or a recreated tile would take the old job's image as current
+    const int center = (firstShownLine() + height() / kLinePixels / 2) / kTileLines;
+    QVector<int> tiles = m_tiles.keys().toVector();
+    std::sort(tiles.begin(), tiles.end(), [center](int a, int b) {
+        return qAbs(a - center) > qAbs(b - center);
+    });
+    for (int i = 0; m_tiles.size() > kMaxCachedTiles && i < tiles.size(); ++i) {
+        if (!m_tiles.value(tiles.at(i)).pending) {
+            m_tiles.remove(tiles.at(i));
+        }
+    }
+}
+
+QImage Minimap::rasterize(const TileJob &job)
+{
+    QImage image(job.width, kTileLines * kLinePixels, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    for (int line = 0; line < job.lines.size(); ++line) {
+        const QString &text = job.lines.at(line);
+        const TokenStream &tokens = job.tokens.at(line);
+        auto *row = reinterpret_cast<QRgb *>(image.scanLine(line * kLinePixels));
+
+        int x = 0;
+        int token = 0;
+        for (int column = 0; column < text.size() && x < job.width; ++column) {
+            const QChar ch = text.at(column);
+            if (ch == QLatin1Char('\t')) {
+                x += kTabWidth - x % kTabWidth;
+                continue;
+            }
+            if (ch.isSpace()) {
+                ++x;
+                continue;
+            }
+
+            // Tokens are sorted runs, so one forward walk finds each column's class
+            while (token < tokens.size() && tokens.start(token) + tokens.length(token) <= column) {
+                ++token;
+            }
+            TokenStream::ClassId tokenClass = TokenStream::PlainText;
+            if (token < tokens.size() && tokens.start(token) <= column) {
+                tokenClass = tokens.tokenClass(token);
+            }
+            row[x++] = tokenClass != TokenStream::PlainText && tokenClass < job.palette.size()
+                ? job.palette.at(tokenClass) : job.plainColor;
+        }
+    }
+    return image;
+}
@@ -0,0 +1,87 @@
+#ifndef MINIMAP_H
+#define MINIMAP_H
+
+#include <QWidget>
+#include <QHash>
+#include <QImage>
+#include <QPointer>
+#include <QVector>
+#include "syntax/token_stream.h"
+
+class QPlainTextEdit;
+class SyntaxHighlighter;
+
+/**
+ * @brief Downsampled overview of the document shown along the editor's right edge
+ *
+ * Each line is drawn as a row of colored pixels, one per character, straight
+ * from the highlighter's token streams. The document is cut into tiles of
+ * kTileLines lines that are rasterized into cached images on a worker thread.
+ * Edits and re-lexing only mark the affected tiles dirty; the stale image
+ * stays on screen until its replacement arrives. Only tiles in view are ever
+ * rasterized and the cache is bounded, so cost does not grow with file size.
+ *
+ * It sits in a right viewport margin it reserves on the editor, between the
+ * text and the scroll bar, so it never covers text.
+ */
+class Minimap : public QWidget
+{
+    Q_OBJECT
+
+public:
+    static constexpr int kTileLines = 256;
+
+    Minimap(QPlainTextEdit *editor, SyntaxHighlighter *highlighter);
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void onTokensChanged(int firstBlock, int lastBlock);
+    void onFormatsChanged();
+
+private:
+    struct Tile {
+        QImage image;
+        quint64 revision = 1;         // Bumped whenever the tile's lines change
+        quint64 imageRevision = 0;    // Revision the image was rasterized from
+        bool pending = false;         // A worker is rasterizing it
+    };
+
+    // Everything a worker needs, copied on the UI thread
+    struct TileJob {
+        quint64 revision = 0;
+        int width = 0;
+        QVector<QString> lines;
+        QVector<TokenStream> tokens;
+        QVector<QRgb> palette;
+        QRgb plainColor = 0;
+    };
+
+    static QImage rasterize(const TileJob &job);
+
+    void markDirty(int firstLine, int lastLine);
+    void markDirtyFrom(int firstLine);
+    void requestTile(int tile);
+    void scheduleRepaint();
+    void evictTiles();
+    void rebuildPalette();
+    void updateGeometryFromEditor();
+    int firstShownLine() const;
+    void scrollEditorTo(int y);
+
+    QPointer<QPlainTextEdit> m_editor;
+    QPointer<SyntaxHighlighter> m_highlighter;
+    QHash<int, Tile> m_tiles;
+    QVector<QRgb> m_palette;
+    QRgb m_plainColor = 0;
+    int m_lineCount = 0;
+};
+
+#endif // MINIMAP_H
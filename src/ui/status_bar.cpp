@@ -1,4 +1,5 @@
 #include "status_bar.h"
+#include "utilities/frame_scheduler.h"
 #include <QLabel>
 #include <QProgressBar>
 #include <QHBoxLayout>
@@ -112,8 +113,12 @@ void StatusBar::setupConnections()
     m_messageTimer->setSingleShot(true);
     connect(m_messageTimer, &QTimer::timeout, this, &QStatusBar::clearMessage);
     
-    // Memory usage timer
-    connect(m_memoryTimer, &QTimer::timeout, this, &StatusBar::updateMemoryUsage);
+    // Memory usage timer; reading process stats waits for a frame with spare time
+    connect(m_memoryTimer, &QTimer::timeout, this, [this]() {
+        FrameScheduler::instance()->postCoalesced(FrameScheduler::StatusBar, this,
+                                                  QStringLiteral("memory"),
+                                                  [this]() { updateMemoryUsage(); });
+    });
     
     // Clickable encoding label
     connect(m_encodingLabel, &QLabel::linkActivated, this, [this]() {
@@ -167,7 +172,11 @@ void StatusBar::applyTheme(bool darkMode)
 // Public methods
 void StatusBar::setLineCol(int line, int col)
 {
-    m_lineColLabel->setText(QString("Line: %1, Col: %2").arg(line).arg(col));
+    // Cursor moves arrive per keystroke; only the latest position is shown
+    FrameScheduler::instance()->postCoalesced(FrameScheduler::StatusBar, this,
+                                              QStringLiteral("lineCol"), [this, line, col]() {
+        m_lineColLabel->setText(QString("Line: %1, Col: %2").arg(line).arg(col));
+    });
 }
 
 void StatusBar::setEncoding(const QString &encoding)
@@ -182,7 +191,10 @@ void StatusBar::setFileType(const QString &fileType)
 
 void StatusBar::setCursorPosition(int pos)
 {
-    m_cursorPosLabel->setText(QString("Pos: %1").arg(pos));
+    FrameScheduler::instance()->postCoalesced(FrameScheduler::StatusBar, this,
+                                              QStringLiteral("cursorPos"), [this, pos]() {
+        m_cursorPosLabel->setText(QString("Pos: %1").arg(pos));
+    });
 }
 
 void StatusBar::setZoomFactor(int percent)
@@ -199,12 +211,15 @@ void StatusBar::showProgressBar(int maximum)
 
 void StatusBar::updateProgress(int value)
 {
-    m_progressBar->setValue(value);
-    if (value >= m_progressBar->maximum()) {
-        QTimer::singleShot(1000, this, [this]() {
-            m_progressBar->hide();
-        });
-    }
+    FrameScheduler::instance()->postCoalesced(FrameScheduler::StatusBar, this,
+                                              QStringLiteral("progress"), [this, value]() {
+        m_progressBar->setValue(value);
+        if (value >= m_progressBar->maximum()) {
+            QTimer::singleShot(1000, this, [this]() {
+                m_progressBar->hide();
+            });
+        }
+    });
 }
 
 void StatusBar::hideProgressBar()
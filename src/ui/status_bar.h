@@ -1,65 +1,64 @@
-#ifndef MAIN_WINDOW_H
-#define MAIN_WINDOW_H
+#ifndef STATUS_BAR_H
+#define STATUS_BAR_H
 
-#include <QMainWindow>
 #include <QStatusBar>
 #include <QLabel>
 #include <QTimer>
 #include <QProgressBar>
 #include <QFrame>
+#include <QFile>
+#include <QTextStream>
 
-class MainWindow : public QMainWindow {
+class StatusBar : public QStatusBar {
     Q_OBJECT
 
 public:
-    explicit MainWindow(QWidget* parent = nullptr);
-    ~MainWindow() = default;
+    explicit StatusBar(QWidget* parent = nullptr);
+    ~StatusBar() = default;
 
     // Status Bar Component Methods
-    void showStatusMessage(const QString& message, int timeout = 0);
-    void setStatusLineCol(int line, int col);
-    void setStatusEncoding(const QString& encoding);
-    void setStatusFileType(const QString& fileType);
-    void setStatusCursorPosition(int pos);
-    void setStatusZoomFactor(int percent);
-
-    // Progress Bar Control
-    void showStatusProgressBar(int maximum);
-    void updateStatusProgress(int value);
-    void hideStatusProgressBar();
+    void setLineCol(int line, int col);
+    void setEncoding(const QString& encoding);
+    void setFileType(const QString& fileType);
+    void setCursorPosition(int pos);
+    void setZoomFactor(int percent);
+    void showMessage(const QString& message, int timeout = 0);
 
     // Theme Support
-    void applyTheme(const QString& theme);
+    void applyTheme(bool darkMode);
+
+public slots:
+    // Progress Bar Control
+    void showProgressBar(int maximum);
+    void updateProgress(int value);
+    void hideProgressBar();
 
     // Memory Indicator
-    void updateStatusMemoryUsage();
+    void updateMemoryUsage();
 
 signals:
-    void statusEncodingClicked();
-    void statusLineColClicked();
+    void encodingClicked();
+    void rightClicked();
 
-private slots:
-    void clearStatusTemporaryMessage();
+protected:
+    void mousePressEvent(QMouseEvent* event) override;
 
 private:
-    // Main Window Components
-    QMenuBar* m_menuBar;
-    QToolBar* m_toolBar;
-    
     // Status Bar Components
-    QLabel* m_statusLineColLabel;
-    QLabel* m_statusEncodingLabel;
-    QLabel* m_statusFileTypeLabel;
-    QLabel* m_statusCursorPosLabel;
-    QLabel* m_statusZoomLabel;
-    QLabel* m_statusMemoryLabel;
-    QProgressBar* m_statusProgressBar;
-    QTimer* m_statusMessageTimer;
+    QLabel* m_lineColLabel;
+    QLabel* m_encodingLabel;
+    QLabel* m_fileTypeLabel;
+    QLabel* m_cursorPosLabel;
+    QLabel* m_zoomLabel;
+    QLabel* m_memoryLabel;
+    QProgressBar* m_progressBar;
+    QTimer* m_messageTimer;
+    QTimer* m_memoryTimer;
 
     // UI Setup Methods
-    void setupStatusBar();
-    QFrame* createStatusSeparator();
-    void makeLabelsInteractive();
+    void setupWidgets();
+    QFrame* createSeparator();
+    void setupConnections();
 };
 
-#endif // MAIN_WINDOW_H
+#endif // STATUS_BAR_H
@@ -1,5 +1,12 @@
 #include "tab_system.h"
 #include "code_editor.h"
+#include "syntax/highlighter.h"
+#include "syntax/highlight_cache.h"
+#include "utilities/streaming_file_loader.h"
+#include "utilities/compression.h"
+#include "utilities/file_io.h"
+#include "utilities/log_follower.h"
+#include "utilities/settings.h"
 #include <QFileInfo>
 #include <QMessageBox>
 #include <QFileDialog>
@@ -7,8 +14,25 @@
 #include <QMenu>
 #include <QApplication>
 #include <QMimeData>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QScrollBar>
 
-TabSystem::TabSystem(EditorCore* core, QWidget* parent)
+namespace {
+// Files at least this large are decoded on a worker and shown progressively
+const qint64 kStreamingThresholdBytes = 4 * 1024 * 1024;
+
+// Logs are followed as soon as they are opened when follow_log_files is set
+bool followsOnOpen(const QString& filePath)
+{
+    return QFileInfo(filePath).suffix() == QLatin1String("log")
+        && SettingsManager::instance()->get("Core/follow_log_files", false).toBool();
+}
+} // namespace
+
+TabSystem::TabSystem(EditorCore* core, QWidget* parent, bool welcomeTab)
     : QTabWidget(parent), m_core(core)
 {
     // Basic tab configuration
@@ -23,11 +47,17 @@ TabSystem::TabSystem(EditorCore* core, QWidget* parent)
     setupTabBar();
     
     // Add default tab
-    addNewTab("Welcome");
+    if (welcomeTab) {
+        addNewTab("Welcome");
+    }
 }
 
 void TabSystem::setupTabBar()
 {
+    // Dragged tabs take their data along
+    connect(tabBar(), &QTabBar::tabMoved, this, [this](int from, int to) {
+        m_tabData.move(from, to);
+    });
     tabBar()->setContextMenuPolicy(Qt::CustomContextMenu);
     connect(tabBar(), &QTabBar::customContextMenuRequested, [this](const QPoint& pos) {
         int index = tabBar()->tabAt(pos);
@@ -40,15 +70,32 @@ void TabSystem::setupTabBar()
 int TabSystem::addNewTab(const QString& title, const QString& content)
 {
     CodeEditor* editor = createEditor();
-    editor->setPlainText(content);
+
+    // Large files are lexed on the worker pool instead of block by block
+    SyntaxHighlighter* highlighter = editor->document()->findChild<SyntaxHighlighter*>();
+    if (highlighter) {
+        highlighter->loadTextInParallel(content);
+    } else {
+        editor->setPlainText(content);
+    }
     
     int index = addTab(editor, title);
     setCurrentIndex(index);
-    m_tabData.insert(index, {QString(), false});
+    m_tabData[index] = {QString(), false};
     
     return index;
 }
 
+int TabSystem::addExternalEditor(CodeEditor* editor, const QString& title)
+{
+    setupTabConnections(editor);
+    int index = addTab(editor, title);
+    setCurrentIndex(index);
+    m_tabData[index].external = true;
+
+    return index;
+}
+
 bool TabSystem::loadFileToTab(const QString& filePath)
 {
     int existingTab = findTabByPath(filePath);
@@ -56,6 +103,12 @@ bool TabSystem::loadFileToTab(const QString& filePath)
         setCurrentIndex(existingTab);
         return true;
     }
+
+    // Compressed files count by their decompressed size; unknown sizes (xz) stream
+    const qint64 contentSize = Compression::contentSize(filePath);
+    if (contentSize >= kStreamingThresholdBytes || (contentSize < 0 && QFileInfo(filePath).isReadable())) {
+        return streamFileToTab(filePath);
+    }
     
     QString content;
     if (!m_core->loadFile(filePath, content)) {
@@ -63,14 +116,195 @@ bool TabSystem::loadFileToTab(const QString& filePath)
         return false;
     }
     
+    // Preloads tokens persisted for frequently opened files
+    HighlightCache::instance()->fileOpened(filePath);
+
     int index = addNewTab(QFileInfo(filePath).fileName(), content);
     m_tabData[index].filePath = filePath;
+    // Saves, including Save All, write the file back in the encoding it was read in
+    m_tabData[index].encoding = m_core->currentEncoding();
+    // Sampled right after the read; follow mode picks up from here
+    m_tabData[index].loadedBytes = QFileInfo(filePath).size();
     updateTabTitle(index);
+    if (followsOnOpen(filePath)) {
+        setTabFollowing(index, true);
+    }
     
     emit fileOpened(filePath);
     return true;
 }
 
+bool TabSystem::streamFileToTab(const QString& filePath)
+{
+    // Preloads tokens persisted for frequently opened files
+    HighlightCache::instance()->fileOpened(filePath);
+
+    int index = addNewTab(QFileInfo(filePath).fileName());
+    CodeEditor* editor = qobject_cast<CodeEditor*>(widget(index));
+    m_tabData[index].filePath = filePath;
+    updateTabTitle(index);
+
+    // Loaded text is not an undoable edit; the undo history starts once loading is done
+    editor->document()->setUndoRedoEnabled(false);
+
+    // Owned by the editor, so closing the tab also stops the load
+    auto* loader = new StreamingFileLoader(filePath, editor);
+    m_tabData[index].loader = loader;
+
+    connect(loader, &StreamingFileLoader::started, this,
+            [this, editor, filePath](const QString& encoding, qint64 totalBytes) {
+        const int index = indexOf(editor);
+        if (index >= 0) {
+            m_tabData[index].encoding = encoding;
+            m_tabData[index].loadedBytes = totalBytes;
+        }
+        emit loadStarted(filePath, 100);
+    });
+    connect(loader, &StreamingFileLoader::chunkDecoded, editor,
+            [this, editor, loader, filePath](const QString& text, bool first) {
+        appendLoadedChunk(editor, text, first);
+        loader->chunkConsumed();
+        if (first) {
+            emit fileOpened(filePath);
+        }
+    });
+    connect(loader, &StreamingFileLoader::progress, this, [this](qint64 done, qint64 total) {
+        emit loadProgress(total > 0 ? int(done * 100 / total) : 100);
+    });
+    connect(loader, &StreamingFileLoader::finished, editor,
+            [this, editor, loader, filePath](bool success) {
+        const int index = indexOf(editor);
+        if (index < 0) return; // Closed while the last chunk was queued
+
+        editor->document()->setUndoRedoEnabled(true);
+        m_tabData[index].loader.clear();
+        loader->deleteLater();
+        emit loadFinished(filePath, success);
+
+        if (!success) {
+            closeTab(index);
+            QMessageBox::warning(this, tr("Error"), tr("Failed to load file"));
+            return;
+        }
+        SyntaxHighlighter* highlighter = editor->document()->findChild<SyntaxHighlighter*>();
+        if (highlighter) {
+            highlighter->finishStreamingLoad();
+        }
+        if (followsOnOpen(filePath)) {
+            setTabFollowing(index, true);
+        }
+    });
+
+    loader->start();
+    return true;
+}
+
+void TabSystem::appendLoadedChunk(CodeEditor* editor, const QString& text, bool first)
+{
+    m_appendingChunk = true;
+    if (first) {
+        // The first screen, highlighted right away
+        SyntaxHighlighter* highlighter = editor->document()->findChild<SyntaxHighlighter*>();
+        if (highlighter) {
+            highlighter->beginStreamingLoad(text);
+        } else {
+            editor->setPlainText(text);
+        }
+    } else {
+        // A separate cursor, so the user's cursor and edits near the top stay put
+        QTextCursor cursor(editor->document());
+        cursor.movePosition(QTextCursor::End);
+        cursor.insertText(text);
+    }
+    m_appendingChunk = false;
+}
+
+bool TabSystem::setTabFollowing(int index, bool follow)
+{
+    if (index < 0 || index >= m_tabData.size()) return false;
+
+    CodeEditor* editor = qobject_cast<CodeEditor*>(widget(index));
+    if (!follow) {
+        if (m_tabData[index].follower) {
+            m_tabData[index].follower->stop();
+            m_tabData[index].follower->deleteLater();
+            m_tabData[index].follower.clear();
+            if (editor) {
+                editor->document()->setUndoRedoEnabled(true);
+            }
+        }
+        return true;
+    }
+    // Untitled tabs have nothing to follow; loading tabs are not complete yet
+    if (!editor || m_tabData[index].filePath.isEmpty() || m_tabData[index].loader) return false;
+    if (m_tabData[index].follower) return true;
+
+    // Appends must not be undoable, and Qt only keeps them off the undo stack
+    // with undo disabled, which also clears the stack: never without asking
+    QTextDocument* document = editor->document();
+    if (document->availableUndoSteps() > 0 || document->availableRedoSteps() > 0) {
+        const QMessageBox::StandardButton reply = QMessageBox::question(
+            this, tr("Follow File"),
+            tr("Following %1 clears its undo history, and edits made while following "
+               "cannot be undone. Follow anyway?").arg(QFileInfo(m_tabData[index].filePath).fileName()));
+        if (reply != QMessageBox::Yes) return false;
+    }
+
+    // Owned by the editor, so closing the tab also stops following
+    auto* follower = new LogFollower(m_tabData[index].filePath, m_tabData[index].encoding, editor);
+    connect(follower, &LogFollower::appended, editor, [this, editor](const QString& text) {
+        appendFollowedText(editor, text);
+    });
+    connect(follower, &LogFollower::restarted, editor, [this, editor]() {
+        const int index = indexOf(editor);
+        if (index < 0) return;
+
+        if (m_tabData[index].isModified) {
+            // Replacing the text would throw the edits away
+            setTabFollowing(index, false);
+            QMessageBox::warning(this, tr("Follow File"),
+                                 tr("%1 was truncated or replaced. Following stopped to keep your changes.")
+                                     .arg(QFileInfo(m_tabData[index].filePath).fileName()));
+            return;
+        }
+        // A new file: its text replaces the old instead of being appended to it
+        m_appendingChunk = true;
+        editor->setPlainText(QString());
+        m_appendingChunk = false;
+    });
+
+    // Undo stays off while following; the history starts over once it stops
+    document->setUndoRedoEnabled(false);
+    m_tabData[index].follower = follower;
+    if (!follower->start(m_tabData[index].loadedBytes)) {
+        m_tabData[index].follower.clear();
+        follower->deleteLater();
+        document->setUndoRedoEnabled(true);
+        return false;
+    }
+    return true;
+}
+
+bool TabSystem::isTabFollowing(int index) const
+{
+    return index >= 0 && index < m_tabData.size() && m_tabData[index].follower;
+}
+
+void TabSystem::appendFollowedText(CodeEditor* editor, const QString& text)
+{
+    // Scrolls along only when the end was in view, so reading further up is not interrupted
+    QScrollBar* scrollBar = editor->verticalScrollBar();
+    const bool atEnd = scrollBar->value() >= scrollBar->maximum();
+
+    // Appended at the end like a streamed chunk, so earlier blocks keep their
+    // highlighting; undo is off while following (see setTabFollowing)
+    appendLoadedChunk(editor, text, false);
+
+    if (atEnd) {
+        scrollBar->setValue(scrollBar->maximum());
+    }
+}
+
 bool TabSystem::saveCurrentTab()
 {
     int index = currentIndex();
@@ -99,6 +333,12 @@ bool TabSystem::saveTabContent(int index)
 {
     CodeEditor* editor = qobject_cast<CodeEditor*>(widget(index));
     if (!editor) return false;
+
+    // Saving now would truncate the file to the part loaded so far
+    if (m_tabData[index].loader) {
+        QMessageBox::information(this, tr("Loading"), tr("The file is still loading."));
+        return false;
+    }
     
     if (m_core->saveFile(m_tabData[index].filePath, editor->toPlainText())) {
         setTabModified(index, false);
@@ -110,6 +350,53 @@ bool TabSystem::saveTabContent(int index)
     return false;
 }
 
+void TabSystem::saveAllTabs()
+{
+    struct Pending {
+        QPointer<CodeEditor> editor;
+        int revision;
+    };
+    QVector<FileIO::SaveRequest> requests;
+    QVector<Pending> pending;
+    const bool backup = SettingsManager::instance()->get("Core/backup_before_save", true).toBool();
+
+    for (int i = 0; i < count(); ++i) {
+        const TabData& data = m_tabData[i];
+        CodeEditor* editor = qobject_cast<CodeEditor*>(widget(i));
+        // Untitled tabs need Save As; loading tabs would be truncated
+        if (!editor || !data.isModified || data.filePath.isEmpty() || data.loader) continue;
+
+        requests.append({data.filePath, editor->toPlainText(),
+                         data.encoding.isEmpty() ? QStringLiteral("UTF-8") : data.encoding, backup});
+        pending.append({editor, editor->document()->revision()});
+    }
+    if (requests.isEmpty()) return;
+
+    auto* watcher = new QFutureWatcher<QVector<WritePipeline::Result>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, pending]() {
+        const QVector<WritePipeline::Result> results = watcher->result();
+        watcher->deleteLater();
+
+        QStringList failed;
+        for (int i = 0; i < results.size(); ++i) {
+            if (!results[i].success) {
+                failed << QString("%1: %2").arg(results[i].filePath, results[i].error);
+                continue;
+            }
+            const int index = pending[i].editor ? indexOf(pending[i].editor) : -1;
+            // Edits made while saving keep the tab modified
+            if (index >= 0 && pending[i].editor->document()->revision() == pending[i].revision) {
+                setTabModified(index, false);
+            }
+            emit fileSaved(results[i].filePath);
+        }
+        if (!failed.isEmpty()) {
+            QMessageBox::warning(this, tr("Error"), tr("Failed to save files:\n%1").arg(failed.join('\n')));
+        }
+    });
+    watcher->setFuture(FileIO::writeTextFiles(requests));
+}
+
 void TabSystem::closeTab(int index)
 {
     if (index < 0 || index >= count()) return;
@@ -128,9 +415,29 @@ void TabSystem::closeTab(int index)
     }
     
     QWidget* tabWidget = widget(index);
+    CodeEditor* editor = qobject_cast<CodeEditor*>(tabWidget);
+    const bool loading = m_tabData[index].loader;
+    if (loading) {
+        // Stops the worker now; the loader itself goes with the editor
+        m_tabData[index].loader->cancel();
+        emit loadFinished(m_tabData[index].filePath, false);
+    }
+    if (m_tabData[index].follower) {
+        m_tabData[index].follower->stop();
+    }
+    if (editor && !loading && !m_tabData[index].filePath.isEmpty()) {
+        SyntaxHighlighter* highlighter = editor->document()->findChild<SyntaxHighlighter*>();
+        if (highlighter) {
+            highlighter->persistTokens(m_tabData[index].filePath);
+        }
+    }
+
+    // The owner of an external editor keeps using it
+    const bool external = m_tabData[index].external;
     removeTab(index);
-    tabWidget->deleteLater();
-    m_tabData.removeAt(index);
+    if (!external) {
+        tabWidget->deleteLater();
+    }
 }
 
 void TabSystem::closeAllTabs()
@@ -164,6 +471,9 @@ void TabSystem::setupTabConnections(CodeEditor* editor)
 
 void TabSystem::onEditorContentChanged()
 {
+    // Text arriving from a streaming load is not a modification
+    if (m_appendingChunk) return;
+
     int index = currentIndex();
     if (index >= 0) {
         setTabModified(index, true);
@@ -201,12 +511,15 @@ int TabSystem::findTabByPath(const QString& path) const
 
 void TabSystem::tabInserted(int index)
 {
+    // Kept here so every tab has its data, however it was added
+    m_tabData.insert(index, TabData{QString(), false});
     QTabWidget::tabInserted(index);
     emit tabCountChanged(count());
 }
 
 void TabSystem::tabRemoved(int index)
 {
+    m_tabData.removeAt(index);
     QTabWidget::tabRemoved(index);
     emit tabCountChanged(count());
 }
@@ -237,6 +550,12 @@ void TabSystem::contextMenuEvent(QContextMenuEvent* event)
         menu.addAction(tr("Close Tab"), [this, index]() { closeTab(index); });
         menu.addAction(tr("Close Other Tabs"), [this, index]() { closeOtherTabs(index); });
         menu.addAction(tr("Save Tab"), [this, index]() { saveTabContent(index); });
+        QAction* follow = menu.addAction(tr("Follow File"), [this, index](bool checked) {
+            setTabFollowing(index, checked);
+        });
+        follow->setCheckable(true);
+        follow->setChecked(isTabFollowing(index));
+        follow->setEnabled(!m_tabData[index].filePath.isEmpty() && !m_tabData[index].loader);
         menu.addSeparator();
         menu.addAction(tr("Split Horizontally"), [this]() { splitHorizontally(); });
         menu.addAction(tr("Split Vertically"), [this]() { splitVertically(); });
@@ -6,22 +6,29 @@
 #include <QFileInfo>
 #include <QVector>
 #include <QPoint>
+#include <QPointer>
 #include <QDragEnterEvent>
 #include <QDropEvent>
 #include <QContextMenuEvent>
 #include "editor_core.h"
 
 class CodeEditor; // Forward declaration
+class StreamingFileLoader;
+class LogFollower;
 
 class TabSystem : public QTabWidget {
     Q_OBJECT
 
 public:
-    explicit TabSystem(EditorCore* core, QWidget* parent = nullptr);
+    // A hosting window that brings its own first editor passes welcomeTab = false
+    explicit TabSystem(EditorCore* core, QWidget* parent = nullptr, bool welcomeTab = true);
     ~TabSystem() = default;
 
     // Tab management
     int addNewTab(const QString& title = "Untitled", const QString& content = "");
+    // An editor owned by the caller: tracked like any tab, but closing the
+    // tab only removes it and never deletes the editor
+    int addExternalEditor(CodeEditor* editor, const QString& title);
     bool loadFileToTab(const QString& filePath);
     bool saveCurrentTab();
     bool saveTabAs(int index);
@@ -39,6 +46,13 @@ public:
     void setTabModified(int index, bool modified);
     void updateTabTitle(int index);
 
+    // Follow mode: text appended to the file shows up at the end of the tab.
+    // Appends are decoded in the tab's encoding and are never undoable. Undo
+    // is off while following, and starting clears the undo history, so a
+    // tab that has any asks first.
+    bool setTabFollowing(int index, bool follow);
+    bool isTabFollowing(int index) const;
+
     // Split view
     void splitHorizontally();
     void splitVertically();
@@ -51,6 +65,8 @@ public slots:
     void onEditorContentChanged();
     void updateCursorPosition();
     void showTabPreview(int index);
+    // Writes every modified tab in one background submission
+    void saveAllTabs();
 
 signals:
     void fileOpened(const QString& path);
@@ -59,6 +75,12 @@ signals:
     void tabContextMenuRequested(int index, const QPoint& pos);
     void splitViewRequested(Qt::Orientation orientation);
 
+    // Progressive loads of large files, for StatusBar::showProgressBar,
+    // updateProgress and hideProgressBar
+    void loadStarted(const QString& path, int maximum);
+    void loadProgress(int value);
+    void loadFinished(const QString& path, bool success);
+
 protected:
     void tabInserted(int index) override;
     void tabRemoved(int index) override;
@@ -74,16 +96,25 @@ private:
     void setupTabConnections(CodeEditor* editor);
     QString generateTabTitle(const QString& filePath) const;
     void setupTabBar();
+    bool streamFileToTab(const QString& filePath);
+    void appendLoadedChunk(CodeEditor* editor, const QString& text, bool first);
+    void appendFollowedText(CodeEditor* editor, const QString& text);
     
     // Tab data management
     struct TabData {
         QString filePath;
         bool isModified;
+        QString encoding;                     // As detected on load; UTF-8 if unknown
+        QPointer<StreamingFileLoader> loader; // Set while the file is still loading
+        qint64 loadedBytes = 0;               // Size of the file the text was read from
+        QPointer<LogFollower> follower;       // Set while in follow mode
+        bool external = false;                // Added by addExternalEditor()
     };
     
     EditorCore* m_core;
     QVector<TabData> m_tabData;
     QPoint m_dragStartPos;
+    bool m_appendingChunk = false;
 };
 
 #endif // TAB_SYSTEM_H
@@ -0,0 +1,490 @@
+#include "batch_converter.h"
+#include "bijoy_converter.h"
+#include "directory_walker.h"
+#include "encoding_detector.h"
+#include "file_classifier.h"
+#include "file_identity.h"
+#include "file_io.h"
+#include "utf8.h"
+#include "write_pipeline.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QSet>
+#include <QTextCodec>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QtConcurrent>
+#include <QDebug>
+#include <deque>
+#include <memory>
+
+namespace {
+// Reads overlap on the disk, but more than a few only add seeks
+const int kDefaultReaders = 4;
+// Each writer submits whole batches, which WritePipeline spreads further
+const int kDefaultWriters = 2;
+const int kWriteBatch = 32;
+// Paths are small, so the scanner may run further ahead than the contents
+const int kJobQueueFactor = 16;
+// Bytes classified as text or binary when there is no BOM
+const qint64 kBinaryProbeBytes = 8000;
+const qint64 kProgressIntervalMs = 250;
+
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(int capacity) : m_capacity(qMax(1, capacity)) {}
+
+    // Blocks while full; false once the queue was aborted
+    bool push(T &&item)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (int(m_items.size()) >= m_capacity && !m_aborted) {
+            m_notFull.wait(&m_mutex);
+        }
+        if (m_aborted) {
+            return false;
+        }
+        m_items.push_back(std::move(item));
+        m_notEmpty.wakeOne();
+        return true;
+    }
+
+    // Waits for the first item only; empty once closed and drained, or aborted
+    QVector<T> popBatch(int max)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_items.empty() && !m_closed && !m_aborted) {
+            m_notEmpty.wait(&m_mutex);
+        }
+        QVector<T> batch;
+        while (!m_aborted && !m_items.empty() && batch.size() < max) {
+            batch.append(std::move(m_items.front()));
+            m_items.pop_front();
+        }
+        m_notFull.wakeAll();
+        return batch;
+    }
+
+    bool pop(T &item)
+    {
+        QVector<T> batch = popBatch(1);
+        if (batch.isEmpty()) {
+            return false;
+        }
+        item = std::move(batch.first());
+        return true;
+    }
+
+    // Nothing more will be pushed
+    void close()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+    }
+
+    // Drops what is queued and releases every waiter
+    void abort()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_aborted = true;
+        m_items.clear();
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+private:
+    const int m_capacity;
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    std::deque<T> m_items;
+    bool m_closed = false;
+    bool m_aborted = false;
+};
+
+struct Job {
+    QString sourcePath;
+    QString destPath;
+};
+
+struct Loaded {
+    QString sourcePath;
+    QString destPath;
+    QByteArray data;
+    QString encoding;
+    int bomLength = 0;
+};
+
+struct Encoded {
+    QString sourcePath;
+    WritePipeline::Request request;
+};
+
+bool isSameEncoding(const QString &a, const QString &b)
+{
+    return a.compare(b, Qt::CaseInsensitive) == 0;
+}
+
+bool decode(const Loaded &loaded, QString &content)
+{
+    const char *data = loaded.data.constData() + loaded.bomLength;
+    const qint64 size = loaded.data.size() - loaded.bomLength;
+
+    if (loaded.encoding == QLatin1String("Bijoy")) {
+        content = BijoyConverter::convert(QByteArray::fromRawData(data, int(size)));
+        return true;
+    }
+    if (loaded.encoding == QLatin1String("UTF-8")) {
+        return Utf8::decode(data, size, content);
+    }
+    QTextCodec *codec = EncodingDetector::codecFor(loaded.encoding);
+    if (!codec) {
+        return false;
+    }
+    content = codec->toUnicode(data, int(size));
+    return true;
+}
+
+class Pipeline
+{
+public:
+    Pipeline(const QString &root, const BatchConverter::Options &options,
+             const std::atomic<bool> *cancelled, const BatchConverter::ProgressCallback &progress)
+        : m_options(options)
+        , m_cancelled(cancelled)
+        , m_progress(progress)
+        , m_jobs(options.queueCapacity * kJobQueueFactor)
+        , m_loaded(options.queueCapacity)
+        , m_encoded(options.queueCapacity)
+        , m_durability(WritePipeline::defaultDurability())
+    {
+        m_root = QDir::cleanPath(QFileInfo(root).absoluteFilePath());
+        if (!options.outputDirectory.isEmpty()) {
+            const QString output = QDir::cleanPath(QFileInfo(options.outputDirectory).absoluteFilePath());
+            if (output != m_root) {
+                m_outputRoot = output;
+            }
+        }
+    }
+
+    BatchConverter::Report run()
+    {
+        m_clock.start();
+        if (!QFileInfo(m_root).isDir()) {
+            qWarning() << "Directory does not exist:" << m_root;
+            fail(m_root, QStringLiteral("Not a directory"));
+            return m_report;
+        }
+
+        const int readers = m_options.readers > 0 ? m_options.readers : kDefaultReaders;
+        const int converters = m_options.converters > 0 ? m_options.converters : QThread::idealThreadCount();
+        const int writers = m_options.writers > 0 ? m_options.writers : kDefaultWriters;
+
+        launch(m_scanPool, 1, [this]() { scan(); }, [this]() { m_jobs.close(); });
+        launch(m_readPool, readers, [this]() { read(); }, [this]() { m_loaded.close(); });
+        launch(m_convertPool, converters, [this]() { convert(); }, [this]() { m_encoded.close(); });
+        launch(m_writePool, writers, [this]() { write(); }, []() {});
+        for (QFuture<void> &future : m_futures) {
+            future.waitForFinished();
+        }
+
+        QMutexLocker locker(&m_mutex);
+        m_report.elapsedMs = m_clock.elapsed();
+        m_report.cancelled = m_stopped;
+        return m_report;
+    }
+
+private:
+    bool isInPlace() const { return m_outputRoot.isEmpty(); }
+
+    // A stage's workers; the last one to finish tells the next stage
+    void launch(QThreadPool &pool, int workers, const std::function<void()> &body,
+                const std::function<void()> &done)
+    {
+        pool.setMaxThreadCount(workers);
+        auto remaining = std::make_shared<std::atomic<int>>(workers);
+        for (int i = 0; i < workers; ++i) {
+            m_futures.append(QtConcurrent::run(&pool, [body, done, remaining]() {
+                body();
+                if (remaining->fetch_sub(1) == 1) {
+                    done();
+                }
+            }));
+        }
+    }
+
+    bool stopping()
+    {
+        if (m_stopped) {
+            return true;
+        }
+        if (m_cancelled && m_cancelled->load(std::memory_order_relaxed)) {
+            m_stopped = true;
+            m_jobs.abort();
+            m_loaded.abort();
+            m_encoded.abort();
+            return true;
+        }
+        return false;
+    }
+
+    QString destinationFor(const QString &sourcePath) const
+    {
+        return isInPlace() ? sourcePath : m_outputRoot + sourcePath.mid(m_root.size());
+    }
+
+    // Applies change to the counters and reports progress when it is due
+    void update(const std::function<void(BatchConverter::Report &)> &change)
+    {
+        BatchConverter::Report snapshot;
+        {
+            QMutexLocker locker(&m_mutex);
+            change(m_report);
+            if (!m_progress || m_clock.elapsed() - m_lastProgressMs < kProgressIntervalMs) {
+                return;
+            }
+            m_lastProgressMs = m_clock.elapsed();
+            m_report.elapsedMs = m_lastProgressMs;
+            snapshot = m_report;
+        }
+        m_progress(snapshot);
+    }
+
+    void fail(const QString &path, const QString &error)
+    {
+        qWarning() << "Conversion failed for" << path << ":" << error;
+        update([&](BatchConverter::Report &report) { report.failures.append({path, error}); });
+    }
+
+    void scan()
+    {
+        DirectoryWalker::Options walk;
+        walk.nameFilters = m_options.nameFilters;
+        walk.respectIgnoreFiles = m_options.respectIgnoreFiles;
+        const QString outputPrefix = m_outputRoot + QLatin1Char('/');
+
+        const bool completed = DirectoryWalker::walk(m_root, walk, [&](QVector<DirectoryWalker::Entry> &&batch) {
+            int accepted = 0;
+            for (const DirectoryWalker::Entry &entry : batch) {
+                // An output directory inside the tree holds our own results
+                if (!isInPlace() && entry.path.startsWith(outputPrefix)) {
+                    continue;
+                }
+                if (stopping() || !m_jobs.push({entry.path, destinationFor(entry.path)})) {
+                    break;
+                }
+                ++accepted;
+            }
+            update([accepted](BatchConverter::Report &report) { report.scanned += accepted; });
+        }, &m_stopped);
+        if (!completed && !stopping()) {
+            fail(m_root, QStringLiteral("Failed to read directory"));
+        }
+    }
+
+    void read()
+    {
+        Job job;
+        while (!stopping() && m_jobs.pop(job)) {
+            QFile file(job.sourcePath);
+            if (!file.open(QIODevice::ReadOnly)) {
+                fail(job.sourcePath, file.errorString());
+                continue;
+            }
+            Loaded loaded;
+            loaded.sourcePath = job.sourcePath;
+            loaded.destPath = job.destPath;
+            loaded.data = file.readAll();
+            if (file.error() != QFileDevice::NoError) {
+                fail(job.sourcePath, file.errorString());
+                continue;
+            }
+            const FileIdentity identity = FileIdentity::of(file.handle());
+            file.close();
+
+            const char *data = loaded.data.constData();
+            const qint64 size = loaded.data.size();
+            update([size](BatchConverter::Report &report) { report.bytesRead += size; });
+
+            loaded.bomLength = EncodingDetector::byteOrderMark(data, size, loaded.encoding);
+            if (loaded.bomLength == 0) {
+                if (FileClassifier::scan(data, qMin(size, kBinaryProbeBytes)).binary) {
+                    update([](BatchConverter::Report &report) { ++report.skipped; });
+                    continue;
+                }
+                loaded.encoding = EncodingDetector::instance()->detect(identity, data, size).encoding;
+            }
+            if (isInPlace() && isSameEncoding(loaded.encoding, m_options.targetEncoding)) {
+                update([](BatchConverter::Report &report) { ++report.skipped; });
+                continue;
+            }
+            if (!m_loaded.push(std::move(loaded))) {
+                break;
+            }
+        }
+    }
+
+    void convert()
+    {
+        Loaded loaded;
+        while (!stopping() && m_loaded.pop(loaded)) {
+            Encoded encoded;
+            encoded.sourcePath = loaded.sourcePath;
+            encoded.request.filePath = loaded.destPath;
+            encoded.request.backup = m_options.backup && isInPlace();
+
+            if (isSameEncoding(loaded.encoding, m_options.targetEncoding)) {
+                // Mirrored into the output directory unchanged
+                encoded.request.data = loaded.data;
+            } else {
+                QString content;
+                if (!decode(loaded, content)) {
+                    fail(loaded.sourcePath, QStringLiteral("Not valid %1").arg(loaded.encoding));
+                    continue;
+                }
+#ifdef Q_OS_WIN
+                // encodeText() writes \n as \r\n; don't double line ends the file already has
+                content.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+#endif
+                encoded.request.data = FileIO::encodeText(content, m_options.targetEncoding);
+            }
+            loaded.data.clear();
+
+            if (!m_encoded.push(std::move(encoded))) {
+                break;
+            }
+        }
+    }
+
+    void write()
+    {
+        QSet<QString> createdDirectories;
+        while (!stopping()) {
+            const QVector<Encoded> batch = m_encoded.popBatch(kWriteBatch);
+            if (batch.isEmpty()) {
+                break;
+            }
+
+            QVector<WritePipeline::Request> requests;
+            requests.reserve(batch.size());
+            for (const Encoded &encoded : batch) {
+                if (!isInPlace()) {
+                    const QString directory = QFileInfo(encoded.request.filePath).path();
+                    if (!createdDirectories.contains(directory)) {
+                        QDir().mkpath(directory);
+                        createdDirectories.insert(directory);
+                    }
+                }
+                requests.append(encoded.request);
+            }
+
+            // One submission per batch, so io_uring builds see all of it at once
+            const QVector<WritePipeline::Result> results =
+                WritePipeline::instance()->submit(requests, m_durability).result();
+            qint64 written = 0;
+            int converted = 0;
+            for (int i = 0; i < results.size(); ++i) {
+                if (results[i].success) {
+                    written += requests[i].data.size();
+                    ++converted;
+                } else {
+                    fail(batch[i].sourcePath, results[i].error);
+                }
+            }
+            update([written, converted](BatchConverter::Report &report) {
+                report.bytesWritten += written;
+                report.converted += converted;
+            });
+        }
+    }
+
+    const BatchConverter::Options m_options;
+    const std::atomic<bool> *m_cancelled;
+    const BatchConverter::ProgressCallback m_progress;
+    QString m_root;
+    QString m_outputRoot;
+
+    BoundedQueue<Job> m_jobs;
+    BoundedQueue<Loaded> m_loaded;
+    BoundedQueue<Encoded> m_encoded;
+    const WritePipeline::Durability m_durability;
+
+    // One pool per stage, so a stage never waits for threads another holds
+    QThreadPool m_scanPool;
+    QThreadPool m_readPool;
+    QThreadPool m_convertPool;
+    QThreadPool m_writePool;
+    QVector<QFuture<void>> m_futures;
+    std::atomic<bool> m_stopped{false};
+
+    QMutex m_mutex;
+    BatchConverter::Report m_report;
+    QElapsedTimer m_clock;
+    qint64 m_lastProgressMs = 0;
+};
+} // namespace
+
+double BatchConverter::Report::filesPerSecond() const
+{
+    return elapsedMs > 0 ? converted * 1000.0 / elapsedMs : 0.0;
+}
+
+double BatchConverter::Report::megabytesPerSecond() const
+{
+    return elapsedMs > 0 ? bytesRead / (1024.0 * 1024.0) * 1000.0 / elapsedMs : 0.0;
+}
+
+BatchConverter::BatchConverter(QObject *parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<BatchConverter::Report>();
+}
+
+BatchConverter::~BatchConverter()
+{
+    cancel();
+    m_future.waitForFinished();
+}
+
+void BatchConverter::start(const QString &root, const Options &options)
+{
+    if (isRunning()) {
+        return;
+    }
+    m_cancelled = false;
+    m_future = QtConcurrent::run([this, root, options]() {
+        const Report report = run(root, options, &m_cancelled, [this](const Report &snapshot) {
+            emit progress(snapshot);
+        });
+        emit finished(report);
+    });
+}
+
+void BatchConverter::cancel()
+{
+    m_cancelled = true;
+}
+
+bool BatchConverter::isRunning() const
+{
+    return m_future.isRunning();
+}
+
+BatchConverter::Report BatchConverter::run(const QString &root, const Options &options,
+                                           const std::atomic<bool> *cancelled,
+                                           const ProgressCallback &progress)
+{
+    Pipeline pipeline(root, options, cancelled, progress);
+    const Report report = pipeline.run();
+    qInfo() << "Converted" << report.converted << "of" << report.scanned << "files in" << report.elapsedMs
+            << "ms:" << report.skipped << "skipped," << report.failures.size() << "failed,"
+            << QString::number(report.megabytesPerSecond(), 'f', 1) << "MB/s";
+    return report;
+}
@@ -0,0 +1,90 @@
+#ifndef BATCH_CONVERTER_H
+#define BATCH_CONVERTER_H
+
+#include <QFuture>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+/**
+ * @brief Converts every text file under a directory to one encoding
+ *
+ * The work is a pipeline of four stages: scanning (DirectoryWalker),
+ * reading and detecting, decoding and re-encoding (Bijoy through
+ * BijoyConverter, everything else through its codec), and atomic writes
+ * through WritePipeline, a batch at a time. Each stage has its own thread
+ * pool and hands items on through a bounded queue, so reads keep the disk
+ * busy while conversions keep the cores busy, and a slow stage holds back
+ * the ones before it instead of piling file contents up in memory.
+ *
+ * Files already in the target encoding are skipped when converting in
+ * place, and so is anything that looks binary.
+ */
+class BatchConverter : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        QString targetEncoding = "UTF-8";
+        QString outputDirectory;         // Mirror the tree here; empty converts in place
+        QStringList nameFilters;         // As for DirectoryWalker
+        bool respectIgnoreFiles = true;
+        bool backup = false;             // In place only: keep the original as .bak
+        int readers = 0;                 // Per-stage threads, 0 for the defaults
+        int converters = 0;
+        int writers = 0;
+        int queueCapacity = 64;          // Items between two stages
+    };
+
+    struct Failure {
+        QString path;
+        QString error;
+    };
+
+    struct Report {
+        int scanned = 0;
+        int converted = 0;
+        int skipped = 0;
+        qint64 bytesRead = 0;
+        qint64 bytesWritten = 0;
+        qint64 elapsedMs = 0;
+        bool cancelled = false;
+        QVector<Failure> failures;
+
+        double filesPerSecond() const;
+        double megabytesPerSecond() const;  // Of input
+    };
+
+    using ProgressCallback = std::function<void(const Report &report)>;
+
+    explicit BatchConverter(QObject *parent = nullptr);
+    ~BatchConverter();
+
+    void start(const QString &root, const Options &options);
+    void cancel();
+    bool isRunning() const;
+
+    // Blocks until the tree is done; progress is called from worker threads
+    // a few times per second with a snapshot of the counters
+    static Report run(const QString &root, const Options &options,
+                      const std::atomic<bool> *cancelled = nullptr,
+                      const ProgressCallback &progress = ProgressCallback());
+
+signals:
+    // Emitted from worker threads
+    void progress(const BatchConverter::Report &report);
+    void finished(const BatchConverter::Report &report);
+
+private:
+    QFuture<void> m_future;
+    std::atomic<bool> m_cancelled{false};
+};
+
+Q_DECLARE_METATYPE(BatchConverter::Report)
+
+#endif // BATCH_CONVERTER_H
@@ -0,0 +1,465 @@
+#include "bijoy_converter.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QDebug>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+// Source bytes per step when converting a file
+const qint64 kChunkBytes = 1024 * 1024;
+// Flushed even without a syllable boundary, so the carried text stays bounded
+const int kMaxVisualLength = 64 * 1024;
+
+// Stands for reph in the mapped text until reordering puts র্ in place
+const ushort kRephMarker = 0xE000;
+const ushort kHasant = 0x09CD;
+const ushort kZeroWidthJoiner = 0x200D;
+const ushort kSignI = 0x09BF;
+const ushort kSignE = 0x09C7;
+const ushort kSignAi = 0x09C8;
+const ushort kSignAa = 0x09BE;
+const ushort kSignAuLength = 0x09D7;
+const ushort kSignO = 0x09CB;
+const ushort kSignAu = 0x09CC;
+
+struct Mapping {
+    const char *bijoy;    // Windows-1252 bytes as typed with the SutonnyMJ layout
+    const char *unicode;  // UTF-8, in Bijoy (visual) order
+};
+
+// Longer keys win over their prefixes, so conjunct glyphs and the
+// two-glyph forms need no special casing
+const Mapping kMappings[] = {
+    // Independent vowels
+    {"A", "অ"}, {"Av", "আ"}, {"B", "ই"}, {"C", "ঈ"}, {"D", "উ"}, {"E", "ঊ"},
+    {"F", "ঋ"}, {"G", "এ"}, {"H", "ঐ"}, {"I", "ও"}, {"J", "ঔ"},
+    // Consonants
+    {"K", "ক"}, {"L", "খ"}, {"M", "গ"}, {"N", "ঘ"}, {"O", "ঙ"},
+    {"P", "চ"}, {"Q", "ছ"}, {"R", "জ"}, {"S", "ঝ"}, {"T", "ঞ"},
+    {"U", "ট"}, {"V", "ঠ"}, {"W", "ড"}, {"X", "ঢ"}, {"Y", "ণ"},
+    {"Z", "ত"}, {"_", "থ"}, {"`", "দ"}, {"a", "ধ"}, {"b", "ন"},
+    {"c", "প"}, {"d", "ফ"}, {"e", "ব"}, {"f", "ভ"}, {"g", "ম"},
+    {"h", "য"}, {"i", "র"}, {"j", "ল"}, {"k", "শ"}, {"l", "ষ"},
+    {"m", "স"}, {"n", "হ"}, {"o", "ড়"}, {"p", "ঢ়"}, {"q", "য়"},
+    {"r", "ৎ"},
+    // Signs
+    {"s", "ং"}, {"t", "ঃ"}, {"u", "ঁ"}, {"&", "্"},
+    // Vowel signs; ি ে ৈ come before their consonant
+    {"v", "া"}, {"w", "ি"}, {"x", "ী"},
+    {"y", "ু"}, {"z", "ু"}, {"\x93", "ু"}, {"\x96", "ু"},
+    {"~", "ূ"}, {"\x82", "ূ"}, {"\x83", "ূ"},
+    {"\x84", "ৃ"}, {"\x85", "ৃ"},
+    {"\x86", "ে"}, {"\x87", "ে"}, {"\x88", "ৈ"}, {"\x89", "ৈ"},
+    {"\x8A", "ৗ"},
+    // Phala and reph
+    {"\xA8", "্য"}, {"\xAA", "্র"}, {"\xA1", "্ব"}, {"\xA5", "্ম"},
+    {"\xF8", "্ল"}, {"\x9C", "্ন"}, {"\xA9", "\xEE\x80\x80"},
+    {"i\xA8", "র\xE2\x80\x8D্য"}, {"\xAA\xA8", "্র্য"},
+    // Half forms
+    {"\x95", "ঙ্"}, {"\x94", "চ্"}, {"\x9A", "ন্"}, {"\xAF", "স্"},
+    // Conjunct glyphs
+    {"\xB0", "ক্ক"}, {"\xB1", "ক্ট"}, {"\xB3", "ক্ত"}, {"\xB5", "ক্র"},
+    {"\xB6", "ক্ষ"}, {"\xB7", "ক্স"}, {"\xB8", "গু"}, {"\xBB", "গ্ধ"},
+    {"\xBC", "ঙ্ক"}, {"\xBD", "ঙ্গ"}, {"\xBE", "জ্জ"}, {"\xC0", "জ্ঝ"},
+    {"\xC1", "জ্ঞ"}, {"\xC2", "ঞ্চ"}, {"\xC3", "ঞ্ছ"}, {"\xC4", "ঞ্জ"},
+    {"\xC5", "ঞ্ঝ"}, {"\xC6", "ট্ট"}, {"\xC7", "ড্ড"}, {"\xC8", "ণ্ট"},
+    {"\xC9", "ণ্ঠ"}, {"\xCA", "ণ্ড"}, {"\xCB", "ত্ত"}, {"\xCC", "ত্থ"},
+    {"\xCF", "দ্ঘ"}, {"\xD0", "দ্দ"}, {"\xD7", "দ্ধ"}, {"\xD8", "দ্ব"},
+    {"\xD9", "দ্ভ"}, {"\xDC", "দ্ম"},
+    // Punctuation and digits
+    {"|", "।"},
+    {"0", "০"}, {"1", "১"}, {"2", "২"}, {"3", "৩"}, {"4", "৪"},
+    {"5", "৫"}, {"6", "৬"}, {"7", "৭"}, {"8", "৮"}, {"9", "৯"},
+};
+
+// Windows-1252 0x80..0x9F; the rest of the range is Latin-1
+const ushort kWindows1252High[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178
+};
+
+inline ushort fromWindows1252(uchar byte)
+{
+    return byte >= 0x80 && byte < 0xA0 ? kWindows1252High[byte - 0x80] : byte;
+}
+
+// Windows-1252 byte for c, or -1 if it has none
+inline int toWindows1252(ushort c)
+{
+    if (c < 0x80 || (c >= 0xA0 && c <= 0xFF)) {
+        return c;
+    }
+    for (int i = 0; i < 32; ++i) {
+        if (kWindows1252High[i] == c) {
+            return 0x80 + i;
+        }
+    }
+    return -1;
+}
+
+inline bool isConsonant(ushort c)
+{
+    return (c >= 0x0995 && c <= 0x09B9) || c == 0x09CE || c == 0x09DC || c == 0x09DD || c == 0x09DF;
+}
+
+inline bool isPreBaseSign(ushort c)
+{
+    return c == kSignI || c == kSignE || c == kSignAi;
+}
+
+// Vowel signs and modifiers that may sit between a cluster and its reph
+inline bool isPostBaseSign(ushort c)
+{
+    return (c >= 0x0981 && c <= 0x0983) || c == kSignAa || (c >= 0x09C0 && c <= 0x09C4) || c == kSignAuLength;
+}
+
+// Anything outside the Bangla block ends a syllable
+inline bool isSyllableBoundary(ushort c)
+{
+    return (c < 0x0980 || c > 0x09FF) && c != kRephMarker && c != kZeroWidthJoiner;
+}
+
+// End of the consonant cluster starting at i: C, then (্C or ZWJ্C)*
+int clusterEnd(const ushort *text, int size, int i)
+{
+    if (i >= size || !isConsonant(text[i])) {
+        return i;
+    }
+    ++i;
+    while (i < size) {
+        if (i + 1 < size && text[i] == kHasant && isConsonant(text[i + 1])) {
+            i += 2;
+        } else if (i + 2 < size && text[i] == kZeroWidthJoiner && text[i + 1] == kHasant
+                   && isConsonant(text[i + 2])) {
+            i += 3;
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+#ifdef __SSE2__
+// Leading bytes of the 16 at data below '0' other than '&': whitespace and
+// punctuation, which no key starts with
+inline int passthroughPrefix(const uchar *data)
+{
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    // Signed compare, so bytes from 0x80 count as negative and are excluded below
+    const __m128i below = _mm_cmplt_epi8(chunk, _mm_set1_epi8('0'));
+    const __m128i high = _mm_cmplt_epi8(chunk, _mm_setzero_si128());
+    const __m128i hasant = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('&'));
+    const __m128i stop = _mm_or_si128(_mm_andnot_si128(below, _mm_set1_epi8(char(0xFF))),
+                                      _mm_or_si128(high, hasant));
+    const uint mask = uint(_mm_movemask_epi8(stop));
+    return mask ? int(qCountTrailingZeroBits(mask)) : 16;
+}
+#endif
+} // namespace
+
+BijoyConverter::BijoyConverter()
+{
+    trie();
+}
+
+const BijoyConverter::Trie &BijoyConverter::trie()
+{
+    static const Trie compiled = [] {
+        Trie t;
+        Node root;
+        std::fill(std::begin(root.children), std::end(root.children), -1);
+        t.nodes.append(root);
+
+        for (const Mapping &mapping : kMappings) {
+            int node = 0;
+            for (const char *p = mapping.bijoy; *p; ++p) {
+                const uchar byte = uchar(*p);
+                int next = t.nodes[node].children[byte];
+                if (next < 0) {
+                    Node child;
+                    std::fill(std::begin(child.children), std::end(child.children), -1);
+                    next = t.nodes.size();
+                    t.nodes.append(child);
+                    t.nodes[node].children[byte] = next;
+                    t.nodes[node].hasChildren = true;
+                }
+                node = next;
+            }
+            t.nodes[node].value = t.outputs.size();
+            t.outputs.append(QString::fromUtf8(mapping.unicode));
+        }
+
+        for (int byte = 0; byte < 256; ++byte) {
+            t.passthrough[byte] = byte < 0x80 && t.nodes[0].children[byte] < 0;
+        }
+#ifdef __SSE2__
+        // passthroughPrefix() relies on this
+        for (int byte = 0; byte < '0'; ++byte) {
+            Q_ASSERT(t.passthrough[byte] == (byte != '&'));
+        }
+#endif
+        return t;
+    }();
+    return compiled;
+}
+
+void BijoyConverter::reset()
+{
+    m_carry.clear();
+    m_visual.clear();
+}
+
+void BijoyConverter::convert(const char *data, qint64 size, bool final, QString &out)
+{
+    const Trie &t = trie();
+
+    // A match cut off by the previous chunk is redone from its first byte
+    QByteArray joined;
+    if (!m_carry.isEmpty()) {
+        joined = m_carry;
+        joined.append(data, int(size));
+        m_carry.clear();
+        data = joined.constData();
+        size = joined.size();
+    }
+
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    qint64 i = 0;
+    while (i < size) {
+        // Whitespace and punctuation map to themselves
+        const qint64 runStart = i;
+#ifdef __SSE2__
+        while (i + 16 <= size) {
+            const int prefix = passthroughPrefix(bytes + i);
+            i += prefix;
+            if (prefix < 16) {
+                break;
+            }
+        }
+#endif
+        while (i < size && t.passthrough[bytes[i]]) {
+            ++i;
+        }
+        if (i > runStart) {
+            m_visual.append(QLatin1String(data + runStart, int(i - runStart)));
+            if (i >= size) {
+                break;
+            }
+        }
+
+        // Longest key starting at i
+        int node = 0;
+        int best = -1;
+        qint64 bestLength = 0;
+        qint64 k = i;
+        while (k < size) {
+            node = t.nodes[node].children[bytes[k]];
+            if (node < 0) {
+                break;
+            }
+            ++k;
+            if (t.nodes[node].value >= 0) {
+                best = t.nodes[node].value;
+                bestLength = k - i;
+            }
+        }
+        if (!final && k == size && node >= 0 && t.nodes[node].hasChildren) {
+            // The next chunk may extend this match
+            m_carry = QByteArray(data + i, int(size - i));
+            break;
+        }
+
+        if (best >= 0) {
+            m_visual.append(t.outputs[best]);
+            i += bestLength;
+        } else {
+            m_visual.append(QChar(fromWindows1252(bytes[i])));
+            ++i;
+        }
+    }
+
+    // Reorder complete syllables; the last one may continue in the next chunk
+    int complete = m_visual.size();
+    if (!final && m_visual.size() <= kMaxVisualLength) {
+        const ushort *visual = m_visual.utf16();
+        complete = m_visual.size();
+        while (complete > 0 && !isSyllableBoundary(visual[complete - 1])) {
+            --complete;
+        }
+    }
+    if (complete > 0) {
+        out.append(reorder(m_visual.left(complete)));
+        m_visual.remove(0, complete);
+    }
+}
+
+QString BijoyConverter::reorder(const QString &visual)
+{
+    const ushort *text = visual.utf16();
+    const int size = visual.size();
+    const QString reph = QStringLiteral("র্");
+
+    QString result;
+    result.reserve(size + size / 8);
+
+    int i = 0;
+    while (i < size) {
+        const ushort c = text[i];
+
+        if (isPreBaseSign(c)) {
+            // Sign, cluster, optional reph: reph + cluster + sign
+            const int start = i + 1;
+            const int end = clusterEnd(text, size, start);
+            if (end == start) {
+                result.append(QChar(c));
+                ++i;
+                continue;
+            }
+            int next = end;
+            if (next < size && text[next] == kRephMarker) {
+                result.append(reph);
+                ++next;
+            }
+            result.append(reinterpret_cast<const QChar *>(text + start), end - start);
+            if (c == kSignE && next < size && text[next] == kSignAa) {
+                result.append(QChar(kSignO));
+                ++next;
+            } else if (c == kSignE && next < size && text[next] == kSignAuLength) {
+                result.append(QChar(kSignAu));
+                ++next;
+            } else {
+                result.append(QChar(c));
+            }
+            i = next;
+            continue;
+        }
+
+        if (isConsonant(c)) {
+            // Cluster, post-base signs, reph: reph + cluster + signs
+            const int end = clusterEnd(text, size, i);
+            int signs = end;
+            while (signs < size && isPostBaseSign(text[signs])) {
+                ++signs;
+            }
+            if (signs < size && text[signs] == kRephMarker) {
+                result.append(reph);
+                result.append(reinterpret_cast<const QChar *>(text + i), signs - i);
+                i = signs + 1;
+            } else {
+                result.append(reinterpret_cast<const QChar *>(text + i), end - i);
+                i = end;
+            }
+            continue;
+        }
+
+        if (c == kRephMarker) {
+            // Reph with nothing to sit on
+            result.append(reph);
+        } else {
+            result.append(QChar(c));
+        }
+        ++i;
+    }
+    return result;
+}
+
+QString BijoyConverter::convert(const QByteArray &bijoy)
+{
+    BijoyConverter converter;
+    QString result;
+    converter.convert(bijoy.constData(), bijoy.size(), true, result);
+    return result;
+}
+
+QString BijoyConverter::fromDecodedText(const QString &text)
+{
+    BijoyConverter converter;
+    QString result;
+    result.reserve(text.size());
+
+    // Back to the Bijoy bytes; characters Windows-1252 cannot hold are
+    // already Unicode and are kept as they are
+    QByteArray bytes;
+    bytes.reserve(text.size());
+    const ushort *chars = text.utf16();
+    for (int i = 0; i < text.size(); ++i) {
+        const int byte = toWindows1252(chars[i]);
+        if (byte >= 0) {
+            bytes.append(char(byte));
+            continue;
+        }
+        converter.convert(bytes.constData(), bytes.size(), true, result);
+        bytes.clear();
+        result.append(QChar(chars[i]));
+    }
+    converter.convert(bytes.constData(), bytes.size(), true, result);
+    return result;
+}
+
+bool BijoyConverter::convertFile(const QString &sourcePath, const QString &destPath,
+                                 const std::atomic<bool> *cancelled)
+{
+    QFile source(sourcePath);
+    if (!source.open(QIODevice::ReadOnly)) {
+        qWarning() << "Bijoy conversion: cannot open" << sourcePath << source.errorString();
+        return false;
+    }
+
+    QSaveFile dest(destPath);
+    if (!dest.open(QIODevice::WriteOnly)) {
+        qWarning() << "Bijoy conversion: cannot write" << destPath << dest.errorString();
+        return false;
+    }
+    // Converted text is Bangla, which the editor saves with a BOM
+    dest.write("\xEF\xBB\xBF", 3);
+
+    const qint64 size = source.size();
+    uchar *mapped = size > 0 ? source.map(0, size) : nullptr;
+
+    BijoyConverter converter;
+    QString text;
+    bool ok = true;
+    qint64 offset = 0;
+    QByteArray buffer;
+    while (ok) {
+        if (cancelled && cancelled->load(std::memory_order_relaxed)) {
+            ok = false;
+            break;
+        }
+        const char *chunk;
+        qint64 length;
+        if (mapped) {
+            chunk = reinterpret_cast<const char *>(mapped) + offset;
+            length = qMin(kChunkBytes, size - offset);
+        } else {
+            buffer = source.read(kChunkBytes);
+            chunk = buffer.constData();
+            length = buffer.size();
+        }
+        offset += length;
+        const bool last = mapped ? offset >= size : source.atEnd() || length == 0;
+
+        text.clear();
+        converter.convert(chunk, length, last, text);
+        const QByteArray encoded = text.toUtf8();
+        if (dest.write(encoded) != encoded.size()) {
+            qWarning() << "Bijoy conversion: write failed for" << destPath << dest.errorString();
+            ok = false;
+        }
+        if (last) {
+            break;
+        }
+    }
+
+    if (!ok) {
+        dest.cancelWriting();
+        return false;
+    }
+    return dest.commit();
+}
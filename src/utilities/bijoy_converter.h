@@ -0,0 +1,60 @@
+#ifndef BIJOY_CONVERTER_H
+#define BIJOY_CONVERTER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+/**
+ * @brief Converts Bijoy (SutonnyMJ) encoded text to Unicode Bangla
+ *
+ * Bijoy stores glyphs, not characters: the bytes are Windows-1252, vowel
+ * signs such as ি and ে are typed before their consonant, and reph (©)
+ * after it. Conversion is a longest-match transducer over a trie of the
+ * Bijoy byte sequences, precompiled once, followed by a reordering pass
+ * that moves pre-base vowel signs behind their consonant cluster, joins
+ * ে…া and ে…ৗ into ো and ৌ, and moves reph in front of its cluster.
+ *
+ * Input can be fed in chunks of any size: bytes that may still extend a
+ * match and the syllable at the end of a chunk are carried over. Runs of
+ * bytes that map to themselves (whitespace, punctuation) are found 16 at
+ * a time with SSE2 and copied without going through the trie.
+ */
+class BijoyConverter
+{
+public:
+    BijoyConverter();
+
+    // Appends the Unicode text for the next chunk to out; final flushes everything held back
+    void convert(const char *data, qint64 size, bool final, QString &out);
+    void reset();
+
+    static QString convert(const QByteArray &bijoy);
+    // Bijoy text that was already decoded as Windows-1252, as the editor loads it
+    static QString fromDecodedText(const QString &text);
+    // Streams sourcePath into destPath as UTF-8; destPath is replaced atomically
+    static bool convertFile(const QString &sourcePath, const QString &destPath,
+                            const std::atomic<bool> *cancelled = nullptr);
+
+private:
+    struct Node {
+        int children[256];
+        int value = -1;            // Index into the trie's outputs, -1 if no key ends here
+        bool hasChildren = false;
+    };
+
+    struct Trie {
+        QVector<Node> nodes;
+        QVector<QString> outputs;
+        bool passthrough[256];     // Bytes that start no key and decode to themselves
+    };
+
+    static const Trie &trie();
+    static QString reorder(const QString &visual);
+
+    QByteArray m_carry;   // Bytes that may still extend a match
+    QString m_visual;     // Mapped text of the unfinished syllable, in Bijoy order
+};
+
+#endif // BIJOY_CONVERTER_H
@@ -0,0 +1,556 @@
+#include "compression.h"
+#include "file_identity.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QtEndian>
+#include <QDebug>
+#include <limits>
+#ifdef MANGO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MANGO_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef MANGO_HAVE_LZMA
+#include <lzma.h>
+#endif
+
+namespace {
+// Compressed bytes read and decompressed bytes handed to the sink per step
+const qint64 kChunkBytes = 256 * 1024;
+// Longest zstd frame header, and more than the gzip and xz magic
+const int kHeaderBytes = 18;
+// Decompressed copies kept in the cache; least recently used go first
+const qint64 kMaxDecompressedCacheBytes = qint64(2) * 1024 * 1024 * 1024;
+
+// Next piece of compressed input; size 0 at the end, false on a read error
+using Input = std::function<bool(const char *&data, qint64 &size)>;
+
+void setError(QString *error, const QString &message)
+{
+    if (error) {
+        *error = message;
+    }
+}
+
+#ifdef MANGO_HAVE_ZLIB
+bool inflateGzip(const Input &next, const Compression::Sink &sink, QString *error)
+{
+    z_stream stream = {};
+    // 32 + 15: gzip or zlib header, largest window
+    if (inflateInit2(&stream, 32 + 15) != Z_OK) {
+        setError(error, QStringLiteral("zlib initialization failed"));
+        return false;
+    }
+
+    QByteArray output(int(kChunkBytes), Qt::Uninitialized);
+    int status = Z_OK;
+    bool ok = true;
+    bool done = false;
+    while (ok && !done) {
+        const char *data = nullptr;
+        qint64 size = 0;
+        if (!next(data, size)) {
+            setError(error, QStringLiteral("Read error"));
+            ok = false;
+            break;
+        }
+        if (size == 0) {
+            break;
+        }
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        stream.avail_in = uInt(size);
+        do {
+            bool nextMember = false;
+            if (status == Z_STREAM_END) {
+                if (stream.avail_in == 0) {
+                    break;
+                }
+                // Concatenated members, as written by gzip -c a b
+                inflateReset(&stream);
+                nextMember = true;
+            }
+            stream.next_out = reinterpret_cast<Bytef *>(output.data());
+            stream.avail_out = uInt(kChunkBytes);
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status == Z_NEED_DICT || status == Z_DATA_ERROR || status == Z_MEM_ERROR || status == Z_STREAM_ERROR) {
+                if (nextMember && stream.total_out == 0) {
+                    // Padding after the last member; gzip ignores it too
+                    qWarning() << "Ignoring trailing data after the last gzip member";
+                    status = Z_STREAM_END;
+                    done = true;
+                    break;
+                }
+                setError(error, QStringLiteral("Corrupt gzip data: %1").arg(QString::fromLatin1(stream.msg ? stream.msg : "")));
+                ok = false;
+                break;
+            }
+            const qint64 produced = kChunkBytes - stream.avail_out;
+            if (produced > 0 && !sink(output.constData(), produced)) {
+                setError(error, QStringLiteral("Stopped"));
+                ok = false;
+                break;
+            }
+        } while (stream.avail_in > 0 || stream.avail_out == 0);
+    }
+    inflateEnd(&stream);
+
+    if (ok && status != Z_STREAM_END) {
+        setError(error, QStringLiteral("Truncated gzip data"));
+        ok = false;
+    }
+    return ok;
+}
+
+bool deflateGzip(const QByteArray &data, QByteArray &out, QString *error)
+{
+    z_stream stream = {};
+    // 16 + 15: gzip header, largest window
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        setError(error, QStringLiteral("zlib initialization failed"));
+        return false;
+    }
+    out.resize(int(deflateBound(&stream, uLong(data.size()))));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = uInt(data.size());
+    stream.next_out = reinterpret_cast<Bytef *>(out.data());
+    stream.avail_out = uInt(out.size());
+    const int status = deflate(&stream, Z_FINISH);
+    out.resize(int(stream.total_out));
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        setError(error, QStringLiteral("gzip compression failed"));
+        return false;
+    }
+    return true;
+}
+#endif // MANGO_HAVE_ZLIB
+
+#ifdef MANGO_HAVE_ZSTD
+const int kZstdLevel = 3;
+
+bool decompressZstd(const Input &next, const Compression::Sink &sink, QString *error)
+{
+    ZSTD_DStream *stream = ZSTD_createDStream();
+    ZSTD_initDStream(stream);
+
+    QByteArray output(int(kChunkBytes), Qt::Uninitialized);
+    size_t status = 0;  // 0 once a frame is complete
+    bool ok = true;
+    while (ok) {
+        const char *data = nullptr;
+        qint64 size = 0;
+        if (!next(data, size)) {
+            setError(error, QStringLiteral("Read error"));
+            ok = false;
+            break;
+        }
+        if (size == 0) {
+            break;
+        }
+        ZSTD_inBuffer input = {data, size_t(size), 0};
+        ZSTD_outBuffer buffer = {output.data(), size_t(kChunkBytes), 0};
+        do {
+            buffer.pos = 0;
+            status = ZSTD_decompressStream(stream, &buffer, &input);
+            if (ZSTD_isError(status)) {
+                setError(error, QStringLiteral("Corrupt zstd data: %1").arg(QString::fromLatin1(ZSTD_getErrorName(status))));
+                ok = false;
+                break;
+            }
+            if (buffer.pos > 0 && !sink(output.constData(), qint64(buffer.pos))) {
+                setError(error, QStringLiteral("Stopped"));
+                ok = false;
+                break;
+            }
+        } while (input.pos < input.size || buffer.pos == buffer.size);
+    }
+    ZSTD_freeDStream(stream);
+
+    if (ok && status != 0) {
+        setError(error, QStringLiteral("Truncated zstd data"));
+        ok = false;
+    }
+    return ok;
+}
+
+bool compressZstd(const QByteArray &data, QByteArray &out, QString *error)
+{
+    ZSTD_CCtx *context = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, kZstdLevel);
+    ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1);
+    // Fails harmlessly on libzstd builds without threading
+    ZSTD_CCtx_setParameter(context, ZSTD_c_nbWorkers, QThread::idealThreadCount());
+
+    out.resize(int(ZSTD_compressBound(size_t(data.size()))));
+    const size_t written = ZSTD_compress2(context, out.data(), size_t(out.size()), data.constData(), size_t(data.size()));
+    ZSTD_freeCCtx(context);
+    if (ZSTD_isError(written)) {
+        setError(error, QStringLiteral("zstd compression failed: %1").arg(QString::fromLatin1(ZSTD_getErrorName(written))));
+        return false;
+    }
+    out.resize(int(written));
+    return true;
+}
+#endif // MANGO_HAVE_ZSTD
+
+#ifdef MANGO_HAVE_LZMA
+const uint32_t kXzPreset = 6;
+
+bool decompressXz(const Input &next, const Compression::Sink &sink, QString *error)
+{
+    lzma_stream stream = LZMA_STREAM_INIT;
+    if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+        setError(error, QStringLiteral("liblzma initialization failed"));
+        return false;
+    }
+
+    QByteArray output(int(kChunkBytes), Qt::Uninitialized);
+    lzma_ret status = LZMA_OK;
+    bool ok = true;
+    while (ok && status != LZMA_STREAM_END) {
+        const char *data = nullptr;
+        qint64 size = 0;
+        if (!next(data, size)) {
+            setError(error, QStringLiteral("Read error"));
+            ok = false;
+            break;
+        }
+        // With LZMA_CONCATENATED the end is only known once input runs out
+        const lzma_action action = size == 0 ? LZMA_FINISH : LZMA_RUN;
+        stream.next_in = reinterpret_cast<const uint8_t *>(data);
+        stream.avail_in = size_t(size);
+        do {
+            stream.next_out = reinterpret_cast<uint8_t *>(output.data());
+            stream.avail_out = size_t(kChunkBytes);
+            status = lzma_code(&stream, action);
+            if (status != LZMA_OK && status != LZMA_STREAM_END) {
+                setError(error, status == LZMA_BUF_ERROR ? QStringLiteral("Truncated xz data")
+                                                         : QStringLiteral("Corrupt xz data (%1)").arg(int(status)));
+                ok = false;
+                break;
+            }
+            const qint64 produced = kChunkBytes - qint64(stream.avail_out);
+            if (produced > 0 && !sink(output.constData(), produced)) {
+                setError(error, QStringLiteral("Stopped"));
+                ok = false;
+                break;
+            }
+        } while (status == LZMA_OK && (stream.avail_in > 0 || stream.avail_out == 0 || action == LZMA_FINISH));
+    }
+    lzma_end(&stream);
+    return ok;
+}
+
+bool compressXz(const QByteArray &data, QByteArray &out, QString *error)
+{
+    lzma_mt options = {};
+    options.threads = uint32_t(qMax(1, QThread::idealThreadCount()));
+    options.preset = kXzPreset;
+    options.check = LZMA_CHECK_CRC64;
+
+    lzma_stream stream = LZMA_STREAM_INIT;
+    if (lzma_stream_encoder_mt(&stream, &options) != LZMA_OK) {
+        setError(error, QStringLiteral("liblzma initialization failed"));
+        return false;
+    }
+
+    out.resize(int(lzma_stream_buffer_bound(size_t(data.size()))));
+    stream.next_in = reinterpret_cast<const uint8_t *>(data.constData());
+    stream.avail_in = size_t(data.size());
+    stream.next_out = reinterpret_cast<uint8_t *>(out.data());
+    stream.avail_out = size_t(out.size());
+    lzma_ret status;
+    do {
+        status = lzma_code(&stream, LZMA_FINISH);
+        if (status == LZMA_OK && stream.avail_out == 0) {
+            // Headers of the parallel blocks can exceed the single-stream bound
+            const qint64 used = qint64(stream.total_out);
+            out.resize(out.size() + out.size() / 2 + 4096);
+            stream.next_out = reinterpret_cast<uint8_t *>(out.data()) + used;
+            stream.avail_out = size_t(out.size() - used);
+        }
+    } while (status == LZMA_OK);
+    out.resize(int(stream.total_out));
+    lzma_end(&stream);
+
+    if (status != LZMA_STREAM_END) {
+        setError(error, QStringLiteral("xz compression failed (%1)").arg(int(status)));
+        return false;
+    }
+    return true;
+}
+#endif // MANGO_HAVE_LZMA
+
+// Removes the least recently used copies until the directory fits the cap.
+// A copy that is mapped stays readable until unmapped; keep is never removed.
+void trimDecompressedCache(const QString &directory, const QString &keep)
+{
+    // Oldest first; names with a dot are QSaveFile copies still being written
+    QFileInfoList copies = QDir(directory).entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
+    qint64 total = 0;
+    for (const QFileInfo &info : qAsConst(copies)) {
+        if (!info.fileName().contains('.')) {
+            total += info.size();
+        }
+    }
+    for (const QFileInfo &info : qAsConst(copies)) {
+        if (total <= kMaxDecompressedCacheBytes) {
+            break;
+        }
+        if (info.fileName().contains('.') || info.absoluteFilePath() == keep) {
+            continue;
+        }
+        if (QFile::remove(info.absoluteFilePath())) {
+            total -= info.size();
+        }
+    }
+}
+
+bool decompressInput(const Input &next, Compression::Format format, const Compression::Sink &sink, QString *error)
+{
+    if (format == Compression::None) {
+        setError(error, QStringLiteral("Not compressed"));
+        return false;
+    }
+    if (!Compression::isAvailable(format)) {
+        setError(error, QStringLiteral("%1 support is not built in").arg(Compression::name(format)));
+        return false;
+    }
+    switch (format) {
+#ifdef MANGO_HAVE_ZLIB
+    case Compression::Gzip:
+        return inflateGzip(next, sink, error);
+#endif
+#ifdef MANGO_HAVE_ZSTD
+    case Compression::Zstd:
+        return decompressZstd(next, sink, error);
+#endif
+#ifdef MANGO_HAVE_LZMA
+    case Compression::Xz:
+        return decompressXz(next, sink, error);
+#endif
+    default:
+        return false;
+    }
+}
+} // namespace
+
+Compression::Format Compression::detect(const char *data, qint64 size)
+{
+    const QByteArray head = QByteArray::fromRawData(data, int(qMin<qint64>(size, kHeaderBytes)));
+    if (head.startsWith("\x1F\x8B")) {
+        return Gzip;
+    }
+    if (head.startsWith("\x28\xB5\x2F\xFD")) {
+        return Zstd;
+    }
+    if (head.startsWith(QByteArray("\xFD" "7zXZ\x00", 6))) {
+        return Xz;
+    }
+    return None;
+}
+
+Compression::Format Compression::formatForPath(const QString &filePath)
+{
+    if (filePath.endsWith(QLatin1String(".gz"), Qt::CaseInsensitive)) {
+        return Gzip;
+    }
+    if (filePath.endsWith(QLatin1String(".zst"), Qt::CaseInsensitive)) {
+        return Zstd;
+    }
+    if (filePath.endsWith(QLatin1String(".xz"), Qt::CaseInsensitive)) {
+        return Xz;
+    }
+    return None;
+}
+
+bool Compression::isAvailable(Format format)
+{
+    switch (format) {
+    case Gzip:
+#ifdef MANGO_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case Zstd:
+#ifdef MANGO_HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    case Xz:
+#ifdef MANGO_HAVE_LZMA
+        return true;
+#else
+        return false;
+#endif
+    default:
+        return false;
+    }
+}
+
+QString Compression::name(Format format)
+{
+    switch (format) {
+    case Gzip:
+        return QStringLiteral("gzip");
+    case Zstd:
+        return QStringLiteral("zstd");
+    case Xz:
+        return QStringLiteral("xz");
+    default:
+        return QStringLiteral("none");
+    }
+}
+
+qint64 Compression::contentSize(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QByteArray head = file.read(kHeaderBytes);
+    switch (detect(head.constData(), head.size())) {
+    case None:
+        return file.size();
+    case Gzip: {
+        // ISIZE, the last four bytes of the (last) member
+        if (file.size() < 18 || !file.seek(file.size() - 4)) {
+            return -1;
+        }
+        const QByteArray trailer = file.read(4);
+        return trailer.size() == 4 ? qint64(qFromLittleEndian<quint32>(trailer.constData())) : -1;
+    }
+    case Zstd: {
+#ifdef MANGO_HAVE_ZSTD
+        // First frame only; files of several frames are rare
+        const unsigned long long size = ZSTD_getFrameContentSize(head.constData(), size_t(head.size()));
+        if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR) {
+            return qint64(size);
+        }
+#endif
+        return -1;
+    }
+    default:
+        return -1;
+    }
+}
+
+bool Compression::decompress(QIODevice *source, Format format, const Sink &sink, QString *error)
+{
+    QByteArray buffer(int(kChunkBytes), Qt::Uninitialized);
+    return decompressInput([&](const char *&data, qint64 &size) {
+        size = source->read(buffer.data(), kChunkBytes);
+        data = buffer.constData();
+        return size >= 0;
+    }, format, sink, error);
+}
+
+bool Compression::decompress(const char *data, qint64 size, Format format, QByteArray &out, QString *error)
+{
+    // Handed out in slices, since zlib counts input in 32 bits
+    qint64 position = 0;
+    out.clear();
+    return decompressInput([&](const char *&chunk, qint64 &length) {
+        chunk = data + position;
+        length = qMin(size - position, kChunkBytes * 64);
+        position += length;
+        return true;
+    }, format, [&out](const char *decompressed, qint64 length) {
+        if (qint64(out.size()) + length > std::numeric_limits<int>::max()) {
+            return false;
+        }
+        out.append(decompressed, int(length));
+        return true;
+    }, error);
+}
+
+bool Compression::compress(const QByteArray &data, Format format, QByteArray &out, QString *error)
+{
+    if (format == None) {
+        out = data;
+        return true;
+    }
+    if (!isAvailable(format)) {
+        setError(error, QStringLiteral("%1 support is not built in").arg(name(format)));
+        return false;
+    }
+    switch (format) {
+#ifdef MANGO_HAVE_ZLIB
+    case Gzip:
+        return deflateGzip(data, out, error);
+#endif
+#ifdef MANGO_HAVE_ZSTD
+    case Zstd:
+        return compressZstd(data, out, error);
+#endif
+#ifdef MANGO_HAVE_LZMA
+    case Xz:
+        return compressXz(data, out, error);
+#endif
+    default:
+        return false;
+    }
+}
+
+QString Compression::decompressedCopy(const QString &filePath, QString *error)
+{
+    QFile source(filePath);
+    if (!source.open(QIODevice::ReadOnly)) {
+        setError(error, source.errorString());
+        return QString();
+    }
+    const FileIdentity identity = FileIdentity::of(source.handle());
+    const QByteArray head = source.peek(kHeaderBytes);
+    const Format format = detect(head.constData(), head.size());
+    if (format == None) {
+        return filePath;
+    }
+
+    // Named after the file's identity: one copy per version, found again without reading
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/decompressed";
+    QDir().mkpath(directory);
+    const QString prefix = QString("%1-%2-").arg(identity.device, 0, 16).arg(identity.inode, 0, 16);
+    const QString copyPath = directory + '/' + prefix
+                           + QString("%1-%2").arg(identity.size, 0, 16).arg(identity.mtimeNs, 0, 16);
+    if (identity.isValid() && QFileInfo::exists(copyPath)) {
+        // The modification time orders copies for eviction
+        QFile reused(copyPath);
+        if (reused.open(QIODevice::ReadWrite)) {
+            reused.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+        }
+        return copyPath;
+    }
+    // Copies of earlier versions of this file are stale
+    const QStringList stale = QDir(directory).entryList({prefix + '*'}, QDir::Files);
+    for (const QString &name : stale) {
+        QFile::remove(directory + '/' + name);
+    }
+
+    QSaveFile copy(copyPath);
+    if (!copy.open(QIODevice::WriteOnly)) {
+        setError(error, copy.errorString());
+        return QString();
+    }
+    const bool ok = decompress(&source, format, [&copy](const char *data, qint64 size) {
+        return copy.write(data, size) == size;
+    }, error);
+    if (!ok) {
+        copy.cancelWriting();
+        return QString();
+    }
+    if (!copy.commit()) {
+        setError(error, copy.errorString());
+        return QString();
+    }
+    trimDecompressedCache(directory, QFileInfo(copyPath).absoluteFilePath());
+    return copyPath;
+}
@@ -0,0 +1,59 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <QByteArray>
+#include <QString>
+#include <functional>
+
+class QIODevice;
+
+/**
+ * @brief gzip, zstd and xz streams for transparently opening and saving
+ *
+ * Compressed files are recognized by their magic bytes when read and by
+ * their suffix when written. Each format is backed by its library when
+ * the build has it (MANGO_HAVE_ZLIB, MANGO_HAVE_ZSTD, MANGO_HAVE_LZMA);
+ * otherwise isAvailable() is false and the operations fail cleanly.
+ *
+ * Decompression streams: output is handed to a sink a chunk at a time, so
+ * large files can go straight into a buffer or a file without holding the
+ * compressed and decompressed data twice. Concatenated gzip members, zstd
+ * frames and xz streams are all read. Compression uses one worker per
+ * core for zstd and xz.
+ */
+class Compression
+{
+public:
+    enum Format {
+        None,
+        Gzip,
+        Zstd,
+        Xz
+    };
+
+    // Returns false to stop decompressing
+    using Sink = std::function<bool(const char *data, qint64 size)>;
+
+    // From the magic bytes at the start of a file
+    static Format detect(const char *data, qint64 size);
+    // From the suffix of a file about to be written
+    static Format formatForPath(const QString &filePath);
+    static bool isAvailable(Format format);
+    static QString name(Format format);
+
+    // Size of the file once decompressed: the file size for plain files, the
+    // size recorded by gzip (modulo 4 GiB) and zstd, -1 where unknown (xz)
+    static qint64 contentSize(const QString &filePath);
+
+    static bool decompress(QIODevice *source, Format format, const Sink &sink, QString *error = nullptr);
+    static bool decompress(const char *data, qint64 size, Format format, QByteArray &out,
+                           QString *error = nullptr);
+    static bool compress(const QByteArray &data, Format format, QByteArray &out, QString *error = nullptr);
+
+    // An uncompressed copy in the cache directory, made once per version of
+    // the file, for the mapped large-file mode; empty on failure. Copies
+    // beyond 2 GiB in total are evicted least recently used first.
+    static QString decompressedCopy(const QString &filePath, QString *error = nullptr);
+};
+
+#endif // COMPRESSION_H
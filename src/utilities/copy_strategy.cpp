@@ -0,0 +1,285 @@
+#include "copy_strategy.h"
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <memory>
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+
+namespace {
+const qint64 kBufferSize = 1024 * 1024; // 1MB
+#ifdef Q_OS_LINUX
+// Largest single sendfile() transfer Linux accepts
+const qint64 kMaxSendFile = 0x7ffff000;
+#endif
+
+#ifdef Q_OS_UNIX
+enum Outcome {
+    Done,
+    Unsupported,  // Nothing went wrong; the next method continues from done
+    Failed
+};
+
+// The filesystem, kernel or file pair cannot use this method
+bool isUnsupported(int error)
+{
+    return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP
+        || error == ENOTTY || error == EBADF;
+}
+
+Outcome reflink(int in, int out, qint64 size, qint64 &done)
+{
+#ifdef FICLONE
+    // Clones whole files only
+    if (done == 0 && ::ioctl(out, FICLONE, in) == 0) {
+        done = size;
+        return Done;
+    }
+#else
+    Q_UNUSED(in) Q_UNUSED(out) Q_UNUSED(size) Q_UNUSED(done)
+#endif
+    return Unsupported;
+}
+
+Outcome copyFileRange(int in, int out, qint64 size, qint64 &done)
+{
+#if defined(Q_OS_LINUX) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    while (done < size) {
+        loff_t inOffset = done;
+        loff_t outOffset = done;
+        const ssize_t count = ::copy_file_range(in, &inOffset, out, &outOffset, size_t(size - done), 0);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return isUnsupported(errno) ? Unsupported : Failed;
+        }
+        if (count == 0) {
+            // Some filesystems (procfs, sysfs, some FUSE) report 0 instead of
+            // an error; read/write tells a shrunk source from those
+            return Unsupported;
+        }
+        done += count;
+    }
+    return Done;
+#else
+    Q_UNUSED(in) Q_UNUSED(out) Q_UNUSED(size) Q_UNUSED(done)
+    return Unsupported;
+#endif
+}
+
+Outcome sendFile(int in, int out, qint64 size, qint64 &done)
+{
+#ifdef Q_OS_LINUX
+    // sendfile() writes at the destination's file position
+    if (::lseek(out, off_t(done), SEEK_SET) < 0) {
+        return Failed;
+    }
+    while (done < size) {
+        off_t offset = off_t(done);
+        const ssize_t count = ::sendfile(out, in, &offset, size_t(qMin(size - done, kMaxSendFile)));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return isUnsupported(errno) ? Unsupported : Failed;
+        }
+        if (count == 0) {
+            return Unsupported; // As for copy_file_range()
+        }
+        done += count;
+    }
+    return Done;
+#else
+    Q_UNUSED(in) Q_UNUSED(out) Q_UNUSED(size) Q_UNUSED(done)
+    return Unsupported;
+#endif
+}
+
+Outcome readWrite(int in, int out, qint64 size, qint64 &done)
+{
+    std::unique_ptr<char[]> buffer(new char[kBufferSize]);
+    while (done < size) {
+        const ssize_t count = ::pread(in, buffer.get(), size_t(qMin(size - done, kBufferSize)), off_t(done));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return Failed;
+        }
+        if (count == 0) {
+            break; // Source shrank while copying
+        }
+        for (ssize_t written = 0; written < count;) {
+            const ssize_t result = ::pwrite(out, buffer.get() + written, size_t(count - written),
+                                            off_t(done + written));
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return Failed;
+            }
+            written += result;
+        }
+        done += count;
+    }
+    return Done;
+}
+#endif // Q_OS_UNIX
+} // namespace
+
+bool CopyStrategy::copy(int sourceFd, int destinationFd, qint64 size, Method fastest, Method *used)
+{
+#ifdef Q_OS_UNIX
+    qint64 done = 0;
+    for (int method = fastest; method <= ReadWrite; ++method) {
+        Outcome outcome = Unsupported;
+        switch (method) {
+        case Reflink:
+            outcome = reflink(sourceFd, destinationFd, size, done);
+            break;
+        case CopyFileRange:
+            outcome = copyFileRange(sourceFd, destinationFd, size, done);
+            break;
+        case SendFile:
+            outcome = sendFile(sourceFd, destinationFd, size, done);
+            break;
+        case ReadWrite:
+            outcome = readWrite(sourceFd, destinationFd, size, done);
+            break;
+        }
+
+        if (outcome == Done) {
+            if (used) {
+                *used = Method(method);
+            }
+            return true;
+        }
+        if (outcome == Failed) {
+            qWarning() << "Copy failed using" << methodName(Method(method)) << std::strerror(errno);
+            return false;
+        }
+    }
+    return false;
+#else
+    Q_UNUSED(sourceFd) Q_UNUSED(destinationFd) Q_UNUSED(size) Q_UNUSED(fastest) Q_UNUSED(used)
+    return false;
+#endif
+}
+
+bool CopyStrategy::copyFile(const QString &source, const QString &destination, Method fastest, Method *used)
+{
+#ifdef Q_OS_UNIX
+    const int in = ::open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        qWarning() << "Failed to open source file:" << source << std::strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (::fstat(in, &info) != 0) {
+        qWarning() << "Failed to stat source file:" << source << std::strerror(errno);
+        ::close(in);
+        return false;
+    }
+
+    // A symlink keeps pointing at the file it named; the rename replaces
+    // the link's target, so the temporary file goes next to that
+    QByteArray targetPath = QFile::encodeName(destination);
+    if (char *resolved = ::realpath(targetPath.constData(), nullptr)) {
+        targetPath = resolved;
+        ::free(resolved);
+    }
+    QByteArray tempPath = targetPath + ".mango-copy-XXXXXX";
+    const int out = ::mkstemp(tempPath.data());
+    if (out < 0) {
+        qWarning() << "Failed to create destination file:" << destination << std::strerror(errno);
+        ::close(in);
+        return false;
+    }
+
+    // An existing destination keeps its owner and mode, as with cp; a new
+    // one gets the source's mode
+    struct stat existing;
+    if (::stat(targetPath.constData(), &existing) == 0) {
+        if ((existing.st_uid != ::geteuid() || existing.st_gid != ::getegid())
+            && ::fchown(out, existing.st_uid, existing.st_gid) != 0
+            && ::fchown(out, uid_t(-1), existing.st_gid) != 0) {
+            qWarning() << "Cannot keep the owner of" << destination << std::strerror(errno);
+        }
+        ::fchmod(out, existing.st_mode & 07777);
+    } else {
+        ::fchmod(out, info.st_mode & 07777);
+    }
+
+    bool success = copy(in, out, qint64(info.st_size), fastest, used);
+    ::close(in);
+    if (::close(out) != 0) {
+        success = false;
+    }
+    if (success && ::rename(tempPath.constData(), targetPath.constData()) != 0) {
+        qWarning() << "Failed to rename copy to" << destination << std::strerror(errno);
+        success = false;
+    }
+    if (!success) {
+        ::unlink(tempPath.constData());
+    }
+    return success;
+#else
+    // QSaveFile for atomic copy operation
+    Q_UNUSED(fastest)
+    QFile srcFile(source);
+    QSaveFile destFile(destination);
+
+    if (!srcFile.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open source file:" << srcFile.errorString();
+        return false;
+    }
+    if (!destFile.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open destination file:" << destFile.errorString();
+        return false;
+    }
+
+    std::unique_ptr<char[]> buffer(new char[kBufferSize]);
+    while (!srcFile.atEnd()) {
+        const qint64 bytesRead = srcFile.read(buffer.get(), kBufferSize);
+        if (bytesRead == -1) {
+            qWarning() << "Error reading file:" << srcFile.errorString();
+            return false;
+        }
+        if (destFile.write(buffer.get(), bytesRead) == -1) {
+            qWarning() << "Error writing file:" << destFile.errorString();
+            return false;
+        }
+    }
+    if (used) {
+        *used = ReadWrite;
+    }
+    return destFile.commit();
+#endif
+}
+
+QString CopyStrategy::methodName(Method method)
+{
+    switch (method) {
+    case Reflink:
+        return QStringLiteral("reflink");
+    case CopyFileRange:
+        return QStringLiteral("copy_file_range");
+    case SendFile:
+        return QStringLiteral("sendfile");
+    case ReadWrite:
+        return QStringLiteral("read/write");
+    }
+    return QString();
+}
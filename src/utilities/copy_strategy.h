@@ -0,0 +1,51 @@
+#ifndef COPY_STRATEGY_H
+#define COPY_STRATEGY_H
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief Copies file content with the cheapest mechanism the system offers
+ *
+ * Methods are tried from the fastest down, each continuing where the
+ * previous one stopped:
+ * - Reflink: FICLONE shares the extents (btrfs, xfs); no data is copied
+ * - CopyFileRange: copy_file_range() copies inside the kernel, and lets
+ *   NFS and SMB copy server-side
+ * - SendFile: sendfile() for kernels or file pairs copy_file_range rejects
+ * - ReadWrite: a user-space pread/pwrite loop, the only method elsewhere
+ *
+ * A method that copies nothing where bytes remain hands over to the next,
+ * since some filesystems report that instead of an error.
+ *
+ * The destination is written to a temporary sibling and renamed into
+ * place, so a failed copy never leaves a truncated file. A symlinked
+ * destination stays a link to the replaced file, and an existing
+ * destination keeps its owner and mode. Thread-safe.
+ */
+class CopyStrategy
+{
+public:
+    enum Method {
+        Reflink,
+        CopyFileRange,
+        SendFile,
+        ReadWrite
+    };
+
+    // Replaces destination with a copy of source, trying methods from fastest
+    // on; used (if given) receives the method that finished the copy
+    static bool copyFile(const QString &source, const QString &destination,
+                         Method fastest = Reflink, Method *used = nullptr);
+
+    // Copies size bytes between open descriptors, both from offset 0
+    static bool copy(int sourceFd, int destinationFd, qint64 size,
+                     Method fastest = Reflink, Method *used = nullptr);
+
+    static QString methodName(Method method);
+
+private:
+    CopyStrategy() = delete;
+};
+
+#endif // COPY_STRATEGY_H
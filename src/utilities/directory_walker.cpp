@@ -0,0 +1,426 @@
+#include "directory_walker.h"
+#include "ignore_matcher.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QThread>
+#include <QtConcurrent>
+#include <deque>
+#include <memory>
+#include <vector>
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+namespace {
+// Entries handed to the sink at a time
+const int kBatchSize = 1024;
+// Enough for a few hundred entries per getdents64() call
+const int kDirentBufferBytes = 64 * 1024;
+// Failed steals before an idle worker starts sleeping between attempts
+const int kSpinRounds = 64;
+
+const char *const kIgnoreFiles[] = {".gitignore", ".ignore"};
+
+struct DirEntry {
+    QByteArray name;
+    bool isDirectory = false;
+    bool isFile = false;  // Regular file, or a symlink to one
+    qint64 size = -1;
+    qint64 mtimeNs = 0;
+};
+
+#ifdef Q_OS_LINUX
+// Layout the kernel writes for getdents64()
+struct LinuxDirent64 {
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+#endif
+
+/**
+ * Reads one directory. Entry types come from the directory entry itself;
+ * only symlinks and filesystems that report DT_UNKNOWN cost a stat.
+ */
+class DirectoryReader
+{
+public:
+    ~DirectoryReader()
+    {
+#ifdef Q_OS_UNIX
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+#endif
+    }
+
+    bool open(const QByteArray &path)
+    {
+        m_path = path;
+#ifdef Q_OS_UNIX
+        m_fd = ::open(path.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        return m_fd >= 0;
+#else
+        return QFileInfo(QFile::decodeName(path)).isDir();
+#endif
+    }
+
+    void read(QVector<DirEntry> &entries)
+    {
+#if defined(Q_OS_LINUX)
+        std::unique_ptr<char[]> buffer(new char[kDirentBufferBytes]);
+        for (;;) {
+            const long count = ::syscall(SYS_getdents64, m_fd, buffer.get(), kDirentBufferBytes);
+            if (count <= 0) {
+                break;
+            }
+            for (long offset = 0; offset < count;) {
+                const auto *dirent = reinterpret_cast<const LinuxDirent64 *>(buffer.get() + offset);
+                offset += dirent->d_reclen;
+                add(dirent->d_name, dirent->d_type, entries);
+            }
+        }
+#elif defined(Q_OS_UNIX)
+        DIR *directory = ::fdopendir(::dup(m_fd));
+        if (!directory) {
+            return;
+        }
+        while (const struct dirent *dirent = ::readdir(directory)) {
+            add(dirent->d_name, dirent->d_type, entries);
+        }
+        ::closedir(directory);
+#else
+        const QFileInfoList infos = QDir(QFile::decodeName(m_path)).entryInfoList(
+            QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+        for (const QFileInfo &info : infos) {
+            DirEntry entry;
+            entry.name = QFile::encodeName(info.fileName());
+            entry.isDirectory = info.isDir() && !info.isSymLink();
+            entry.isFile = info.isFile();
+            entry.size = info.size();
+            entry.mtimeNs = info.lastModified().toMSecsSinceEpoch() * 1000000;
+            entries.append(entry);
+        }
+#endif
+    }
+
+    // Fills in size and mtime
+    void stat(DirEntry &entry) const
+    {
+#if defined(Q_OS_LINUX) && defined(STATX_SIZE)
+        // Only the two fields asked for; DONT_SYNC spares network filesystems a round trip
+        struct statx info;
+        if (::statx(m_fd, entry.name.constData(), AT_STATX_DONT_SYNC, STATX_SIZE | STATX_MTIME, &info) == 0) {
+            entry.size = qint64(info.stx_size);
+            entry.mtimeNs = qint64(info.stx_mtime.tv_sec) * 1000000000 + info.stx_mtime.tv_nsec;
+        }
+#elif defined(Q_OS_UNIX)
+        struct stat info;
+        if (::fstatat(m_fd, entry.name.constData(), &info, 0) == 0) {
+            entry.size = qint64(info.st_size);
+#ifdef Q_OS_MACOS
+            entry.mtimeNs = qint64(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+            entry.mtimeNs = qint64(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+        }
+#else
+        Q_UNUSED(entry) // Filled in by read()
+#endif
+    }
+
+private:
+#ifdef Q_OS_UNIX
+    void add(const char *name, unsigned char type, QVector<DirEntry> &entries) const
+    {
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            return;
+        }
+        DirEntry entry;
+        entry.name = QByteArray(name);
+        if (type == DT_LNK || type == DT_UNKNOWN) {
+            // Symlinks count as their target's type but are never descended into
+            struct stat info;
+            const int flags = type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW;
+            if (::fstatat(m_fd, name, &info, flags) != 0) {
+                return;
+            }
+            entry.isFile = S_ISREG(info.st_mode);
+            entry.isDirectory = type == DT_UNKNOWN && S_ISDIR(info.st_mode);
+        } else {
+            entry.isFile = type == DT_REG;
+            entry.isDirectory = type == DT_DIR;
+        }
+        entries.append(entry);
+    }
+
+    int m_fd = -1;
+#endif
+    QByteArray m_path;
+};
+
+struct Work {
+    QByteArray path;      // Raw bytes, as passed to the system
+    QByteArray relative;  // From the root, empty for the root itself
+    QSharedPointer<const IgnoreMatcher> ignore;
+};
+
+/**
+ * One walk. Every worker owns a queue: it pushes subdirectories to the
+ * back and pops from the back, staying depth-first in one subtree, and
+ * steals from the front of the others' queues, taking the shallowest and
+ * so largest pending work. pending counts queued and in-progress
+ * directories; the walk ends when it reaches zero.
+ */
+class Walk
+{
+public:
+    Walk(const DirectoryWalker::Options &options, const DirectoryWalker::Sink &sink,
+         const std::atomic<bool> *cancelled, int workers)
+        : m_options(options), m_sink(sink), m_cancelled(cancelled)
+    {
+        for (int i = 0; i < workers; ++i) {
+            m_queues.emplace_back(new Queue);
+        }
+        for (const QString &filter : options.nameFilters) {
+            m_filters.append(filter.toUtf8());
+        }
+    }
+
+    void push(int worker, Work &&work)
+    {
+        ++m_pending;
+        QMutexLocker locker(&m_queues[worker]->mutex);
+        m_queues[worker]->items.push_back(std::move(work));
+    }
+
+    void run(int worker)
+    {
+        QVector<DirectoryWalker::Entry> batch;
+        int idleRounds = 0;
+        while (m_pending.load() > 0 && !isCancelled()) {
+            Work work;
+            if (!take(worker, work)) {
+                // Another worker is still reading and may queue more
+                if (++idleRounds < kSpinRounds) {
+                    QThread::yieldCurrentThread();
+                } else {
+                    QThread::usleep(100);
+                }
+                continue;
+            }
+            idleRounds = 0;
+            process(worker, work, batch);
+            --m_pending;
+        }
+        if (!batch.isEmpty() && !isCancelled()) {
+            flush(batch);
+        }
+    }
+
+    bool rootFailed() const { return m_rootFailed; }
+    bool isCancelled() const { return m_cancelled && m_cancelled->load(); }
+
+private:
+    struct Queue {
+        QMutex mutex;
+        std::deque<Work> items;
+    };
+
+    bool take(int worker, Work &work)
+    {
+        const int count = int(m_queues.size());
+        for (int k = 0; k < count; ++k) {
+            Queue &queue = *m_queues[(worker + k) % count];
+            QMutexLocker locker(&queue.mutex);
+            if (queue.items.empty()) {
+                continue;
+            }
+            if (k == 0) {
+                work = std::move(queue.items.back());
+                queue.items.pop_back();
+            } else {
+                work = std::move(queue.items.front());
+                queue.items.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void process(int worker, const Work &work, QVector<DirectoryWalker::Entry> &batch)
+    {
+        DirectoryReader reader;
+        if (!reader.open(work.path)) {
+            if (work.relative.isEmpty()) {
+                m_rootFailed = true;
+            }
+            return;
+        }
+        QVector<DirEntry> entries;
+        reader.read(entries);
+
+        const QByteArray prefix = work.path.endsWith('/') ? work.path : work.path + '/';
+
+        // This level's ignore files apply to its own entries, so they come first
+        QSharedPointer<const IgnoreMatcher> ignore = work.ignore;
+        if (m_options.respectIgnoreFiles) {
+            QVector<QByteArray> contents;
+            for (const char *ignoreFile : kIgnoreFiles) {
+                for (const DirEntry &entry : qAsConst(entries)) {
+                    if (entry.isFile && entry.name == ignoreFile) {
+                        QFile file(QFile::decodeName(prefix + entry.name));
+                        if (file.open(QIODevice::ReadOnly)) {
+                            contents.append(file.readAll());
+                        }
+                    }
+                }
+            }
+            if (!contents.isEmpty()) {
+                QSharedPointer<const IgnoreMatcher> level(new IgnoreMatcher(ignore, work.relative, contents));
+                if (!level->isEmpty()) {
+                    ignore = level;
+                }
+            }
+        }
+
+        for (DirEntry &entry : entries) {
+            if (!m_options.includeHidden && entry.name.startsWith('.')) {
+                continue;
+            }
+            if (m_options.respectIgnoreFiles && entry.isDirectory && entry.name == ".git") {
+                continue;
+            }
+            const QByteArray relative = work.relative.isEmpty() ? entry.name : work.relative + '/' + entry.name;
+            if (ignore && ignore->isIgnored(relative, entry.isDirectory)) {
+                continue;
+            }
+
+            if (entry.isDirectory) {
+                if (m_options.recursive) {
+                    push(worker, {prefix + entry.name, relative, ignore});
+                }
+                if (!m_options.includeDirectories) {
+                    continue;
+                }
+            } else if (!m_options.includeFiles || !entry.isFile || !matchesFilters(entry.name)) {
+                continue;
+            }
+            if (m_options.statFiles) {
+                reader.stat(entry);
+            }
+            batch.append({QFile::decodeName(prefix + entry.name), entry.size, entry.mtimeNs, entry.isDirectory});
+            if (batch.size() >= kBatchSize) {
+                flush(batch);
+            }
+        }
+    }
+
+    bool matchesFilters(const QByteArray &name) const
+    {
+        if (m_filters.isEmpty()) {
+            return true;
+        }
+        for (const QByteArray &filter : m_filters) {
+            if (IgnoreMatcher::globMatch(filter.constData(), filter.size(), name.constData(), name.size(), true)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void flush(QVector<DirectoryWalker::Entry> &batch)
+    {
+        // Sinks need not be thread-safe
+        QMutexLocker locker(&m_sinkMutex);
+        m_sink(std::move(batch));
+        batch = QVector<DirectoryWalker::Entry>();
+        batch.reserve(kBatchSize);
+    }
+
+    const DirectoryWalker::Options &m_options;
+    const DirectoryWalker::Sink &m_sink;
+    const std::atomic<bool> *m_cancelled;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    QVector<QByteArray> m_filters;
+    std::atomic<int> m_pending{0};
+    std::atomic<bool> m_rootFailed{false};
+    QMutex m_sinkMutex;
+};
+} // namespace
+
+DirectoryWalker::DirectoryWalker(QObject *parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<QVector<DirectoryWalker::Entry>>("QVector<DirectoryWalker::Entry>");
+}
+
+DirectoryWalker::~DirectoryWalker()
+{
+    cancel();
+    m_future.waitForFinished();
+}
+
+void DirectoryWalker::start(const QString &root, const Options &options)
+{
+    if (isRunning()) {
+        return;
+    }
+    m_cancelled = false;
+    m_future = QtConcurrent::run([this, root, options]() {
+        const bool completed = walk(root, options, [this](QVector<Entry> &&batch) {
+            emit entriesFound(batch);
+        }, &m_cancelled);
+        emit finished(completed);
+    });
+}
+
+void DirectoryWalker::cancel()
+{
+    m_cancelled = true;
+}
+
+bool DirectoryWalker::isRunning() const
+{
+    return m_future.isRunning();
+}
+
+bool DirectoryWalker::walk(const QString &root, const Options &options, const Sink &sink,
+                           const std::atomic<bool> *cancelled)
+{
+    if (!QFileInfo(root).isDir()) {
+        qWarning() << "Directory does not exist:" << root;
+        return false;
+    }
+
+    const int workers = options.recursive ? qMax(1, options.threads > 0 ? options.threads : QThread::idealThreadCount()) : 1;
+    Walk walk(options, sink, cancelled, workers);
+    walk.push(0, {QFile::encodeName(QDir::cleanPath(root)), QByteArray(), {}});
+
+    // The calling thread is a worker too, so a busy pool only means fewer helpers
+    QVector<QFuture<void>> helpers;
+    for (int i = 1; i < workers; ++i) {
+        helpers.append(QtConcurrent::run([&walk, i]() { walk.run(i); }));
+    }
+    walk.run(0);
+    for (QFuture<void> &helper : helpers) {
+        helper.waitForFinished();
+    }
+
+    if (walk.rootFailed()) {
+        qWarning() << "Failed to read directory:" << root;
+    }
+    return !walk.rootFailed() && !walk.isCancelled();
+}
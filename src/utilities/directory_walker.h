@@ -0,0 +1,77 @@
+#ifndef DIRECTORY_WALKER_H
+#define DIRECTORY_WALKER_H
+
+#include <QFuture>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+/**
+ * @brief Parallel directory scanner that honors .gitignore and .ignore
+ *
+ * Directories are spread over worker threads that each keep their own
+ * queue and steal from the others when it runs dry, so one huge subtree
+ * does not serialize the scan. On Linux entries are read in bulk with
+ * getdents64(), and the file type comes from the directory entry, so
+ * files are only stat'ed (statx) when sizes are requested. Ignored
+ * directories are never opened, which is what keeps build output from
+ * dominating a repository scan.
+ *
+ * Results arrive in batches as they are found: through entriesFound()
+ * for a started walk, or through the sink of the blocking walk().
+ */
+class DirectoryWalker : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        QStringList nameFilters;          // Wildcards on file names, case-insensitive like QDir
+        bool recursive = true;
+        bool respectIgnoreFiles = true;   // .gitignore and .ignore; .git is skipped too
+        bool includeHidden = false;
+        bool statFiles = false;           // Fill in size and mtimeNs
+        bool includeFiles = true;
+        bool includeDirectories = false;  // Report directories too; name filters don't apply
+        int threads = 0;                  // 0 for QThread::idealThreadCount()
+    };
+
+    struct Entry {
+        QString path;
+        qint64 size = -1;
+        qint64 mtimeNs = 0;
+        bool isDirectory = false;
+    };
+
+    using Sink = std::function<void(QVector<Entry> &&batch)>;
+
+    explicit DirectoryWalker(QObject *parent = nullptr);
+    ~DirectoryWalker();
+
+    void start(const QString &root, const Options &options);
+    void cancel();
+    bool isRunning() const;
+
+    // Walks on the calling thread and the pool; sink is called from any of
+    // them, one batch at a time. Returns false if the root cannot be read or
+    // the walk was cancelled.
+    static bool walk(const QString &root, const Options &options, const Sink &sink,
+                     const std::atomic<bool> *cancelled = nullptr);
+
+signals:
+    // Emitted from worker threads
+    void entriesFound(const QVector<DirectoryWalker::Entry> &entries);
+    void finished(bool completed);
+
+private:
+    QFuture<void> m_future;
+    std::atomic<bool> m_cancelled{false};
+};
+
+Q_DECLARE_METATYPE(DirectoryWalker::Entry)
+
+#endif // DIRECTORY_WALKER_H
@@ -0,0 +1,231 @@
+#include "encoding_detector.h"
+#include "utf8.h"
+#include <QPair>
+#include <QTextCodec>
+#include <QVector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+// Bytes per sampled region; files up to three regions are read whole
+const qint64 kSampleBytes = 16 * 1024;
+const int kMaxCachedFiles = 4096;
+// UTF-16: enough NULs, nearly all of them on one byte parity
+const double kMinUtf16NulShare = 0.01;
+const double kMinUtf16Parity = 0.9;
+// ISCII: Bengali letters are all high bytes, with many vowel signs and halants
+const double kMinIsciiHighShare = 0.3;
+const double kMinIsciiSignShare = 0.1;
+// Bijoy: mostly ASCII, but the e-kar and reph glyphs (0x86, 0x87, 0xA9)
+// dominate the high bytes, which they almost never do in Latin text
+const double kMinBijoyHighShare = 0.03;
+const double kMinBijoyMarkerShare = 0.25;
+const int kUtf8Mib = 106;
+
+struct Histogram {
+    qint64 bytes = 0;
+    qint64 nulEven = 0;
+    qint64 nulOdd = 0;
+    qint64 controls = 0;  // Below 0x20, except NUL and whitespace
+    qint64 high = 0;      // 0x80 and above
+    qint64 highCounts[128] = {};
+    bool utf8Valid = true;
+    bool utf8NonAscii = false;
+};
+
+bool isControl(uchar byte)
+{
+    return byte != 0 && byte < 0x20 && byte != '\t' && byte != '\n' && byte != '\r' && byte != '\f';
+}
+
+// data must start at an even file offset so NUL parities line up
+void accumulate(const uchar *data, qint64 size, Histogram &histogram)
+{
+    qint64 i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lineFeed = _mm_set1_epi8('\n');
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    const __m128i formFeed = _mm_set1_epi8('\f');
+    for (; i + 16 <= size; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const uint nul = uint(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero)));
+        const uint high = uint(_mm_movemask_epi8(chunk));
+        // Signed compare, so high bytes count as below 0x20 and are masked out
+        const uint below = uint(_mm_movemask_epi8(_mm_cmplt_epi8(chunk, space)));
+        const __m128i whitespace = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, tab), _mm_cmpeq_epi8(chunk, lineFeed)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, carriageReturn), _mm_cmpeq_epi8(chunk, formFeed)));
+
+        histogram.nulEven += qPopulationCount(nul & 0x5555u);
+        histogram.nulOdd += qPopulationCount(nul & 0xAAAAu);
+        histogram.controls += qPopulationCount(below & ~high & ~nul & ~uint(_mm_movemask_epi8(whitespace)));
+        histogram.high += qPopulationCount(high);
+        for (uint bits = high; bits; bits &= bits - 1) {
+            ++histogram.highCounts[data[i + qCountTrailingZeroBits(bits)] - 0x80];
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        const uchar byte = data[i];
+        if (byte == 0) {
+            ++(i % 2 ? histogram.nulOdd : histogram.nulEven);
+        } else if (byte >= 0x80) {
+            ++histogram.high;
+            ++histogram.highCounts[byte - 0x80];
+        } else if (isControl(byte)) {
+            ++histogram.controls;
+        }
+    }
+    histogram.bytes += size;
+}
+
+qint64 countRange(const Histogram &histogram, int first, int last)
+{
+    qint64 count = 0;
+    for (int byte = first; byte <= last; ++byte) {
+        count += histogram.highCounts[byte - 0x80];
+    }
+    return count;
+}
+} // namespace
+
+// Singleton instance initialization
+EncodingDetector* EncodingDetector::m_instance = nullptr;
+QMutex EncodingDetector::m_instanceMutex;
+
+EncodingDetector* EncodingDetector::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+    if (!m_instance) {
+        m_instance = new EncodingDetector();
+    }
+    return m_instance;
+}
+
+EncodingDetector::Result EncodingDetector::detect(const FileIdentity &identity, const char *data, qint64 size)
+{
+    if (identity.isValid()) {
+        QMutexLocker locker(&m_mutex);
+        auto cached = m_cache.constFind(identity);
+        if (cached != m_cache.constEnd()) {
+            return *cached;
+        }
+    }
+
+    const Result result = score(data, size);
+
+    if (identity.isValid()) {
+        QMutexLocker locker(&m_mutex);
+        if (m_cache.size() >= kMaxCachedFiles) {
+            m_cache.clear();
+        }
+        m_cache.insert(identity, result);
+    }
+    return result;
+}
+
+void EncodingDetector::forget(const FileIdentity &identity)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.remove(identity);
+}
+
+int EncodingDetector::byteOrderMark(const char *data, qint64 size, QString &encoding)
+{
+    const QByteArray head = QByteArray::fromRawData(data, int(qMin<qint64>(size, 3)));
+    if (head.startsWith("\xEF\xBB\xBF")) {
+        encoding = QStringLiteral("UTF-8");
+        return 3;
+    }
+    if (head.startsWith("\xFF\xFE")) {
+        encoding = QStringLiteral("UTF-16LE");
+        return 2;
+    }
+    if (head.startsWith("\xFE\xFF")) {
+        encoding = QStringLiteral("UTF-16BE");
+        return 2;
+    }
+    return 0;
+}
+
+QTextCodec *EncodingDetector::codecFor(const QString &encoding)
+{
+    if (encoding == QLatin1String("Bijoy")) {
+        return QTextCodec::codecForName("windows-1252");
+    }
+    QTextCodec *codec = QTextCodec::codecForName(encoding.toLatin1());
+    return codec ? codec : QTextCodec::codecForLocale();
+}
+
+EncodingDetector::Result EncodingDetector::score(const char *data, qint64 size)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+
+    // Head, middle and tail; region starts stay even for the UTF-16 parity counts
+    QVector<QPair<qint64, qint64>> regions;
+    if (size <= 3 * kSampleBytes) {
+        regions.append({0, size});
+    } else {
+        const qint64 middle = (size / 2 - kSampleBytes / 2) & ~qint64(1);
+        const qint64 tail = (size - kSampleBytes) & ~qint64(1);
+        regions = {{0, kSampleBytes}, {middle, kSampleBytes}, {tail, size - tail}};
+    }
+
+    Histogram histogram;
+    for (const auto &region : qAsConst(regions)) {
+        accumulate(bytes + region.first, region.second, histogram);
+
+        // Regions may start and end inside a multi-byte sequence
+        const qint64 end = region.first + region.second;
+        qint64 start = region.first;
+        while (region.first > 0 && start < end && start - region.first < 3 && (bytes[start] & 0xC0) == 0x80) {
+            ++start;
+        }
+        const Utf8::ScanResult scan = Utf8::scan(data + start, end - start);
+        if (!scan.valid && (end == size || scan.errorOffset < end - start - 3)) {
+            histogram.utf8Valid = false;
+        }
+        histogram.utf8NonAscii |= !scan.ascii;
+    }
+
+    const qint64 nuls = histogram.nulEven + histogram.nulOdd;
+    if (nuls > 0 && nuls >= kMinUtf16NulShare * histogram.bytes) {
+        // ASCII in UTF-16LE is "A\0", so the NUL lands on the odd byte
+        if (histogram.nulOdd >= kMinUtf16Parity * nuls) {
+            return {QStringLiteral("UTF-16LE"), double(histogram.nulOdd) / nuls};
+        }
+        if (histogram.nulEven >= kMinUtf16Parity * nuls) {
+            return {QStringLiteral("UTF-16BE"), double(histogram.nulEven) / nuls};
+        }
+    }
+
+    if (histogram.utf8Valid) {
+        // Pure ASCII decodes the same in every candidate
+        return {QStringLiteral("UTF-8"), histogram.utf8NonAscii ? 1.0 : 0.5};
+    }
+
+    // ISCII leaves 0x80..0xA0 unused; 0xDA..0xE8 are vowel signs and the halant
+    const qint64 isciiUnused = countRange(histogram, 0x80, 0xA0);
+    const qint64 isciiSigns = countRange(histogram, 0xDA, 0xE8);
+    if (isciiUnused == 0 && histogram.high >= kMinIsciiHighShare * histogram.bytes
+        && isciiSigns >= kMinIsciiSignShare * histogram.high) {
+        return {QStringLiteral("Iscii-Bng"), 0.7};
+    }
+
+    const qint64 bijoyMarkers = countRange(histogram, 0x86, 0x87) + countRange(histogram, 0xA9, 0xA9);
+    if (histogram.high >= kMinBijoyHighShare * histogram.bytes
+        && bijoyMarkers >= kMinBijoyMarkerShare * histogram.high) {
+        return {QStringLiteral("Bijoy"), 0.6};
+    }
+
+    // A legacy locale codec is the user's best hint; otherwise the common Latin one
+    QTextCodec *locale = QTextCodec::codecForLocale();
+    if (locale->mibEnum() != kUtf8Mib) {
+        return {QString::fromLatin1(locale->name()), 0.3};
+    }
+    return {QStringLiteral("windows-1252"), 0.4};
+}
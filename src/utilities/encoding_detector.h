@@ -0,0 +1,62 @@
+#ifndef ENCODING_DETECTOR_H
+#define ENCODING_DETECTOR_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include "file_identity.h"
+
+class QTextCodec;
+
+/**
+ * @brief Guesses the text encoding of a file from samples of its bytes
+ *
+ * The head, middle and tail of the file are sampled, so non-ASCII content
+ * far from the start is still seen. Each sample is reduced to a byte-class
+ * histogram (NULs by position parity, control bytes, high bytes) with SSE2
+ * and checked for UTF-8 validity. The candidates are scored in order:
+ * UTF-16LE/BE (NULs concentrated on one byte parity), UTF-8, the legacy
+ * Bangla encodings ISCII and Bijoy, and finally Windows-1252 or a non-UTF-8
+ * locale codec.
+ *
+ * Results are cached by FileIdentity, so reopening an unchanged file costs
+ * nothing. All methods are thread-safe.
+ */
+class EncodingDetector
+{
+public:
+    struct Result {
+        QString encoding;        // "UTF-8", "UTF-16LE", "Iscii-Bng", "Bijoy", ...
+        double confidence = 0;   // 0..1
+    };
+
+    // Singleton instance access
+    static EncodingDetector* instance();
+
+    EncodingDetector(const EncodingDetector&) = delete;
+    EncodingDetector& operator=(const EncodingDetector&) = delete;
+
+    // data is usually the whole mapped file; an invalid identity skips the cache
+    Result detect(const FileIdentity &identity, const char *data, qint64 size);
+    void forget(const FileIdentity &identity);
+
+    // Length of a leading UTF-8/UTF-16 byte order mark, setting encoding; 0 if none
+    static int byteOrderMark(const char *data, qint64 size, QString &encoding);
+
+    // Codec that decodes an encoding reported by detect(). Bijoy is a font
+    // encoding over Windows-1252 bytes and is loaded as such until converted.
+    static QTextCodec *codecFor(const QString &encoding);
+
+private:
+    EncodingDetector() = default;
+
+    static Result score(const char *data, qint64 size);
+
+    QMutex m_mutex;
+    QHash<FileIdentity, Result> m_cache;
+
+    static EncodingDetector* m_instance;
+    static QMutex m_instanceMutex;
+};
+
+#endif // ENCODING_DETECTOR_H
@@ -0,0 +1,180 @@
+#include "file_classifier.h"
+#include "encoding_detector.h"
+#include <QFile>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+const qint64 kSampleBytes = 8 * 1024;
+const int kMaxCachedFiles = 16384;
+const double kMaxControlShare = 0.1;
+
+bool isControl(uchar byte)
+{
+    return byte != 0 && byte < 0x20 && byte != '\t' && byte != '\n' && byte != '\r' && byte != '\f';
+}
+
+// Length of the UTF-8 sequence whose lead byte (0x80 or above) is at data,
+// setting codePoint; 0 if it is invalid, -1 if the buffer ends inside it
+int decodeSequence(const uchar *data, qint64 available, uint &codePoint)
+{
+    const uchar lead = data[0];
+    int length;
+    uint minimum;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        minimum = 0x80;
+        codePoint = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+        length = 3;
+        minimum = 0x800;
+        codePoint = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        minimum = 0x10000;
+        codePoint = lead & 0x07;
+    } else {
+        return 0;
+    }
+
+    for (int k = 1; k < length; ++k) {
+        if (k >= available) {
+            return -1;
+        }
+        if ((data[k] & 0xC0) != 0x80) {
+            return 0;
+        }
+        codePoint = (codePoint << 6) | (data[k] & 0x3F);
+    }
+    if (codePoint < minimum || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+        return 0;
+    }
+    return length;
+}
+} // namespace
+
+// Singleton instance initialization
+FileClassifier* FileClassifier::m_instance = nullptr;
+QMutex FileClassifier::m_instanceMutex;
+
+FileClassifier* FileClassifier::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+    if (!m_instance) {
+        m_instance = new FileClassifier();
+    }
+    return m_instance;
+}
+
+FileClassifier::Verdict FileClassifier::classify(const QString &filePath)
+{
+    // stat() only; an unchanged file is not opened again
+    const FileIdentity identity = FileIdentity::of(filePath);
+    if (identity.isValid()) {
+        QMutexLocker locker(&m_mutex);
+        auto cached = m_cache.constFind(identity);
+        if (cached != m_cache.constEnd()) {
+            return *cached;
+        }
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return Verdict();
+    }
+    const QByteArray sample = file.read(kSampleBytes);
+    const Verdict verdict = scan(sample.constData(), sample.size());
+
+    // A write while reading changes the identity; don't cache a mixed sample
+    if (identity.isValid() && FileIdentity::of(file.handle()) == identity) {
+        QMutexLocker locker(&m_mutex);
+        if (m_cache.size() >= kMaxCachedFiles) {
+            m_cache.clear();
+        }
+        m_cache.insert(identity, verdict);
+    }
+    return verdict;
+}
+
+void FileClassifier::forget(const FileIdentity &identity)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.remove(identity);
+}
+
+void FileClassifier::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.clear();
+}
+
+FileClassifier::Verdict FileClassifier::scan(const char *data, qint64 size)
+{
+    Verdict verdict;
+    verdict.readable = true;
+    verdict.sampledBytes = size;
+
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    qint64 i = 0;
+    while (i < size) {
+#ifdef __SSE2__
+        // Blocks without high bytes only need counting
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i space = _mm_set1_epi8(0x20);
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i lineFeed = _mm_set1_epi8('\n');
+        const __m128i carriageReturn = _mm_set1_epi8('\r');
+        const __m128i formFeed = _mm_set1_epi8('\f');
+        while (i + 16 <= size) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+            if (_mm_movemask_epi8(chunk)) {
+                break;
+            }
+            const uint nul = uint(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero)));
+            const uint below = uint(_mm_movemask_epi8(_mm_cmplt_epi8(chunk, space)));
+            const __m128i whitespace = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, tab), _mm_cmpeq_epi8(chunk, lineFeed)),
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, carriageReturn), _mm_cmpeq_epi8(chunk, formFeed)));
+            verdict.nulBytes += qPopulationCount(nul);
+            verdict.controlBytes += qPopulationCount(below & ~nul & ~uint(_mm_movemask_epi8(whitespace)));
+            i += 16;
+        }
+#endif
+        // The next 16 bytes, decoding any UTF-8 sequences in them whole
+        const qint64 end = qMin(size, i + 16);
+        while (i < end) {
+            const uchar byte = bytes[i];
+            if (byte < 0x80) {
+                if (byte == 0) {
+                    ++verdict.nulBytes;
+                } else if (isControl(byte)) {
+                    ++verdict.controlBytes;
+                }
+                ++i;
+                continue;
+            }
+
+            uint codePoint = 0;
+            const int length = decodeSequence(bytes + i, size - i, codePoint);
+            if (length > 0) {
+                if (codePoint >= 0x0980 && codePoint <= 0x09FF) {
+                    verdict.hasBengali = true;
+                }
+                i += length;
+            } else if (length < 0) {
+                // Cut off by the end of the sample
+                i = size;
+            } else {
+                verdict.validUtf8 = false;
+                ++i;
+            }
+        }
+    }
+
+    QString bomEncoding;
+    const bool utf16 = EncodingDetector::byteOrderMark(data, size, bomEncoding) > 0
+                    && bomEncoding.startsWith(QLatin1String("UTF-16"));
+    verdict.binary = (verdict.nulBytes > 0 && !utf16) || verdict.controlBytes > size * kMaxControlShare;
+    return verdict;
+}
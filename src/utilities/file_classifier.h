@@ -0,0 +1,61 @@
+#ifndef FILE_CLASSIFIER_H
+#define FILE_CLASSIFIER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include "file_identity.h"
+
+/**
+ * @brief Tells text from binary files, and Bangla text from the rest
+ *
+ * One pass over the first 8 KB of a file gathers everything the checks
+ * need: NUL and control byte counts, UTF-8 validity and whether any code
+ * point falls in the Bengali block. Blocks of plain ASCII are counted 16
+ * bytes at a time with SSE2; only blocks with high bytes go through the
+ * UTF-8 decoder. A file is binary if the sample has a NUL byte (unless
+ * a UTF-16 byte order mark explains it) or is more than a tenth control
+ * bytes.
+ *
+ * Verdicts are cached by FileIdentity, so asking again about an unchanged
+ * file costs one stat(). All methods are thread-safe.
+ */
+class FileClassifier
+{
+public:
+    struct Verdict {
+        bool readable = false;
+        bool binary = false;
+        bool validUtf8 = true;     // A sequence cut off by the end of the sample counts as valid
+        bool hasBengali = false;   // Code points in U+0980..U+09FF, as UTF-8
+        qint64 sampledBytes = 0;
+        qint64 nulBytes = 0;
+        qint64 controlBytes = 0;   // Below 0x20, except NUL and whitespace
+
+        bool isBanglaText() const { return readable && !binary && hasBengali; }
+    };
+
+    // Singleton instance access
+    static FileClassifier* instance();
+
+    FileClassifier(const FileClassifier&) = delete;
+    FileClassifier& operator=(const FileClassifier&) = delete;
+
+    Verdict classify(const QString &filePath);
+    void forget(const FileIdentity &identity);
+    void clear();
+
+    // Classifies a buffer that starts at the beginning of a file
+    static Verdict scan(const char *data, qint64 size);
+
+private:
+    FileClassifier() = default;
+
+    QMutex m_mutex;
+    QHash<FileIdentity, Verdict> m_cache;
+
+    static FileClassifier* m_instance;
+    static QMutex m_instanceMutex;
+};
+
+#endif // FILE_CLASSIFIER_H
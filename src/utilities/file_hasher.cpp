@@ -0,0 +1,196 @@
+#include "file_hasher.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QVector>
+#include <QtEndian>
+#include <QtConcurrent>
+#include <cstring>
+#include <functional>
+
+namespace {
+// Files above one chunk are hashed chunk-parallel
+const qint64 kChunkBytes = 8 * 1024 * 1024;
+const int kMaxCachedFiles = 4096;
+
+const quint64 kPrime1 = 11400714785074694791ULL;
+const quint64 kPrime2 = 14029467366897019727ULL;
+const quint64 kPrime3 = 1609587929392839161ULL;
+const quint64 kPrime4 = 9650029242287828579ULL;
+const quint64 kPrime5 = 2870177450012600261ULL;
+
+inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline quint64 read64(const uchar *data)
+{
+    quint64 value;
+    std::memcpy(&value, data, sizeof(value));
+    return qFromLittleEndian(value);
+}
+
+inline quint32 read32(const uchar *data)
+{
+    quint32 value;
+    std::memcpy(&value, data, sizeof(value));
+    return qFromLittleEndian(value);
+}
+
+inline quint64 accumulate(quint64 accumulator, quint64 input)
+{
+    accumulator += input * kPrime2;
+    return rotateLeft(accumulator, 31) * kPrime1;
+}
+
+inline quint64 mergeRound(quint64 accumulator, quint64 value)
+{
+    accumulator ^= accumulate(0, value);
+    return accumulator * kPrime1 + kPrime4;
+}
+
+QString toHex(quint64 digest)
+{
+    return QString::number(digest, 16).rightJustified(16, QLatin1Char('0'));
+}
+} // namespace
+
+// Singleton instance initialization
+FileHasher* FileHasher::m_instance = nullptr;
+QMutex FileHasher::m_instanceMutex;
+
+FileHasher* FileHasher::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+    if (!m_instance) {
+        m_instance = new FileHasher();
+    }
+    return m_instance;
+}
+
+QString FileHasher::hash(const QString &filePath, Algorithm algorithm)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+
+    const FileIdentity identity = FileIdentity::of(file.handle());
+    if (identity.isValid()) {
+        QMutexLocker locker(&m_mutex);
+        auto cached = m_cache[algorithm].constFind(identity);
+        if (cached != m_cache[algorithm].constEnd()) {
+            return *cached;
+        }
+    }
+
+    // Mapped so the chunks can be hashed in parallel without copies; empty
+    // files and pipes cannot be mapped and are read normally
+    const qint64 size = file.size();
+    QByteArray buffer;
+    uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+    if (!mapped) {
+        buffer = file.readAll();
+    }
+    const char *data = mapped ? reinterpret_cast<const char *>(mapped) : buffer.constData();
+    const QString digest = compute(data, mapped ? size : buffer.size(), algorithm);
+
+    // A write during hashing changes the identity; don't cache a mixed result
+    if (identity.isValid() && FileIdentity::of(file.handle()) == identity) {
+        QMutexLocker locker(&m_mutex);
+        if (m_cache[algorithm].size() >= kMaxCachedFiles) {
+            m_cache[algorithm].clear();
+        }
+        m_cache[algorithm].insert(identity, digest);
+    }
+    return digest;
+}
+
+void FileHasher::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache[Fast].clear();
+    m_cache[Sha256].clear();
+}
+
+QString FileHasher::compute(const char *data, qint64 size, Algorithm algorithm)
+{
+    if (algorithm == Sha256) {
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        for (qint64 offset = 0; offset < size; offset += kChunkBytes) {
+            hash.addData(data + offset, int(qMin(kChunkBytes, size - offset)));
+        }
+        return QString::fromLatin1(hash.result().toHex());
+    }
+
+    if (size <= kChunkBytes) {
+        return toHex(fastHash(data, size));
+    }
+
+    QVector<qint64> offsets;
+    for (qint64 offset = 0; offset < size; offset += kChunkBytes) {
+        offsets.append(offset);
+    }
+    std::function<quint64(const qint64 &)> hashChunk = [data, size](const qint64 &offset) {
+        return qToLittleEndian(fastHash(data + offset, qMin(kChunkBytes, size - offset)));
+    };
+    const QVector<quint64> digests = QtConcurrent::blockingMapped<QVector<quint64>>(offsets, hashChunk);
+
+    // Seeded with the size, so a tree digest never equals a plain one by construction
+    return toHex(fastHash(reinterpret_cast<const char *>(digests.constData()),
+                          digests.size() * qint64(sizeof(quint64)), quint64(size)));
+}
+
+quint64 FileHasher::fastHash(const char *data, qint64 size, quint64 seed)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    const uchar *const end = bytes + size;
+    quint64 hash;
+
+    if (size >= 32) {
+        // Four independent lanes, 32 bytes per stripe
+        quint64 v1 = seed + kPrime1 + kPrime2;
+        quint64 v2 = seed + kPrime2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - kPrime1;
+        const uchar *const limit = end - 32;
+        do {
+            v1 = accumulate(v1, read64(bytes));
+            v2 = accumulate(v2, read64(bytes + 8));
+            v3 = accumulate(v3, read64(bytes + 16));
+            v4 = accumulate(v4, read64(bytes + 24));
+            bytes += 32;
+        } while (bytes <= limit);
+
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = mergeRound(hash, v1);
+        hash = mergeRound(hash, v2);
+        hash = mergeRound(hash, v3);
+        hash = mergeRound(hash, v4);
+    } else {
+        hash = seed + kPrime5;
+    }
+    hash += quint64(size);
+
+    for (; bytes + 8 <= end; bytes += 8) {
+        hash ^= accumulate(0, read64(bytes));
+        hash = rotateLeft(hash, 27) * kPrime1 + kPrime4;
+    }
+    if (bytes + 4 <= end) {
+        hash ^= quint64(read32(bytes)) * kPrime1;
+        hash = rotateLeft(hash, 23) * kPrime2 + kPrime3;
+        bytes += 4;
+    }
+    for (; bytes < end; ++bytes) {
+        hash ^= *bytes * kPrime5;
+        hash = rotateLeft(hash, 11) * kPrime1;
+    }
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,55 @@
+#ifndef FILE_HASHER_H
+#define FILE_HASHER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include "file_identity.h"
+
+/**
+ * @brief Content hashes of files, cached by FileIdentity
+ *
+ * Fast is a 64-bit XXH64 digest for change detection: files up to one
+ * chunk hash to plain XXH64, larger files are split into chunks hashed in
+ * parallel on the thread pool and the chunk digests are hashed again.
+ * Sha256 is the cryptographic digest, for plugins and anything compared
+ * with external tools; SHA-256 is inherently sequential, so only the
+ * cache makes it cheap.
+ *
+ * A file whose identity is unchanged is not read again, so re-checking a
+ * large file costs one stat(). All methods are thread-safe.
+ */
+class FileHasher
+{
+public:
+    enum Algorithm {
+        Fast,
+        Sha256
+    };
+
+    // Singleton instance access
+    static FileHasher* instance();
+
+    FileHasher(const FileHasher&) = delete;
+    FileHasher& operator=(const FileHasher&) = delete;
+
+    // Lowercase hex digest; empty if the file cannot be read
+    QString hash(const QString &filePath, Algorithm algorithm = Fast);
+    void clear();
+
+    // XXH64 of a buffer
+    static quint64 fastHash(const char *data, qint64 size, quint64 seed = 0);
+
+private:
+    FileHasher() = default;
+
+    static QString compute(const char *data, qint64 size, Algorithm algorithm);
+
+    QMutex m_mutex;
+    QHash<FileIdentity, QString> m_cache[2];
+
+    static FileHasher* m_instance;
+    static QMutex m_instanceMutex;
+};
+
+#endif // FILE_HASHER_H
@@ -0,0 +1,65 @@
+#include "file_identity.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+
+namespace {
+FileIdentity fromStat(const struct stat &info)
+{
+    FileIdentity identity;
+    identity.device = quint64(info.st_dev);
+    identity.inode = quint64(info.st_ino);
+    identity.size = qint64(info.st_size);
+#ifdef Q_OS_MACOS
+    identity.mtimeNs = qint64(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    identity.mtimeNs = qint64(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    return identity;
+}
+} // namespace
+
+FileIdentity FileIdentity::of(const QString &filePath)
+{
+    struct stat info;
+    if (::stat(QFile::encodeName(filePath).constData(), &info) != 0) {
+        return FileIdentity();
+    }
+    return fromStat(info);
+}
+
+FileIdentity FileIdentity::of(int fileDescriptor)
+{
+    struct stat info;
+    if (fileDescriptor < 0 || ::fstat(fileDescriptor, &info) != 0) {
+        return FileIdentity();
+    }
+    return fromStat(info);
+}
+
+#else
+
+FileIdentity FileIdentity::of(const QString &filePath)
+{
+    const QFileInfo info(filePath);
+    if (!info.exists()) {
+        return FileIdentity();
+    }
+    FileIdentity identity;
+    identity.inode = qHash(info.canonicalFilePath());
+    identity.size = info.size();
+    identity.mtimeNs = info.lastModified().toMSecsSinceEpoch() * 1000000;
+    return identity;
+}
+
+FileIdentity FileIdentity::of(int fileDescriptor)
+{
+    // No portable way from a descriptor back to the file; callers pass the path
+    Q_UNUSED(fileDescriptor)
+    return FileIdentity();
+}
+
+#endif
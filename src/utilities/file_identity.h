@@ -0,0 +1,42 @@
+#ifndef FILE_IDENTITY_H
+#define FILE_IDENTITY_H
+
+#include <QHash>
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief Identifies one version of a file's content on disk
+ *
+ * Device and inode survive renames and distinguish files behind different
+ * paths (symlinks, hard links); size and nanosecond mtime change on every
+ * write in practice. Used as the cache key for anything derived from file
+ * content. On platforms without inodes the canonical path stands in.
+ */
+struct FileIdentity
+{
+    quint64 device = 0;
+    quint64 inode = 0;
+    qint64 size = -1;
+    qint64 mtimeNs = 0;
+
+    static FileIdentity of(const QString &filePath);
+    static FileIdentity of(int fileDescriptor);
+
+    bool isValid() const { return size >= 0; }
+
+    bool operator==(const FileIdentity &other) const
+    {
+        return device == other.device && inode == other.inode
+            && size == other.size && mtimeNs == other.mtimeNs;
+    }
+    bool operator!=(const FileIdentity &other) const { return !(*this == other); }
+};
+
+inline uint qHash(const FileIdentity &identity, uint seed = 0)
+{
+    return ::qHash(identity.inode, seed) ^ ::qHash(identity.device, seed)
+         ^ ::qHash(identity.size, seed) ^ ::qHash(identity.mtimeNs, seed);
+}
+
+#endif // FILE_IDENTITY_H
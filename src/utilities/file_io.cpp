@@ -1,26 +1,60 @@
 #include "file_io.h"
+#include "bijoy_converter.h"
+#include "compression.h"
+#include "copy_strategy.h"
+#include "directory_walker.h"
+#include "encoding_detector.h"
+#include "file_classifier.h"
+#include "file_hasher.h"
+#include "file_identity.h"
+#include "file_watcher.h"
+#include "utf8.h"
+#include "write_pipeline.h"
 #include <QFile>
-#include <QTextStream>
 #include <QFileInfo>
 #include <QDir>
-#include <QSaveFile>
 #include <QTextCodec>
 #include <QLockFile>
 #include <QTemporaryFile>
-#include <QFileSystemWatcher>
 #include <QCryptographicHash>
 #include <QMessageBox>
 #include <QDebug>
 #include <chrono>
+#include <limits>
 
-// বাংলাদেশী ডেভেলপারদের জন্য বিশেষ UTF-8 ভ্যালিডেশন
-const QByteArray BANGLA_UTF8_SIGNATURE = QByteArray::fromHex("e0a6a4"); // "ত" character
+namespace {
+// Detects without decoding; the verdict is cached for the later read
+bool isBijoyFile(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly) || file.size() <= 0) {
+        return false;
+    }
+    const uchar *mapped = file.map(0, file.size());
+    if (!mapped) {
+        return false;
+    }
+    const char *data = reinterpret_cast<const char *>(mapped);
+    QString encoding;
+    if (EncodingDetector::byteOrderMark(data, file.size(), encoding) > 0) {
+        return false;
+    }
+    const FileIdentity identity = FileIdentity::of(file.handle());
+    return EncodingDetector::instance()->detect(identity, data, file.size()).encoding == QLatin1String("Bijoy");
+}
+} // namespace
 
 FileIO::FileIO(QObject *parent) : QObject(parent) 
 {
-    m_fileWatcher = new QFileSystemWatcher(this);
-    connect(m_fileWatcher, &QFileSystemWatcher::fileChanged, 
-            this, &FileIO::onWatchedFileChanged);
+    connect(FileWatcher::instance(), &FileWatcher::changed,
+            this, &FileIO::onWatchedFilesChanged);
+}
+
+FileIO::~FileIO()
+{
+    for (const QString &filePath : qAsConst(m_watchedFiles)) {
+        FileWatcher::instance()->unwatchFile(filePath);
+    }
 }
 
 bool FileIO::readTextFile(const QString &filePath, QString &content, QString &detectedEncoding)
@@ -34,40 +68,75 @@ bool FileIO::readTextFile(const QString &filePath, QString &content, QString &de
         return false;
     }
 
-    // Step 1: Check for BOM (Byte Order Mark)
-    QByteArray bom = file.peek(4);
-    if (bom.startsWith("\xEF\xBB\xBF")) {
-        detectedEncoding = "UTF-8";
-        file.seek(3); // Skip UTF-8 BOM
-    } else if (bom.startsWith("\xFF\xFE")) {
-        detectedEncoding = "UTF-16LE";
-        file.seek(2); // Skip UTF-16LE BOM
-    } else if (bom.startsWith("\xFE\xFF")) {
-        detectedEncoding = "UTF-16BE";
-        file.seek(2); // Skip UTF-16BE BOM
-    } else {
-        // Step 2: Auto-detect encoding
-        QByteArray data = file.peek(1024);
-        detectedEncoding = detectEncodingFromContent(data);
+    // Map the file instead of copying it through QIODevice buffers; empty
+    // files and pipes cannot be mapped and are read normally
+    const qint64 size = file.size();
+    QByteArray buffer;
+    uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+    if (!mapped) {
+        buffer = file.readAll();
+    }
+    const char *data = mapped ? reinterpret_cast<const char *>(mapped) : buffer.constData();
+    qint64 length = mapped ? size : buffer.size();
+
+    // Compressed files are decompressed into the buffer and read from there
+    const Compression::Format compression = Compression::detect(data, length);
+    if (compression != Compression::None) {
+        QByteArray decompressed;
+        QString error;
+        if (!Compression::decompress(data, length, compression, decompressed, &error)) {
+            qWarning() << "Cannot decompress" << filePath << ":" << error;
+            return false;
+        }
+        buffer = decompressed;
+        data = buffer.constData();
+        length = buffer.size();
     }
 
-    // Step 3: Read with proper encoding
-    QTextStream in(&file);
-    in.setCodec(detectedEncoding.toUtf8());
-    content = in.readAll();
+    // Step 1: Check for BOM (Byte Order Mark)
+    const FileIdentity identity = FileIdentity::of(file.handle());
+    const qint64 offset = EncodingDetector::byteOrderMark(data, length, detectedEncoding);
+    if (offset == 0) {
+        // Step 2: Auto-detect encoding from samples across the whole file
+        const EncodingDetector::Result detected = EncodingDetector::instance()->detect(identity, data, length);
+        detectedEncoding = detected.encoding;
+        emit encodingDetected(filePath, detected.encoding);
+    }
 
-    // Step 4: Validate Bangla UTF-8 content
-    if (detectedEncoding == "UTF-8" && content.contains(QRegularExpression("[ঀ-৿]"))) {
-        if (!validateBanglaUtf8(content)) {
-            qWarning() << "Invalid Bangla UTF-8 sequence detected";
-            // Fallback to system locale
+    // Step 3: Validate the raw bytes before decoding them as UTF-8
+    bool decoded = false;
+    if (detectedEncoding == "UTF-8") {
+        const Utf8::ScanResult scan = Utf8::scan(data + offset, length - offset);
+        if (scan.valid) {
+            decoded = Utf8::decode(data + offset, length - offset, content);
+            if (scan.hasBengali) {
+                emit banglaTextDetected(filePath);
+            }
+        } else {
+            qWarning() << "Invalid UTF-8 sequence at byte" << offset + scan.errorOffset;
+            // The samples missed it; don't keep the verdict for this file
+            EncodingDetector::instance()->forget(identity);
+            // Fallback to system locale, decoding the same bytes
             detectedEncoding = QTextCodec::codecForLocale()->name();
-            file.seek(0);
-            in.setCodec(detectedEncoding.toUtf8());
-            content = in.readAll();
         }
     }
 
+    // Step 4: Other encodings go through their codec
+    if (!decoded) {
+        if (length - offset > std::numeric_limits<int>::max()) {
+            qWarning() << "File too large to decode:" << filePath;
+            return false;
+        }
+        // Reports the codec actually used, so saving writes the same bytes back.
+        // Bijoy stays Bijoy: codecFor() maps it back to the same bytes, and
+        // callers need the verdict to run BijoyConverter.
+        QTextCodec *codec = EncodingDetector::codecFor(detectedEncoding);
+        if (detectedEncoding != QLatin1String("Bijoy")) {
+            detectedEncoding = codec->name();
+        }
+        content = codec->toUnicode(data + offset, int(length - offset));
+    }
+
     qDebug() << "Read" << filePath << "in" << timer.elapsed() << "ms with encoding:" << detectedEncoding;
     return true;
 }
@@ -77,39 +146,11 @@ bool FileIO::writeTextFile(const QString &filePath, const QString &content, cons
     QElapsedTimer timer;
     timer.start();
 
-    // Step 1: Create backup if requested
-    if (backup && QFile::exists(filePath)) {
-        QString backupPath = filePath + ".bak";
-        if (!QFile::copy(filePath, backupPath)) {
-            qWarning() << "Failed to create backup file";
-        }
-    }
-
-    // Step 2: Atomic write using QSaveFile
-    QSaveFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        qWarning() << "File open error:" << file.errorString();
-        return false;
-    }
-
-    QTextStream out(&file);
-    if (!encoding.isEmpty()) {
-        out.setCodec(encoding.toUtf8());
-        
-        // Add BOM for UTF encodings
-        if (encoding.contains("UTF-16")) {
-            out.setGenerateByteOrderMark(true);
-        } else if (encoding == "UTF-8" && content.contains(QRegularExpression("[ঀ-৿]"))) {
-            // Explicitly write UTF-8 BOM for Bangla content
-            file.write("\xEF\xBB\xBF");
-        }
-    }
-    
-    out << content;
-
-    // Step 3: Finalize write operation
-    if (!file.commit()) {
-        qWarning() << "File write error:" << file.errorString();
+    // Same atomic write and durability as batched saves, waited for here
+    const QVector<WritePipeline::Result> results =
+        WritePipeline::instance()->submit({{filePath, encodeText(content, encoding), backup,
+                                            Compression::formatForPath(filePath)}}).result();
+    if (!results.first().success) {
         return false;
     }
 
@@ -117,30 +158,59 @@ bool FileIO::writeTextFile(const QString &filePath, const QString &content, cons
     return true;
 }
 
-QString FileIO::detectEncodingFromContent(const QByteArray &data)
+QFuture<QVector<WritePipeline::Result>> FileIO::writeTextFiles(const QVector<SaveRequest> &requests)
 {
-    // Bangladesh-specific: Check for Bangla UTF-8 patterns
-    if (data.contains(BANGLA_UTF8_SIGNATURE)) {
-        return "UTF-8";
+    // Encoding runs at memory speed; the disk work is one submission
+    QVector<WritePipeline::Request> writes;
+    writes.reserve(requests.size());
+    for (const SaveRequest &request : requests) {
+        writes.append({request.filePath, encodeText(request.content, request.encoding), request.backup,
+                       Compression::formatForPath(request.filePath)});
     }
+    return WritePipeline::instance()->submit(writes);
+}
 
-    // Check for null bytes (likely UTF-16)
-    if (data.contains('\0')) {
-        return "UTF-16LE"; // Default to little-endian
+QByteArray FileIO::encodeText(const QString &content, const QString &encoding)
+{
+    QString text = content;
+#ifdef Q_OS_WIN
+    // What QIODevice::Text used to do when files were written through QTextStream
+    text.replace(QLatin1Char('\n'), QLatin1String("\r\n"));
+#endif
+    QTextCodec *codec = encoding.isEmpty() ? QTextCodec::codecForLocale() : EncodingDetector::codecFor(encoding);
+
+    // Add BOM for UTF encodings
+    QByteArray bom;
+    if (encoding.contains("UTF-16")) {
+        const QChar mark(QChar::ByteOrderMark);
+        QTextCodec::ConverterState state(QTextCodec::IgnoreHeader);
+        bom = codec->fromUnicode(&mark, 1, &state);
+    } else if (encoding == "UTF-8") {
+        // Explicitly write UTF-8 BOM for Bangla content
+        for (const QChar ch : qAsConst(text)) {
+            if (ch.unicode() >= 0x0980 && ch.unicode() <= 0x09FF) {
+                bom = "\xEF\xBB\xBF";
+                break;
+            }
+        }
     }
 
-    // Use system locale as fallback
-    return QTextCodec::codecForLocale()->name();
+    QTextCodec::ConverterState state(QTextCodec::IgnoreHeader);
+    return bom + codec->fromUnicode(text.constData(), text.size(), &state);
 }
 
-bool FileIO::validateBanglaUtf8(const QString &content)
+QString FileIO::detectEncodingFromContent(const QByteArray &data)
 {
-    QTextCodec::ConverterState state;
-    QTextCodec *codec = QTextCodec::codecForName("UTF-8");
-    codec->toUnicode(content.toUtf8(), content.length(), &state);
-    
-    if (state.invalidChars > 0) {
-        qWarning() << "Invalid UTF-8 sequences found in Bangla text";
+    // No file behind the bytes, so nothing to cache the verdict by
+    return EncodingDetector::instance()->detect(FileIdentity(), data.constData(), data.size()).encoding;
+}
+
+bool FileIO::validateBanglaUtf8(const QByteArray &data)
+{
+    // Must run on the raw bytes; a decoded QString can no longer be invalid
+    const Utf8::ScanResult scan = Utf8::scan(data.constData(), data.size());
+    if (!scan.valid) {
+        qWarning() << "Invalid UTF-8 sequence at byte" << scan.errorOffset;
         return false;
     }
     return true;
@@ -156,72 +226,52 @@ bool FileIO::createDirectory(const QString &path)
     return true;
 }
 
-QStringList FileIO::getFilesInDirectory(const QString &path, const QStringList &filters, bool recursive)
+QStringList FileIO::getFilesInDirectory(const QString &path, const QStringList &filters, bool recursive,
+                                        bool respectIgnoreFiles)
 {
-    QDir dir(path);
-    if (!dir.exists()) {
-        qWarning() << "Directory does not exist:" << path;
-        return QStringList();
-    }
+    DirectoryWalker::Options options;
+    options.nameFilters = filters;
+    options.recursive = recursive;
+    options.respectIgnoreFiles = respectIgnoreFiles;
 
     QStringList files;
-    QDirIterator::IteratorFlags flags = recursive ? 
-        QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags;
-
-    QDirIterator it(path, filters, QDir::Files | QDir::NoDotAndDotDot, flags);
-    while (it.hasNext()) {
-        files.append(it.next());
-    }
-
+    DirectoryWalker::walk(path, options, [&files](QVector<DirectoryWalker::Entry> &&batch) {
+        for (const DirectoryWalker::Entry &entry : qAsConst(batch)) {
+            files.append(entry.path);
+        }
+    });
     return files;
 }
 
-bool FileIO::copyFile(const QString &source, const QString &destination, bool overwrite)
+QFileInfoList FileIO::getFileInfoList(const QString &directory, bool recursive)
 {
-    if (QFile::exists(destination)) {
-        if (overwrite) {
-            QFile::remove(destination);
-        } else {
-            qWarning() << "Destination file exists:" << destination;
-            return false;
+    DirectoryWalker::Options options;
+    options.recursive = recursive;
+
+    // QFileInfo stats lazily, so only entries the caller inspects cost a stat
+    QFileInfoList infos;
+    DirectoryWalker::walk(directory, options, [&infos](QVector<DirectoryWalker::Entry> &&batch) {
+        for (const DirectoryWalker::Entry &entry : qAsConst(batch)) {
+            infos.append(QFileInfo(entry.path));
         }
-    }
-
-    // Use QSaveFile for atomic copy operation
-    QFile srcFile(source);
-    QSaveFile destFile(destination);
+    });
+    return infos;
+}
 
-    if (!srcFile.open(QIODevice::ReadOnly)) {
-        qWarning() << "Failed to open source file:" << srcFile.errorString();
+bool FileIO::copyFile(const QString &source, const QString &destination, bool overwrite)
+{
+    if (QFile::exists(destination) && !overwrite) {
+        qWarning() << "Destination file exists:" << destination;
         return false;
     }
 
-    if (!destFile.open(QIODevice::WriteOnly)) {
-        qWarning() << "Failed to open destination file:" << destFile.errorString();
+    // Reflink or an in-kernel copy where possible; renamed over any existing destination
+    CopyStrategy::Method method;
+    if (!CopyStrategy::copyFile(source, destination, CopyStrategy::Reflink, &method)) {
         return false;
     }
-
-    // Copy in chunks for large files
-    const qint64 bufferSize = 1024 * 1024; // 1MB
-    char *buffer = new char[bufferSize];
-
-    while (!srcFile.atEnd()) {
-        qint64 bytesRead = srcFile.read(buffer, bufferSize);
-        if (bytesRead == -1) {
-            qWarning() << "Error reading file:" << srcFile.errorString();
-            delete[] buffer;
-            return false;
-        }
-
-        if (destFile.write(buffer, bytesRead) == -1) {
-            qWarning() << "Error writing file:" << destFile.errorString();
-            delete[] buffer;
-            return false;
-        }
-    }
-
-    delete[] buffer;
-    return destFile.commit();
+    qDebug() << "Copied" << source << "using" << CopyStrategy::methodName(method);
+    return true;
 }
 
 bool FileIO::lockFile(const QString &filePath, int timeoutMs)
@@ -253,14 +303,18 @@ bool FileIO::unlockFile(const QString &filePath)
 
 void FileIO::watchFile(const QString &filePath)
 {
-    if (!m_fileWatcher->files().contains(filePath)) {
-        m_fileWatcher->addPath(filePath);
+    const QString path = QDir::cleanPath(QFileInfo(filePath).absoluteFilePath());
+    if (!m_watchedFiles.contains(path) && FileWatcher::instance()->watchFile(path)) {
+        m_watchedFiles.insert(path);
     }
 }
 
 void FileIO::stopWatchingFile(const QString &filePath)
 {
-    m_fileWatcher->removePath(filePath);
+    const QString path = QDir::cleanPath(QFileInfo(filePath).absoluteFilePath());
+    if (m_watchedFiles.remove(path)) {
+        FileWatcher::instance()->unwatchFile(path);
+    }
 }
 
 QTemporaryFile *FileIO::createTempFile(const QString &pattern)
@@ -276,6 +330,11 @@ QTemporaryFile *FileIO::createTempFile(const QString &pattern)
 
 QString FileIO::calculateFileHash(const QString &filePath, QCryptographicHash::Algorithm method)
 {
+    // Cached until the file changes
+    if (method == QCryptographicHash::Sha256) {
+        return FileHasher::instance()->hash(filePath, FileHasher::Sha256);
+    }
+
     QFile file(filePath);
     if (!file.open(QIODevice::ReadOnly)) {
         return QString();
@@ -288,15 +347,34 @@ QString FileIO::calculateFileHash(const QString &filePath, QCryptographicHash::A
     return QString();
 }
 
-void FileIO::onWatchedFileChanged(const QString &path)
+QString FileIO::calculateFastHash(const QString &filePath)
 {
-    qDebug() << "Watched file changed:" << path;
-    emit fileChangedExternally(path);
+    return FileHasher::instance()->hash(filePath, FileHasher::Fast);
+}
+
+void FileIO::onWatchedFilesChanged(const QVector<FileWatcher::Change> &changes)
+{
+    // One signal per batch; a checkout touching hundreds of open files is one update
+    QStringList changed;
+    for (const FileWatcher::Change &change : changes) {
+        if (m_watchedFiles.contains(change.path)) {
+            changed.append(change.path);
+        }
+    }
+    if (!changed.isEmpty()) {
+        qDebug() << "Watched files changed:" << changed.size();
+        emit filesChangedExternally(changed);
+    }
 }
 
 // বাংলাদেশী ডেভেলপারদের জন্য বিশেষ ইউটিলিটি
 bool FileIO::convertToUnicode(const QString &sourcePath, const QString &destPath, const QString &targetEncoding)
 {
+    // Bijoy to UTF-8 streams through the converter without holding the file twice
+    if (targetEncoding == "UTF-8" && isBijoyFile(sourcePath)) {
+        return BijoyConverter::convertFile(sourcePath, destPath);
+    }
+
     QString content;
     QString sourceEncoding;
     
@@ -304,20 +382,26 @@ bool FileIO::convertToUnicode(const QString &sourcePath, const QString &destPath
         return false;
     }
 
+    // Glyph codes become Unicode first, whatever the target encoding
+    if (sourceEncoding == "Bijoy") {
+        content = BijoyConverter::fromDecodedText(content);
+    }
     return writeTextFile(destPath, content, targetEncoding);
 }
 
-bool FileIO::isBanglaTextFile(const QString &filePath)
+bool FileIO::convertBijoyToUnicode(const QString &input, QString &output)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return false;
-    }
+    output = BijoyConverter::fromDecodedText(input);
+    return true;
+}
 
-    QByteArray data = file.read(1024);
-    file.close();
+bool FileIO::isBinaryFile(const QString &filePath)
+{
+    return FileClassifier::instance()->classify(filePath).binary;
+}
 
-    // Check for Bangla Unicode range
-    return data.contains(BANGLA_UTF8_SIGNATURE) || 
-           QRegularExpression("[ঀ-৿]").match(QString::fromUtf8(data)).hasMatch();
+bool FileIO::isBanglaTextFile(const QString &filePath)
+{
+    // Same cached verdict as isBinaryFile(); asking both reads the file once
+    return FileClassifier::instance()->classify(filePath).isBanglaText();
 }
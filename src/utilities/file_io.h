@@ -7,9 +7,11 @@
 #include <QFileInfoList>
 #include <QByteArray>
 #include <QCryptographicHash>
-#include <QFileSystemWatcher>
+#include <QSet>
 #include <QLockFile>
 #include <QFuture>
+#include "file_watcher.h"
+#include "write_pipeline.h"
 
 /**
  * @brief The FileIO class provides comprehensive file operations
@@ -32,16 +34,27 @@ public:
     bool readTextFile(const QString &filePath, QString &content, QString &detectedEncoding);
     bool writeTextFile(const QString &filePath, const QString &content, 
                       const QString &encoding = "UTF-8", bool backup = false);
+
+    // Several files in one parallel submission (Save All); results in request order
+    struct SaveRequest {
+        QString filePath;
+        QString content;
+        QString encoding = "UTF-8";
+        bool backup = false;
+    };
+    static QFuture<QVector<WritePipeline::Result>> writeTextFiles(const QVector<SaveRequest> &requests);
+    static QByteArray encodeText(const QString &content, const QString &encoding);
     
     // ==================== Encoding Detection ====================
     QString detectEncodingFromContent(const QByteArray &data);
-    bool validateBanglaUtf8(const QString &content);
+    bool validateBanglaUtf8(const QByteArray &data);
     
     // ==================== File System Operations ====================
     bool createDirectory(const QString &path);
     QStringList getFilesInDirectory(const QString &path, 
                                    const QStringList &filters = QStringList(),
-                                   bool recursive = false);
+                                   bool recursive = false,
+                                   bool respectIgnoreFiles = true);
     bool copyFile(const QString &source, const QString &destination, bool overwrite = false);
     bool deleteFile(const QString &filePath);
     bool renameFile(const QString &oldPath, const QString &newPath);
@@ -53,6 +66,8 @@ public:
     QString getFileSizeHumanReadable(qint64 bytes);
     QString calculateFileHash(const QString &filePath, 
                             QCryptographicHash::Algorithm method = QCryptographicHash::Sha256);
+    // 64-bit non-cryptographic digest for change detection
+    QString calculateFastHash(const QString &filePath);
 
     // ==================== Advanced Features ====================
     bool lockFile(const QString &filePath, int timeoutMs = 1000);
@@ -74,15 +89,19 @@ public:
 signals:
     void fileOperationStarted(const QString &operation, const QString &filePath);
     void fileOperationCompleted(const QString &filePath, bool success);
-    void fileChangedExternally(const QString &filePath);
+    // Batched and debounced by FileWatcher
+    void filesChangedExternally(const QStringList &filePaths);
     void encodingDetected(const QString &filePath, const QString &encoding);
     void banglaTextDetected(const QString &filePath);
 
 public slots:
     void cancelAllOperations();
 
+private slots:
+    void onWatchedFilesChanged(const QVector<FileWatcher::Change> &changes);
+
 private:
-    QFileSystemWatcher *m_fileWatcher;
+    QSet<QString> m_watchedFiles;
     QHash<QString, QLockFile*> m_activeLocks;
     
     QString generateBackupName(const QString &originalPath, int version = 0);
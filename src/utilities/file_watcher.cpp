@@ -0,0 +1,577 @@
+#include "file_watcher.h"
+#include "directory_walker.h"
+#include "ignore_matcher.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <cerrno>
+#include <cstring>
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+const int kDefaultDebounceMs = 100;
+// A path that never goes quiet, like a growing log, is still reported this often
+const int kMaxDelayMs = 1000;
+
+#ifdef Q_OS_LINUX
+const uint kDirectoryMask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE
+                          | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+const int kEventBufferBytes = 64 * 1024;
+#endif
+
+QString absolutePath(const QString &path)
+{
+    return QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+}
+
+QString childPath(const QString &directory, const QString &name)
+{
+    return directory.endsWith('/') ? directory + name : directory + '/' + name;
+}
+
+// The root's own ignore files, for directories that appear after the initial walk
+QSharedPointer<const IgnoreMatcher> rootIgnoreMatcher(const QString &root)
+{
+    QVector<QByteArray> contents;
+    for (const char *name : {".gitignore", ".ignore"}) {
+        QFile file(childPath(root, QLatin1String(name)));
+        if (file.open(QIODevice::ReadOnly)) {
+            contents.append(file.readAll());
+        }
+    }
+    if (contents.isEmpty()) {
+        return {};
+    }
+    return QSharedPointer<const IgnoreMatcher>(new IgnoreMatcher({}, QByteArray(), contents));
+}
+
+// Folds a new event into the pending one; false if the two cancel out
+bool coalesce(FileWatcher::ChangeKind &pending, FileWatcher::ChangeKind event)
+{
+    switch (pending) {
+    case FileWatcher::Created:
+        // Created and gone again within the window: a temporary file
+        if (event == FileWatcher::Removed) {
+            return false;
+        }
+        break;
+    case FileWatcher::Removed:
+        // Replaced, e.g. by an atomic save
+        pending = event == FileWatcher::Removed ? FileWatcher::Removed : FileWatcher::Modified;
+        break;
+    case FileWatcher::Modified:
+        pending = event == FileWatcher::Removed || event == FileWatcher::Rescanned ? event : FileWatcher::Modified;
+        break;
+    case FileWatcher::Rescanned:
+        if (event == FileWatcher::Removed) {
+            pending = event;
+        }
+        break;
+    }
+    return true;
+}
+} // namespace
+
+// Singleton instance initialization
+FileWatcher* FileWatcher::m_instance = nullptr;
+QMutex FileWatcher::m_instanceMutex;
+
+FileWatcher* FileWatcher::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+    if (!m_instance) {
+        m_instance = new FileWatcher();
+    }
+    return m_instance;
+}
+
+FileWatcher::FileWatcher(QObject *parent)
+    : QObject(parent),
+      m_timer(new QTimer(this)),
+      m_debounceMs(kDefaultDebounceMs)
+{
+    qRegisterMetaType<FileWatcher::Change>();
+    qRegisterMetaType<QVector<FileWatcher::Change>>("QVector<FileWatcher::Change>");
+    m_clock.start();
+    connect(m_timer, &QTimer::timeout, this, &FileWatcher::flush);
+
+#ifdef Q_OS_LINUX
+    m_inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd >= 0) {
+        m_notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &FileWatcher::readEvents);
+        return;
+    }
+    qWarning() << "inotify unavailable, falling back to QFileSystemWatcher:" << std::strerror(errno);
+#endif
+
+    m_fallback = new QFileSystemWatcher(this);
+    connect(m_fallback, &QFileSystemWatcher::fileChanged, this, [this](const QString &path) {
+        const bool exists = QFileInfo::exists(path);
+        record(path, exists ? Modified : Removed);
+        // Files replaced by a rename drop out of QFileSystemWatcher
+        if (exists && !m_fallback->files().contains(path)) {
+            m_fallback->addPath(path);
+        }
+    });
+    connect(m_fallback, &QFileSystemWatcher::directoryChanged, this, [this](const QString &path) {
+        record(path, Rescanned);
+    });
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef Q_OS_LINUX
+    if (m_inotifyFd >= 0) {
+        ::close(m_inotifyFd);
+    }
+#endif
+}
+
+bool FileWatcher::watchFile(const QString &filePath)
+{
+    const QString path = absolutePath(filePath);
+    const QFileInfo info(path);
+    WatchedDirectory *watched = addDirectory(info.absolutePath());
+    if (!watched) {
+        return false;
+    }
+
+    WatchedFile &file = watched->files[info.fileName()];
+    if (file.references++ == 0) {
+        file.identity = FileIdentity::of(path);
+        if (m_fallback) {
+            m_fallback->addPath(path);
+        }
+    }
+    return true;
+}
+
+void FileWatcher::unwatchFile(const QString &filePath)
+{
+    const QString path = absolutePath(filePath);
+    const QFileInfo info(path);
+    auto directory = m_directories.find(info.absolutePath());
+    if (directory == m_directories.end()) {
+        return;
+    }
+    auto file = directory->files.find(info.fileName());
+    if (file == directory->files.end()) {
+        return;
+    }
+    if (--file->references <= 0) {
+        directory->files.erase(file);
+        if (m_fallback) {
+            m_fallback->removePath(path);
+        }
+        releaseDirectory(info.absolutePath());
+    }
+}
+
+bool FileWatcher::watchDirectory(const QString &directory, bool recursive)
+{
+    const QString path = absolutePath(directory);
+    if (!QFileInfo(path).isDir()) {
+        qWarning() << "Directory does not exist:" << path;
+        return false;
+    }
+
+    if (!recursive) {
+        WatchedDirectory *watched = addDirectory(path);
+        if (!watched) {
+            return false;
+        }
+        if (watched->references++ == 0 && watched->recursiveReferences == 0 && m_fallback) {
+            m_fallback->addPath(path);
+        }
+        return true;
+    }
+
+    if (m_recursiveRootReferences[path]++ == 0) {
+        m_recursiveRoots.insert(path, rootIgnoreMatcher(path));
+    }
+    addTree(path, 1, false);
+    return m_directories.contains(path);
+}
+
+void FileWatcher::unwatchDirectory(const QString &directory, bool recursive)
+{
+    const QString path = absolutePath(directory);
+    if (!recursive) {
+        auto watched = m_directories.find(path);
+        if (watched == m_directories.end() || watched->references <= 0) {
+            return;
+        }
+        if (--watched->references == 0 && watched->recursiveReferences == 0 && m_fallback) {
+            m_fallback->removePath(path);
+        }
+        releaseDirectory(path);
+        return;
+    }
+
+    auto root = m_recursiveRootReferences.find(path);
+    if (root == m_recursiveRootReferences.end()) {
+        return;
+    }
+    if (--*root == 0) {
+        m_recursiveRootReferences.erase(root);
+        m_recursiveRoots.remove(path);
+    }
+
+    const QString prefix = childPath(path, QString());
+    QStringList covered;
+    for (auto it = m_directories.begin(); it != m_directories.end(); ++it) {
+        if (it->recursiveReferences > 0 && (it.key() == path || it.key().startsWith(prefix))) {
+            covered.append(it.key());
+        }
+    }
+    for (const QString &subdirectory : qAsConst(covered)) {
+        WatchedDirectory &watched = m_directories[subdirectory];
+        if (--watched.recursiveReferences == 0 && watched.references == 0 && m_fallback) {
+            m_fallback->removePath(subdirectory);
+        }
+        releaseDirectory(subdirectory);
+    }
+}
+
+void FileWatcher::setDebounceInterval(int milliseconds)
+{
+    m_debounceMs = qMax(0, milliseconds);
+    if (m_timer->isActive()) {
+        m_timer->start(qMax(10, m_debounceMs / 2));
+    }
+}
+
+int FileWatcher::debounceInterval() const
+{
+    return m_debounceMs;
+}
+
+int FileWatcher::kernelWatchCount() const
+{
+    if (m_fallback) {
+        return m_fallback->files().size() + m_fallback->directories().size();
+    }
+    return m_directoryByDescriptor.size();
+}
+
+FileWatcher::WatchedDirectory *FileWatcher::addDirectory(const QString &directory)
+{
+    auto existing = m_directories.find(directory);
+    if (existing != m_directories.end()) {
+        return &*existing;
+    }
+
+    WatchedDirectory watched;
+    watched.identity = FileIdentity::of(directory);
+#ifdef Q_OS_LINUX
+    if (m_inotifyFd >= 0) {
+        const int descriptor = ::inotify_add_watch(m_inotifyFd, QFile::encodeName(directory).constData(), kDirectoryMask);
+        if (descriptor < 0) {
+            if (errno == ENOSPC) {
+                if (!m_watchLimitReached) {
+                    qWarning() << "inotify watch limit reached (fs.inotify.max_user_watches) at" << directory;
+                }
+                m_watchLimitReached = true;
+            } else {
+                qWarning() << "Failed to watch" << directory << std::strerror(errno);
+            }
+            return nullptr;
+        }
+        if (m_directoryByDescriptor.contains(descriptor)) {
+            // The same directory under another path, e.g. through a symlink
+            return nullptr;
+        }
+        watched.descriptor = descriptor;
+        m_directoryByDescriptor.insert(descriptor, directory);
+    }
+#endif
+    return &*m_directories.insert(directory, watched);
+}
+
+void FileWatcher::releaseDirectory(const QString &directory)
+{
+    auto watched = m_directories.find(directory);
+    if (watched == m_directories.end() || watched->references > 0 || watched->recursiveReferences > 0
+        || !watched->files.isEmpty()) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (watched->descriptor >= 0) {
+        ::inotify_rm_watch(m_inotifyFd, watched->descriptor);
+        m_directoryByDescriptor.remove(watched->descriptor);
+        m_watchLimitReached = false;
+    }
+#endif
+    m_directories.erase(watched);
+}
+
+void FileWatcher::addTree(const QString &directory, int recursiveReferences, bool reportContents)
+{
+    // Directories only, unless the tree is new and its files count as created
+    DirectoryWalker::Options options;
+    options.includeHidden = true;
+    options.includeDirectories = true;
+    options.includeFiles = reportContents;
+
+    QStringList directories{directory};
+    QStringList files;
+    DirectoryWalker::walk(directory, options, [&](QVector<DirectoryWalker::Entry> &&batch) {
+        for (const DirectoryWalker::Entry &entry : qAsConst(batch)) {
+            (entry.isDirectory ? directories : files).append(entry.path);
+        }
+    });
+
+    for (const QString &subdirectory : qAsConst(directories)) {
+        WatchedDirectory *watched = addDirectory(subdirectory);
+        if (!watched) {
+            if (m_watchLimitReached) {
+                break;
+            }
+            continue;
+        }
+        const bool wasWatched = watched->references > 0 || watched->recursiveReferences > 0;
+        watched->recursiveReferences += recursiveReferences;
+        if (!wasWatched && m_fallback) {
+            m_fallback->addPath(subdirectory);
+        }
+        if (reportContents && subdirectory != directory) {
+            record(subdirectory, Created);
+        }
+    }
+    for (const QString &file : qAsConst(files)) {
+        record(file, Created);
+    }
+}
+
+void FileWatcher::removeTree(const QString &directory)
+{
+    const QString prefix = childPath(directory, QString());
+    QStringList covered;
+    for (auto it = m_directories.constBegin(); it != m_directories.constEnd(); ++it) {
+        if (it.key() == directory || it.key().startsWith(prefix)) {
+            covered.append(it.key());
+        }
+    }
+    // Watches on moved-away directories would report changes under stale paths
+    for (const QString &subdirectory : qAsConst(covered)) {
+        m_directories[subdirectory].recursiveReferences = 0;
+        releaseDirectory(subdirectory);
+    }
+}
+
+bool FileWatcher::isIgnoredByRoot(const QString &directory) const
+{
+    if (QFileInfo(directory).fileName() == QLatin1String(".git")) {
+        return true;
+    }
+    for (auto root = m_recursiveRoots.constBegin(); root != m_recursiveRoots.constEnd(); ++root) {
+        const QString prefix = childPath(root.key(), QString());
+        if (root.value() && directory.startsWith(prefix)
+            && root.value()->isIgnored(QFile::encodeName(directory.mid(prefix.size())), true)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FileWatcher::readEvents()
+{
+#ifdef Q_OS_LINUX
+    alignas(struct inotify_event) char buffer[kEventBufferBytes];
+    for (;;) {
+        const ssize_t length = ::read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break; // EAGAIN once the queue is drained
+        }
+        for (ssize_t offset = 0; offset < length;) {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+            offset += ssize_t(sizeof(struct inotify_event)) + event->len;
+            handleEvent(event->wd, event->mask, event->len ? QFile::decodeName(event->name) : QString());
+        }
+    }
+#endif
+}
+
+void FileWatcher::handleEvent(int descriptor, uint mask, const QString &name)
+{
+#ifdef Q_OS_LINUX
+    if (mask & IN_Q_OVERFLOW) {
+        recoverFromOverflow();
+        return;
+    }
+    const QString directory = m_directoryByDescriptor.value(descriptor);
+    if (directory.isEmpty()) {
+        return;
+    }
+    auto watched = m_directories.find(directory);
+    if (watched == m_directories.end()) {
+        return;
+    }
+
+    if (mask & IN_IGNORED) {
+        // The kernel dropped the watch: the directory is gone or unmounted
+        m_directoryByDescriptor.remove(descriptor);
+        watched->descriptor = -1;
+        watched->recursiveReferences = 0;
+        releaseDirectory(directory);
+        return;
+    }
+
+    const bool whole = watched->references > 0 || watched->recursiveReferences > 0;
+    if (mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        if (whole) {
+            record(directory, Removed);
+        }
+        return;
+    }
+    if (name.isEmpty() || (!whole && !watched->files.contains(name))) {
+        return;
+    }
+
+    ChangeKind kind = Modified;
+    if (mask & (IN_CREATE | IN_MOVED_TO)) {
+        kind = Created;
+    } else if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        kind = Removed;
+    }
+    const QString path = childPath(directory, name);
+    m_touchedDirectories.insert(directory);
+
+    if (mask & IN_ISDIR) {
+        if (kind == Modified) {
+            return;
+        }
+        // Copied first: addTree() inserts into m_directories
+        const int recursiveReferences = watched->recursiveReferences;
+        if (recursiveReferences > 0) {
+            if (kind == Created && !isIgnoredByRoot(path)) {
+                addTree(path, recursiveReferences, true);
+            } else if (mask & IN_MOVED_FROM) {
+                removeTree(path);
+            }
+        }
+    }
+    record(path, kind);
+#else
+    Q_UNUSED(descriptor) Q_UNUSED(mask) Q_UNUSED(name)
+#endif
+}
+
+void FileWatcher::record(const QString &path, ChangeKind kind)
+{
+    const qint64 now = m_clock.elapsed();
+    auto pending = m_pending.find(path);
+    if (pending == m_pending.end()) {
+        m_pending.insert(path, {kind, now, now});
+    } else if (coalesce(pending->kind, kind)) {
+        pending->lastEventMs = now;
+    } else {
+        m_pending.erase(pending);
+    }
+    ensureTimer();
+}
+
+void FileWatcher::ensureTimer()
+{
+    if (!m_pending.isEmpty() && !m_timer->isActive()) {
+        m_timer->start(qMax(10, m_debounceMs / 2));
+    }
+}
+
+void FileWatcher::flush()
+{
+    const qint64 now = m_clock.elapsed();
+    QVector<Change> changes;
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        if (now - it->lastEventMs >= m_debounceMs || now - it->firstEventMs >= kMaxDelayMs) {
+            changes.append({it.key(), it->kind});
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (m_pending.isEmpty()) {
+        m_timer->stop();
+    }
+    if (changes.isEmpty()) {
+        return;
+    }
+
+    // Baselines for overflow recovery
+    for (const QString &directory : qAsConst(m_touchedDirectories)) {
+        auto watched = m_directories.find(directory);
+        if (watched != m_directories.end()) {
+            watched->identity = FileIdentity::of(directory);
+        }
+    }
+    m_touchedDirectories.clear();
+    for (Change &change : changes) {
+        const QFileInfo info(change.path);
+        auto watched = m_directories.find(info.absolutePath());
+        if (watched == m_directories.end()) {
+            continue;
+        }
+        auto file = watched->files.find(info.fileName());
+        if (file != watched->files.end()) {
+            // A watched file renamed into place (atomic save) existed all along
+            if (change.kind == Created && file->identity.isValid()) {
+                change.kind = Modified;
+            }
+            file->identity = FileIdentity::of(change.path);
+        }
+    }
+
+    emit changed(changes);
+}
+
+void FileWatcher::recoverFromOverflow()
+{
+    qWarning() << "File watcher event queue overflowed; checking watched paths";
+
+    // Copied: addTree() inserts into m_directories
+    const QStringList directories = m_directories.keys();
+    for (const QString &directory : directories) {
+        auto watched = m_directories.find(directory);
+        if (watched == m_directories.end()) {
+            continue;
+        }
+
+        // Watched files are compared one by one, whatever happened to the directory
+        for (auto file = watched->files.constBegin(); file != watched->files.constEnd(); ++file) {
+            const QString path = childPath(directory, file.key());
+            const FileIdentity current = FileIdentity::of(path);
+            if (current != file->identity) {
+                record(path, !current.isValid() ? Removed : (file->identity.isValid() ? Modified : Created));
+            }
+        }
+
+        // Adding, removing or renaming an entry changes the directory's own mtime
+        const FileIdentity current = FileIdentity::of(directory);
+        if (current == watched->identity) {
+            continue;
+        }
+        watched->identity = current;
+        const int recursiveReferences = watched->recursiveReferences;
+        if (watched->references > 0 || recursiveReferences > 0) {
+            record(directory, Rescanned);
+        }
+        if (recursiveReferences > 0 && current.isValid()) {
+            // Subdirectories created while events were lost need watches of their own
+            const QStringList names = QDir(directory).entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden);
+            for (const QString &name : names) {
+                const QString path = childPath(directory, name);
+                if (!m_directories.contains(path) && !isIgnoredByRoot(path)) {
+                    addTree(path, recursiveReferences, true);
+                }
+            }
+        }
+    }
+}
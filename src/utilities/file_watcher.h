@@ -0,0 +1,133 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMetaType>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include "file_identity.h"
+
+class IgnoreMatcher;
+class QFileSystemWatcher;
+class QSocketNotifier;
+class QTimer;
+
+/**
+ * @brief Watches files and directory trees and reports batched changes
+ *
+ * On Linux all watches share one inotify descriptor. Files are watched
+ * through their directory, one kernel watch per directory however many
+ * of its files are of interest, which also keeps atomic saves (write a
+ * temporary file, rename it over the original) visible as a change of the
+ * original path. Recursive watches skip .git and what the root's ignore
+ * files exclude.
+ *
+ * Events are coalesced per path and delivered once a path has been quiet
+ * for the debounce interval, so a git checkout arrives as a few batches
+ * instead of one signal per write; a temporary file created and removed
+ * within the window is not reported at all. When the kernel queue
+ * overflows, watched files are compared with their last known identity
+ * and only directories whose identity changed are reported as Rescanned.
+ * Elsewhere QFileSystemWatcher feeds the same coalescing.
+ *
+ * Watches are reference counted. Use from the GUI thread only.
+ */
+class FileWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum ChangeKind {
+        Created,
+        Modified,
+        Removed,
+        Rescanned  // Events under this directory were lost; re-read it
+    };
+
+    struct Change {
+        QString path;
+        ChangeKind kind = Modified;
+    };
+
+    // Singleton instance access
+    static FileWatcher* instance();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    bool watchFile(const QString &filePath);
+    void unwatchFile(const QString &filePath);
+    bool watchDirectory(const QString &directory, bool recursive = false);
+    void unwatchDirectory(const QString &directory, bool recursive = false);
+
+    void setDebounceInterval(int milliseconds);
+    int debounceInterval() const;
+    int kernelWatchCount() const;
+
+signals:
+    void changed(const QVector<FileWatcher::Change> &changes);
+
+private slots:
+    void readEvents();
+    void flush();
+
+private:
+    explicit FileWatcher(QObject *parent = nullptr);
+    ~FileWatcher() override;
+
+    struct WatchedFile {
+        int references = 0;
+        FileIdentity identity;
+    };
+
+    struct WatchedDirectory {
+        int descriptor = -1;
+        int references = 0;           // Whole-directory watches
+        int recursiveReferences = 0;  // Recursive roots covering it
+        QHash<QString, WatchedFile> files;  // By name
+        FileIdentity identity;
+    };
+
+    struct Pending {
+        ChangeKind kind;
+        qint64 firstEventMs;
+        qint64 lastEventMs;
+    };
+
+    void handleEvent(int descriptor, uint mask, const QString &name);
+    WatchedDirectory *addDirectory(const QString &directory);
+    void releaseDirectory(const QString &directory);
+    void addTree(const QString &directory, int recursiveReferences, bool reportContents);
+    void removeTree(const QString &directory);
+    bool isIgnoredByRoot(const QString &directory) const;
+    void record(const QString &path, ChangeKind kind);
+    void recoverFromOverflow();
+    void ensureTimer();
+
+    int m_inotifyFd = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    QFileSystemWatcher *m_fallback = nullptr;
+    QHash<int, QString> m_directoryByDescriptor;
+    QHash<QString, WatchedDirectory> m_directories;
+    QHash<QString, QSharedPointer<const IgnoreMatcher>> m_recursiveRoots;
+    QHash<QString, int> m_recursiveRootReferences;
+    bool m_watchLimitReached = false;
+
+    QHash<QString, Pending> m_pending;
+    QSet<QString> m_touchedDirectories;
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    int m_debounceMs;
+
+    static FileWatcher* m_instance;
+    static QMutex m_instanceMutex;
+};
+
+Q_DECLARE_METATYPE(FileWatcher::Change)
+
+#endif // FILE_WATCHER_H
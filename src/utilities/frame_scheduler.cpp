@@ -0,0 +1,171 @@
+#include "frame_scheduler.h"
+#include <QElapsedTimer>
+
+namespace {
+const qint64 kDefaultFrameBudgetNs = 4 * 1000 * 1000;
+// Leftover work resumes on the next ~60 Hz frame
+const int kFrameIntervalMs = 16;
+} // namespace
+
+// Singleton instance initialization
+FrameScheduler* FrameScheduler::m_instance = nullptr;
+
+FrameScheduler::FrameScheduler(QObject *parent)
+    : QObject(parent),
+      m_frameBudgetNs(kDefaultFrameBudgetNs)
+{
+    m_frameTimer.setSingleShot(true);
+    connect(&m_frameTimer, &QTimer::timeout, this, &FrameScheduler::runFrame);
+}
+
+FrameScheduler* FrameScheduler::instance()
+{
+    // UI thread only, no locking needed
+    if (!m_instance) {
+        m_instance = new FrameScheduler();
+    }
+    return m_instance;
+}
+
+void FrameScheduler::post(Category category, const QObject *context, Task task)
+{
+    m_queues[category].enqueue({context, context != nullptr, std::move(task), CoalesceKey()});
+    scheduleFrame(0);
+}
+
+void FrameScheduler::postCoalesced(Category category, const QObject *context,
+                                   const QString &key, Task task)
+{
+    const CoalesceKey coalesceKey(contextId(context), key);
+    auto it = m_coalesced.find(coalesceKey);
+    if (it != m_coalesced.end()) {
+        *it = std::move(task);
+        return;
+    }
+
+    m_coalesced.insert(coalesceKey, std::move(task));
+    m_queues[category].enqueue({context, context != nullptr, Task(), coalesceKey});
+    scheduleFrame(0);
+}
+
+quint64 FrameScheduler::contextId(const QObject *context)
+{
+    if (!context) {
+        return 0;
+    }
+    auto it = m_contextIds.find(context);
+    if (it != m_contextIds.end()) {
+        return *it;
+    }
+
+    const quint64 id = m_nextContextId++;
+    m_contextIds.insert(context, id);
+    // Queued slots of a destroyed context find no task and are skipped
+    connect(context, &QObject::destroyed, this, [this, context, id]() {
+        m_contextIds.remove(context);
+        for (auto entry = m_coalesced.begin(); entry != m_coalesced.end();) {
+            entry = entry.key().first == id ? m_coalesced.erase(entry) : entry + 1;
+        }
+    });
+    return id;
+}
+
+bool FrameScheduler::hasPendingWork() const
+{
+    for (const auto &queue : m_queues) {
+        if (!queue.isEmpty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+qint64 FrameScheduler::frameBudget() const
+{
+    return m_frameBudgetNs / 1000;
+}
+
+void FrameScheduler::setFrameBudget(qint64 microseconds)
+{
+    m_frameBudgetNs = qMax<qint64>(1, microseconds) * 1000;
+}
+
+FrameScheduler::Metrics FrameScheduler::metrics(Category category) const
+{
+    return m_metrics[category];
+}
+
+void FrameScheduler::resetMetrics()
+{
+    for (auto &metrics : m_metrics) {
+        metrics = Metrics();
+    }
+}
+
+void FrameScheduler::scheduleFrame(int delayMs)
+{
+    // Work posted from inside a frame waits for the next one
+    if (!m_inFrame && !m_frameTimer.isActive()) {
+        m_frameTimer.start(delayMs);
+    }
+}
+
+void FrameScheduler::runFrame()
+{
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+    m_inFrame = true;
+
+    // Round-robin over categories, one task at a time, until the budget is spent.
+    // At least one task runs per frame so oversized tasks still make progress.
+    bool ranAny = false;
+    bool progress = true;
+    while (progress && (!ranAny || frameTimer.nsecsElapsed() < m_frameBudgetNs)) {
+        progress = false;
+        for (int i = 0; i < CategoryCount; ++i) {
+            if (ranAny && frameTimer.nsecsElapsed() >= m_frameBudgetNs) {
+                break;
+            }
+
+            const int category = (m_firstCategory + i) % CategoryCount;
+            if (m_queues[category].isEmpty()) {
+                continue;
+            }
+
+            PendingTask pending = m_queues[category].dequeue();
+            Task task = pending.key.second.isEmpty()
+                ? std::move(pending.task)
+                : m_coalesced.take(pending.key);
+            progress = true;
+
+            if ((pending.hasContext && !pending.context) || !task) {
+                continue; // Context destroyed while queued
+            }
+
+            QElapsedTimer taskTimer;
+            taskTimer.start();
+            task();
+            const qint64 elapsed = taskTimer.nsecsElapsed();
+            ranAny = true;
+
+            Metrics &metrics = m_metrics[category];
+            ++metrics.runs;
+            metrics.totalNs += elapsed;
+            metrics.maxNs = qMax(metrics.maxNs, elapsed);
+            if (elapsed > m_frameBudgetNs) {
+                ++metrics.overBudget;
+                emit taskOverBudget(Category(category), elapsed / 1000);
+            }
+        }
+    }
+
+    for (int category = 0; category < CategoryCount; ++category) {
+        m_metrics[category].deferred += quint64(m_queues[category].size());
+    }
+    m_firstCategory = (m_firstCategory + 1) % CategoryCount;
+    m_inFrame = false;
+
+    if (hasPendingWork()) {
+        scheduleFrame(qMax(0, kFrameIntervalMs - int(frameTimer.elapsed())));
+    }
+}
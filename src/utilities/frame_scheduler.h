@@ -0,0 +1,106 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <QObject>
+#include <QHash>
+#include <QPair>
+#include <QPointer>
+#include <QQueue>
+#include <QTimer>
+#include <functional>
+
+/**
+ * @brief Cooperative scheduler for deferrable work on the UI thread
+ *
+ * Highlighting sweeps, status bar refreshes, plugin UI callbacks and
+ * decorations post small tasks here instead of running them inline. Each
+ * frame runs queued tasks until the frame budget is spent and leaves the
+ * rest for the next frame, so input events are never starved. Categories
+ * take turns starting a frame to keep one busy producer from blocking the
+ * others.
+ *
+ * Must only be used from the UI thread.
+ */
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Category {
+        Highlighting,
+        Decorations,
+        StatusBar,
+        PluginUi,
+        CategoryCount
+    };
+    Q_ENUM(Category)
+
+    struct Metrics {
+        quint64 runs = 0;
+        qint64 totalNs = 0;
+        qint64 maxNs = 0;
+        quint64 overBudget = 0; // Single tasks longer than a whole frame budget
+        quint64 deferred = 0;   // Tasks pushed to a later frame
+    };
+
+    using Task = std::function<void()>;
+
+    // Singleton instance access
+    static FrameScheduler* instance();
+
+    FrameScheduler(const FrameScheduler&) = delete;
+    FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+    // Tasks are dropped if their context object is destroyed first
+    void post(Category category, const QObject *context, Task task);
+
+    // Replaces a pending task with the same context and key, keeping its slot.
+    // A context's pending tasks go when it is destroyed, so a new object at
+    // the same address never inherits them.
+    void postCoalesced(Category category, const QObject *context, const QString &key, Task task);
+
+    bool hasPendingWork() const;
+
+    // Budget per frame in microseconds (default 4 ms)
+    qint64 frameBudget() const;
+    void setFrameBudget(qint64 microseconds);
+
+    Metrics metrics(Category category) const;
+    void resetMetrics();
+
+signals:
+    void taskOverBudget(FrameScheduler::Category category, qint64 microseconds);
+
+private slots:
+    void runFrame();
+
+private:
+    explicit FrameScheduler(QObject *parent = nullptr);
+
+    // Contexts are told apart by a serial id, not by address
+    using CoalesceKey = QPair<quint64, QString>;
+
+    struct PendingTask {
+        QPointer<const QObject> context;
+        bool hasContext = false;
+        Task task;
+        CoalesceKey key; // Empty key string: not coalesced
+    };
+
+    void scheduleFrame(int delayMs);
+    quint64 contextId(const QObject *context);
+
+    static FrameScheduler* m_instance;
+
+    QQueue<PendingTask> m_queues[CategoryCount];
+    QHash<CoalesceKey, Task> m_coalesced;
+    QHash<const QObject *, quint64> m_contextIds;
+    quint64 m_nextContextId = 1;
+    Metrics m_metrics[CategoryCount];
+    QTimer m_frameTimer;
+    qint64 m_frameBudgetNs;
+    int m_firstCategory = 0;
+    bool m_inFrame = false;
+};
+
+#endif // FRAME_SCHEDULER_H
@@ -0,0 +1,286 @@
+#include "ignore_matcher.h"
+#include <cstring>
+
+namespace {
+inline char foldCase(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+}
+
+bool hasWildcards(const QByteArray &pattern)
+{
+    for (const char c : pattern) {
+        if (c == '*' || c == '?' || c == '[' || c == '\\') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Matches one [...] class at pattern[0]; sets length to the class length, 0 if unterminated
+bool matchClass(const char *pattern, const char *end, char c, bool caseInsensitive, int &length)
+{
+    const char *p = pattern + 1;
+    const bool negated = p < end && (*p == '!' || *p == '^');
+    if (negated) {
+        ++p;
+    }
+    if (caseInsensitive) {
+        c = foldCase(c);
+    }
+
+    bool matched = false;
+    bool first = true;
+    for (; p < end && (*p != ']' || first); first = false) {
+        char low = *p++;
+        if (low == '\\' && p < end) {
+            low = *p++;
+        }
+        char high = low;
+        if (p + 1 < end && *p == '-' && p[1] != ']') {
+            high = p[1];
+            p += 2;
+        }
+        if (caseInsensitive) {
+            low = foldCase(low);
+            high = foldCase(high);
+        }
+        if (c >= low && c <= high) {
+            matched = true;
+        }
+    }
+    if (p >= end) {
+        length = 0;
+        return false;
+    }
+    length = int(p + 1 - pattern);
+    return matched != negated;
+}
+
+bool glob(const char *p, const char *pe, const char *t, const char *te, bool caseInsensitive)
+{
+    while (p < pe) {
+        const char c = *p;
+        if (c == '*') {
+            if (p + 1 < pe && p[1] == '*') {
+                while (p < pe && *p == '*') {
+                    ++p;
+                }
+                if (p < pe && *p == '/') {
+                    // "**/" is zero or more whole directories
+                    ++p;
+                    for (const char *s = t;;) {
+                        if (glob(p, pe, s, te, caseInsensitive)) {
+                            return true;
+                        }
+                        s = static_cast<const char *>(std::memchr(s, '/', size_t(te - s)));
+                        if (!s) {
+                            return false;
+                        }
+                        ++s;
+                    }
+                }
+                // Trailing or inner "**" matches anything, separators included
+                for (const char *s = t; s <= te; ++s) {
+                    if (glob(p, pe, s, te, caseInsensitive)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            ++p;
+            for (const char *s = t;; ++s) {
+                if (glob(p, pe, s, te, caseInsensitive)) {
+                    return true;
+                }
+                if (s == te || *s == '/') {
+                    return false;
+                }
+            }
+        }
+
+        if (t == te) {
+            return false;
+        }
+        if (c == '?') {
+            if (*t == '/') {
+                return false;
+            }
+            ++p;
+            ++t;
+            continue;
+        }
+        if (c == '[') {
+            int length = 0;
+            const bool matched = matchClass(p, pe, *t, caseInsensitive, length);
+            if (length > 0) {
+                if (!matched || *t == '/') {
+                    return false;
+                }
+                p += length;
+                ++t;
+                continue;
+            }
+            // Unterminated: a literal '['
+        }
+
+        char literal = c;
+        if (c == '\\' && p + 1 < pe) {
+            literal = *++p;
+        }
+        if (caseInsensitive ? foldCase(literal) != foldCase(*t) : literal != *t) {
+            return false;
+        }
+        ++p;
+        ++t;
+    }
+    return t == te;
+}
+} // namespace
+
+IgnoreMatcher::IgnoreMatcher(QSharedPointer<const IgnoreMatcher> parent, const QByteArray &base,
+                             const QVector<QByteArray> &contents)
+    : m_parent(parent), m_base(base)
+{
+    for (const QByteArray &content : contents) {
+        parse(content);
+    }
+
+    // Without negations every match means "ignored", so order no longer matters
+    if (!m_hasNegations) {
+        for (const Rule &rule : qAsConst(m_rules)) {
+            if (rule.kind == Literal && !rule.anchored) {
+                (rule.directoryOnly ? m_literalDirectoryNames : m_literalNames).insert(rule.pattern);
+            } else if (rule.kind == Suffix && !rule.directoryOnly) {
+                m_suffixes.append(rule.pattern);
+            } else {
+                m_otherRules.append(rule);
+            }
+        }
+    }
+}
+
+void IgnoreMatcher::parse(const QByteArray &content)
+{
+    for (QByteArray line : content.split('\n')) {
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+        // Trailing spaces are dropped unless escaped
+        while (line.endsWith(' ') && !line.endsWith("\\ ")) {
+            line.chop(1);
+        }
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        Rule rule;
+        if (line.startsWith('!')) {
+            rule.negated = true;
+            line.remove(0, 1);
+        } else if (line.startsWith("\\!") || line.startsWith("\\#")) {
+            line.remove(0, 1);
+        }
+        if (line.endsWith('/')) {
+            rule.directoryOnly = true;
+            line.chop(1);
+        }
+        // A separator anywhere but the end ties the pattern to this directory
+        if (line.contains('/')) {
+            rule.anchored = true;
+            if (line.startsWith('/')) {
+                line.remove(0, 1);
+            }
+        }
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        if (!hasWildcards(line)) {
+            rule.kind = Literal;
+        } else if (!rule.anchored && line.startsWith('*') && !hasWildcards(line.mid(1))) {
+            rule.kind = Suffix;
+            line.remove(0, 1);
+        }
+        rule.pattern = line;
+        m_hasNegations |= rule.negated;
+        m_rules.append(rule);
+    }
+}
+
+bool IgnoreMatcher::isIgnored(const QByteArray &relativePath, bool isDirectory) const
+{
+    const int nameStart = relativePath.lastIndexOf('/') + 1;
+    for (const IgnoreMatcher *level = this; level; level = level->m_parent.data()) {
+        const int verdict = level->matchLevel(relativePath, nameStart, isDirectory);
+        if (verdict >= 0) {
+            return verdict == 1;
+        }
+    }
+    return false;
+}
+
+int IgnoreMatcher::matchLevel(const QByteArray &relativePath, int nameStart, bool isDirectory) const
+{
+    if (m_rules.isEmpty()) {
+        return -1;
+    }
+
+    // Anchored patterns see the path from this level's directory
+    const int baseLength = m_base.isEmpty() ? 0 : m_base.size() + 1;
+    const char *path = relativePath.constData() + baseLength;
+    const int pathLength = relativePath.size() - baseLength;
+    const char *name = relativePath.constData() + nameStart;
+    const int nameLength = relativePath.size() - nameStart;
+
+    if (!m_hasNegations) {
+        const QByteArray nameBytes = QByteArray::fromRawData(name, nameLength);
+        if (m_literalNames.contains(nameBytes) || (isDirectory && m_literalDirectoryNames.contains(nameBytes))) {
+            return 1;
+        }
+        for (const QByteArray &suffix : m_suffixes) {
+            if (nameBytes.endsWith(suffix)) {
+                return 1;
+            }
+        }
+        for (const Rule &rule : m_otherRules) {
+            if ((!rule.directoryOnly || isDirectory) && ruleMatches(rule, path, pathLength, name, nameLength)) {
+                return 1;
+            }
+        }
+        return -1;
+    }
+
+    // Last matching rule wins
+    for (int i = m_rules.size() - 1; i >= 0; --i) {
+        const Rule &rule = m_rules.at(i);
+        if ((!rule.directoryOnly || isDirectory) && ruleMatches(rule, path, pathLength, name, nameLength)) {
+            return rule.negated ? 0 : 1;
+        }
+    }
+    return -1;
+}
+
+bool IgnoreMatcher::ruleMatches(const Rule &rule, const char *path, int pathLength,
+                                const char *name, int nameLength)
+{
+    const char *text = rule.anchored ? path : name;
+    const int textLength = rule.anchored ? pathLength : nameLength;
+    switch (rule.kind) {
+    case Literal:
+        return textLength == rule.pattern.size() && std::memcmp(text, rule.pattern.constData(), size_t(textLength)) == 0;
+    case Suffix:
+        return textLength >= rule.pattern.size()
+            && std::memcmp(text + textLength - rule.pattern.size(), rule.pattern.constData(),
+                           size_t(rule.pattern.size())) == 0;
+    case Glob:
+        return globMatch(rule.pattern.constData(), rule.pattern.size(), text, textLength);
+    }
+    return false;
+}
+
+bool IgnoreMatcher::globMatch(const char *pattern, int patternLength, const char *text, int textLength,
+                              bool caseInsensitive)
+{
+    return glob(pattern, pattern + patternLength, text, text + textLength, caseInsensitive);
+}
@@ -0,0 +1,70 @@
+#ifndef IGNORE_MATCHER_H
+#define IGNORE_MATCHER_H
+
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QSet>
+#include <QVector>
+
+/**
+ * @brief Compiled .gitignore/.ignore rules for one directory level
+ *
+ * Each directory with ignore files gets a matcher chained to its parent's,
+ * so deeper rules take precedence as in git. Within a level the last
+ * matching rule wins and "!" re-includes. Rules are compiled once:
+ * literal names and "*.ext" suffixes are hash lookups when the level has
+ * no negations, and only the remaining patterns go through the glob
+ * matcher. Paths are raw bytes relative to the walk root, as read from
+ * the directory, so nothing is decoded for entries that end up ignored.
+ *
+ * Immutable after construction and safe to share between threads.
+ */
+class IgnoreMatcher
+{
+public:
+    // base: this level's directory relative to the walk root ("" for the root);
+    // contents: the ignore files found there, lowest precedence first
+    IgnoreMatcher(QSharedPointer<const IgnoreMatcher> parent, const QByteArray &base,
+                  const QVector<QByteArray> &contents);
+
+    bool isEmpty() const { return m_rules.isEmpty(); }
+
+    bool isIgnored(const QByteArray &relativePath, bool isDirectory) const;
+
+    // Shell-style glob: * and ? stop at '/', ** crosses directories, [a-z] and [!a-z]
+    static bool globMatch(const char *pattern, int patternLength, const char *text, int textLength,
+                          bool caseInsensitive = false);
+
+private:
+    enum Kind {
+        Literal,  // Whole name or path, no wildcards
+        Suffix,   // "*.ext" on the name
+        Glob
+    };
+
+    struct Rule {
+        QByteArray pattern;
+        Kind kind = Glob;
+        bool negated = false;
+        bool directoryOnly = false;
+        bool anchored = false;  // Matched against the path from base instead of the name
+    };
+
+    // -1 no rule matched, 0 re-included, 1 ignored
+    int matchLevel(const QByteArray &relativePath, int nameStart, bool isDirectory) const;
+    void parse(const QByteArray &content);
+    static bool ruleMatches(const Rule &rule, const char *path, int pathLength,
+                            const char *name, int nameLength);
+
+    QSharedPointer<const IgnoreMatcher> m_parent;
+    QByteArray m_base;
+    QVector<Rule> m_rules;
+    bool m_hasNegations = false;
+    // Fast path for levels without negations
+    QSet<QByteArray> m_literalNames;
+    QSet<QByteArray> m_literalDirectoryNames;
+    QVector<QByteArray> m_suffixes;
+    QVector<Rule> m_otherRules;
+};
+
+#endif // IGNORE_MATCHER_H
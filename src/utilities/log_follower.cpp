@@ -0,0 +1,190 @@
+#include "log_follower.h"
+#include "compression.h"
+#include "encoding_detector.h"
+#include "file_identity.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QTextCodec>
+#include <QTimer>
+
+namespace {
+// A burst of output larger than this is appended over several turns of the
+// event loop instead of stalling the UI in one
+const qint64 kMaxBytesPerPoll = 4 * 1024 * 1024;
+} // namespace
+
+LogFollower::LogFollower(const QString &filePath, const QString &encoding, QObject *parent)
+    : QObject(parent),
+      m_filePath(QDir::cleanPath(QFileInfo(filePath).absoluteFilePath())),
+      m_encoding(encoding.isEmpty() ? QStringLiteral("UTF-8") : encoding)
+{
+    connect(FileWatcher::instance(), &FileWatcher::changed,
+            this, &LogFollower::onWatchedFilesChanged);
+}
+
+LogFollower::~LogFollower()
+{
+    stop();
+}
+
+bool LogFollower::start(qint64 offset)
+{
+    if (m_following) {
+        return true;
+    }
+    if (!open()) {
+        return false;
+    }
+
+    const QByteArray head = m_file.read(8);
+    if (Compression::detect(head.constData(), head.size()) != Compression::None) {
+        qWarning() << "Cannot follow a compressed file:" << m_filePath;
+        m_file.close();
+        return false;
+    }
+    if (!FileWatcher::instance()->watchFile(m_filePath)) {
+        m_file.close();
+        return false;
+    }
+
+    m_following = true;
+    m_offset = qMax<qint64>(0, offset);
+    resetDecoder(m_offset == 0);
+    // Whatever was written since the load; a file now shorter counts as truncated
+    poll();
+    return true;
+}
+
+void LogFollower::stop()
+{
+    if (!m_following) {
+        return;
+    }
+    m_following = false;
+    FileWatcher::instance()->unwatchFile(m_filePath);
+    m_file.close();
+    m_decoder.reset();
+}
+
+bool LogFollower::isFollowing() const
+{
+    return m_following;
+}
+
+QString LogFollower::filePath() const
+{
+    return m_filePath;
+}
+
+qint64 LogFollower::offset() const
+{
+    return m_offset;
+}
+
+void LogFollower::onWatchedFilesChanged(const QVector<FileWatcher::Change> &changes)
+{
+    if (!m_following) {
+        return;
+    }
+    for (const FileWatcher::Change &change : changes) {
+        if (change.path == m_filePath) {
+            poll();
+            return;
+        }
+    }
+}
+
+void LogFollower::poll()
+{
+    m_pollQueued = false;
+    if (!m_following) {
+        return;
+    }
+
+    // Rotated once the path names another file; while it names none, the
+    // old file may still be written to and stays followed
+    const FileIdentity current = FileIdentity::of(m_filePath);
+    const FileIdentity followed = m_file.isOpen() ? FileIdentity::of(m_file.handle()) : FileIdentity();
+    const bool rotated = current.isValid()
+        && (!followed.isValid() || current.device != followed.device || current.inode != followed.inode);
+
+    if (followed.isValid()) {
+        if (followed.size < m_offset) {
+            // Truncated in place, e.g. by copytruncate or a shell redirection
+            m_offset = 0;
+            resetDecoder(true);
+            emit restarted(Truncated);
+            if (!m_following) {
+                return;
+            }
+        }
+        // The tail of the old file comes before the new one
+        if (!readAvailable(followed.size) || !m_following) {
+            return;
+        }
+    }
+    if (!rotated) {
+        return;
+    }
+
+    m_file.close();
+    if (!open()) {
+        return; // Retried on the next change
+    }
+    m_offset = 0;
+    resetDecoder(true);
+    emit restarted(Rotated);
+    if (m_following) {
+        readAvailable(FileIdentity::of(m_file.handle()).size);
+    }
+}
+
+bool LogFollower::open()
+{
+    m_file.setFileName(m_filePath);
+    // Unbuffered, so every read sees the file as it is now
+    if (!m_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        qWarning() << "Cannot follow" << m_filePath << ":" << m_file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void LogFollower::resetDecoder(bool atStart)
+{
+    // A byte order mark can only be at the start; mid-file there is none to drop
+    QTextCodec *codec = EncodingDetector::codecFor(m_encoding);
+    m_decoder.reset(codec->makeDecoder(atStart ? QTextCodec::DefaultConversion : QTextCodec::IgnoreHeader));
+}
+
+// Reads the bytes between the offset and size; false if some were left for a queued poll
+bool LogFollower::readAvailable(qint64 size)
+{
+    const qint64 end = qMin(size, m_offset + kMaxBytesPerPoll);
+    if (end > m_offset) {
+        if (!m_file.seek(m_offset)) {
+            qWarning() << "Cannot follow" << m_filePath << ":" << m_file.errorString();
+            return true;
+        }
+        const QByteArray bytes = m_file.read(end - m_offset);
+        if (bytes.isEmpty()) {
+            return true;
+        }
+        m_offset += bytes.size();
+        // Partial characters at the end stay in the decoder until the next read
+        const QString text = m_decoder->toUnicode(bytes.constData(), bytes.size());
+        if (!text.isEmpty()) {
+            emit appended(text);
+        }
+    }
+
+    if (m_offset < size && m_following) {
+        if (!m_pollQueued) {
+            m_pollQueued = true;
+            QTimer::singleShot(0, this, &LogFollower::poll);
+        }
+        return false;
+    }
+    return true;
+}
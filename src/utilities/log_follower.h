@@ -0,0 +1,73 @@
+#ifndef LOG_FOLLOWER_H
+#define LOG_FOLLOWER_H
+
+#include <QFile>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include "file_watcher.h"
+
+class QTextDecoder;
+
+/**
+ * @brief Follows a growing file like tail -F, reading only what was appended
+ *
+ * Changes arrive through FileWatcher. When the file has grown, only the
+ * bytes past the last offset are read and decoded; the decoder is
+ * stateful, so a character split across two writes still comes out whole.
+ *
+ * The file stays open between reads. When the path starts naming another
+ * file (log rotation), whatever was written to the old file before the
+ * switch is read first, then the new file is followed from its start. A
+ * file that shrinks in place was truncated and is also followed from its
+ * start. Both emit restarted() before any text of the new content. While
+ * the path does not exist the old file keeps being followed.
+ *
+ * Compressed files cannot be followed. Use from the GUI thread only.
+ */
+class LogFollower : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum RestartReason {
+        Truncated,
+        Rotated
+    };
+
+    // encoding as reported by EncodingDetector; empty means UTF-8
+    explicit LogFollower(const QString &filePath, const QString &encoding = QString(),
+                         QObject *parent = nullptr);
+    ~LogFollower() override;
+
+    // offset is how much of the file is already shown, normally its size at load time
+    bool start(qint64 offset);
+    void stop();
+    bool isFollowing() const;
+    QString filePath() const;
+    qint64 offset() const;
+
+signals:
+    void appended(const QString &text);
+    void restarted(LogFollower::RestartReason reason);
+
+private slots:
+    void onWatchedFilesChanged(const QVector<FileWatcher::Change> &changes);
+    void poll();
+
+private:
+    bool open();
+    void resetDecoder(bool atStart);
+    bool readAvailable(qint64 size);
+
+    const QString m_filePath;
+    const QString m_encoding;
+    QFile m_file;
+    qint64 m_offset = 0;
+    std::unique_ptr<QTextDecoder> m_decoder;
+    bool m_following = false;
+    bool m_pollQueued = false;
+};
+
+#endif // LOG_FOLLOWER_H
@@ -48,6 +48,8 @@ SettingsManager::SettingsManager(QObject *parent)
     setDefault("auto_save/interval", 5); // minutes
     setDefault("cloud_sync/enabled", false);
     setDefault("cloud_sync/last_sync", QDateTime());
+    setDefault("Core/save_durability", "fdatasync"); // none, fdatasync or fsync
+    setDefault("Core/backup_before_save", true);
     setDefault("version", m_settingsVersion);
 }
 
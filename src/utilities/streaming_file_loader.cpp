@@ -0,0 +1,161 @@
+#include "streaming_file_loader.h"
+#include "compression.h"
+#include "encoding_detector.h"
+#include "file_identity.h"
+#include "utf8.h"
+#include <QDebug>
+#include <QFile>
+#include <QTextCodec>
+#include <QtConcurrent>
+#include <memory>
+
+namespace {
+// Enough for the first screen of almost any file; decoded in well under a millisecond
+const qint64 kFirstChunkBytes = 64 * 1024;
+// Later chunks stay small enough that appending one does not stall the UI
+const qint64 kChunkBytes = 1024 * 1024;
+// Decoded chunks waiting in the receiver's event queue; more would only
+// pile up memory while the UI thread is busy appending
+const int kMaxChunksInFlight = 2;
+// How often a worker waiting for a slot checks for cancellation
+const int kSlotWaitMs = 100;
+} // namespace
+
+StreamingFileLoader::StreamingFileLoader(const QString &filePath, QObject *parent)
+    : QObject(parent),
+      m_filePath(filePath),
+      m_chunkSlots(kMaxChunksInFlight)
+{
+}
+
+StreamingFileLoader::~StreamingFileLoader()
+{
+    cancel();
+    m_future.waitForFinished();
+}
+
+void StreamingFileLoader::start()
+{
+    if (isRunning()) {
+        return;
+    }
+    m_cancelled = false;
+    m_future = QtConcurrent::run([this]() { run(); });
+}
+
+void StreamingFileLoader::cancel()
+{
+    m_cancelled = true;
+}
+
+void StreamingFileLoader::chunkConsumed()
+{
+    m_chunkSlots.release();
+}
+
+bool StreamingFileLoader::isRunning() const
+{
+    return m_future.isRunning();
+}
+
+QString StreamingFileLoader::filePath() const
+{
+    return m_filePath;
+}
+
+void StreamingFileLoader::run()
+{
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "File open error:" << file.errorString();
+        emit finished(false);
+        return;
+    }
+
+    // Compressed files are decompressed once into the cache and mapped from there
+    const QByteArray head = file.peek(8);
+    if (Compression::detect(head.constData(), head.size()) != Compression::None) {
+        QString error;
+        const QString copyPath = Compression::decompressedCopy(m_filePath, &error);
+        file.close();
+        file.setFileName(copyPath);
+        if (copyPath.isEmpty() || m_cancelled || !file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Cannot decompress" << m_filePath << ":" << error;
+            emit finished(false);
+            return;
+        }
+    }
+
+    const qint64 size = file.size();
+    QByteArray buffer;
+    uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+    if (!mapped) {
+        buffer = file.readAll();
+    }
+    const char *data = mapped ? reinterpret_cast<const char *>(mapped) : buffer.constData();
+    const qint64 length = mapped ? size : buffer.size();
+
+    QString encoding;
+    qint64 position = EncodingDetector::byteOrderMark(data, length, encoding);
+    if (position == 0) {
+        encoding = EncodingDetector::instance()->detect(FileIdentity::of(file.handle()), data, length).encoding;
+    }
+
+    // UTF-8 goes through the fast decoder; everything else through a
+    // stateful codec decoder, which carries partial characters across chunks
+    std::unique_ptr<QTextDecoder> decoder;
+    if (encoding != QLatin1String("UTF-8")) {
+        QTextCodec *codec = EncodingDetector::codecFor(encoding);
+        // Bijoy is kept so the tab knows its text still needs converting
+        if (encoding != QLatin1String("Bijoy")) {
+            encoding = QString::fromLatin1(codec->name());
+        }
+        decoder.reset(codec->makeDecoder(QTextCodec::IgnoreHeader));
+    }
+    emit started(encoding, length);
+
+    qint64 chunkBytes = kFirstChunkBytes;
+    bool first = true;
+    do {
+        // Wait until the receiver has caught up
+        while (!m_chunkSlots.tryAcquire(1, kSlotWaitMs)) {
+            if (m_cancelled) {
+                return;
+            }
+        }
+        if (m_cancelled) {
+            return;
+        }
+
+        qint64 end = qMin(length, position + chunkBytes);
+        QString text;
+        if (!decoder) {
+            // Never cut inside a sequence; continuation bytes are 10xxxxxx and
+            // a valid sequence has at most three of them
+            const qint64 chunkEnd = end;
+            for (int i = 0; i < 3 && end < length && end > position && (uchar(data[end]) & 0xC0) == 0x80; ++i) {
+                --end;
+            }
+            // Still on a continuation byte: no lead byte where one must be
+            const bool cutInvalid = end < length && (uchar(data[end]) & 0xC0) == 0x80;
+            if (cutInvalid || !Utf8::decode(data + position, end - position, text)) {
+                // Earlier chunks are already published, so the encoding stays
+                qWarning() << "Invalid UTF-8 in" << m_filePath << "after byte" << position
+                           << "- decoding the rest with replacement characters";
+                decoder.reset(QTextCodec::codecForName("UTF-8")->makeDecoder());
+                end = chunkEnd;
+            }
+        }
+        if (decoder) {
+            text = decoder->toUnicode(data + position, int(end - position));
+        }
+        position = end;
+
+        emit chunkDecoded(text, first);
+        emit progress(position, length);
+        first = false;
+        chunkBytes = kChunkBytes;
+    } while (position < length);
+
+    emit finished(true);
+}
@@ -0,0 +1,57 @@
+#ifndef STREAMING_FILE_LOADER_H
+#define STREAMING_FILE_LOADER_H
+
+#include <QFuture>
+#include <QObject>
+#include <QSemaphore>
+#include <QString>
+#include <atomic>
+
+/**
+ * @brief Decodes a file in chunks on a worker thread
+ *
+ * The file is mapped, its encoding detected like FileIO::readTextFile, and
+ * then decoded front to back; a compressed file is decompressed once into
+ * the cache and that copy is mapped instead. A small first chunk is
+ * published right away so the first screen can be shown, followed by
+ * larger chunks that the receiver appends to the end of its buffer.
+ * Chunks split the text at arbitrary characters (never inside one), so
+ * they concatenate to exactly the decoded file.
+ *
+ * Signals are emitted from the worker and queued to receivers. Only a few
+ * chunks may be queued at a time: the receiver calls chunkConsumed() once
+ * it has appended one, and the worker waits for that before decoding more.
+ * Cancelling stops the worker before its next chunk; destroying the loader
+ * cancels and waits for it.
+ */
+class StreamingFileLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit StreamingFileLoader(const QString &filePath, QObject *parent = nullptr);
+    ~StreamingFileLoader() override;
+
+    void start();
+    void cancel();
+    // Called by the receiver after each chunkDecoded(), from any thread
+    void chunkConsumed();
+    bool isRunning() const;
+    QString filePath() const;
+
+signals:
+    void started(const QString &encoding, qint64 totalBytes);
+    void chunkDecoded(const QString &text, bool first);
+    void progress(qint64 bytesDone, qint64 totalBytes);
+    void finished(bool success);
+
+private:
+    void run();
+
+    const QString m_filePath;
+    std::atomic<bool> m_cancelled{false};
+    QSemaphore m_chunkSlots;
+    QFuture<void> m_future;
+};
+
+#endif // STREAMING_FILE_LOADER_H
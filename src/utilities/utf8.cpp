@@ -0,0 +1,170 @@
+#include "utf8.h"
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+// Reads one multi-byte sequence starting at data[i]; returns its length or 0 if invalid
+inline int readSequence(const uchar *data, qint64 i, qint64 size, uint &codePoint)
+{
+    const uint lead = data[i];
+    int length;
+    uint minimum;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        codePoint = lead & 0x1F;
+        minimum = 0x80;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        codePoint = lead & 0x0F;
+        minimum = 0x800;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        codePoint = lead & 0x07;
+        minimum = 0x10000;
+    } else {
+        return 0; // Stray continuation byte, overlong C0/C1 or out of range lead
+    }
+
+    if (size - i < length) {
+        return 0;
+    }
+    for (int k = 1; k < length; ++k) {
+        const uint next = data[i + k];
+        if ((next & 0xC0) != 0x80) {
+            return 0;
+        }
+        codePoint = (codePoint << 6) | (next & 0x3F);
+    }
+    if (codePoint < minimum || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+        return 0;
+    }
+    return length;
+}
+
+#ifdef __SSE2__
+// Number of leading ASCII bytes in the 16 at data, 16 if all are
+inline int asciiPrefix(const uchar *data)
+{
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    const uint nonAscii = uint(_mm_movemask_epi8(chunk));
+    return nonAscii ? int(qCountTrailingZeroBits(nonAscii)) : 16;
+}
+#endif
+} // namespace
+
+namespace Utf8 {
+
+qint64 decode(const char *data, qint64 size, ushort *out)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    ushort *const begin = out;
+    qint64 i = 0;
+
+    while (i < size) {
+#ifdef __SSE2__
+        // Widen 16 ASCII bytes per step; out never runs ahead of i, so the stores fit
+        const __m128i zero = _mm_setzero_si128();
+        while (i + 16 <= size) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+            const uint nonAscii = uint(_mm_movemask_epi8(chunk));
+            if (nonAscii) {
+                // Copy the ASCII prefix, then decode the sequence scalar
+                const int prefix = int(qCountTrailingZeroBits(nonAscii));
+                for (int k = 0; k < prefix; ++k) {
+                    *out++ = bytes[i + k];
+                }
+                i += prefix;
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpackhi_epi8(chunk, zero));
+            i += 16;
+            out += 16;
+        }
+        if (i >= size) {
+            break;
+        }
+#endif
+        if (bytes[i] < 0x80) {
+            *out++ = bytes[i++];
+            continue;
+        }
+        uint codePoint;
+        const int length = readSequence(bytes, i, size, codePoint);
+        if (length == 0) {
+            return -1;
+        }
+        if (codePoint >= 0x10000) {
+            codePoint -= 0x10000;
+            *out++ = ushort(0xD800 | (codePoint >> 10));
+            *out++ = ushort(0xDC00 | (codePoint & 0x3FF));
+        } else {
+            *out++ = ushort(codePoint);
+        }
+        i += length;
+    }
+    return out - begin;
+}
+
+ScanResult scan(const char *data, qint64 size)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    ScanResult result;
+    qint64 i = 0;
+
+    while (i < size) {
+#ifdef __SSE2__
+        // Skip 16 ASCII bytes per step
+        while (i + 16 <= size) {
+            const int prefix = asciiPrefix(bytes + i);
+            i += prefix;
+            if (prefix < 16) {
+                break;
+            }
+        }
+        if (i >= size) {
+            break;
+        }
+#endif
+        if (bytes[i] < 0x80) {
+            ++i;
+            continue;
+        }
+
+        result.ascii = false;
+        uint codePoint;
+        const int length = readSequence(bytes, i, size, codePoint);
+        if (length == 0) {
+            result.valid = false;
+            result.errorOffset = i;
+            break;
+        }
+        // U+0980..U+09FF is E0 A6 80 .. E0 A7 BF
+        if (codePoint >= 0x0980 && codePoint <= 0x09FF) {
+            result.hasBengali = true;
+        }
+        i += length;
+    }
+    return result;
+}
+
+bool decode(const char *data, qint64 size, QString &content)
+{
+    if (maxDecodedLength(size) > std::numeric_limits<int>::max()) {
+        content.clear();
+        return false;
+    }
+
+    content.resize(int(maxDecodedLength(size)));
+    const qint64 length = decode(data, size, reinterpret_cast<ushort *>(content.data()));
+    if (length < 0) {
+        content.clear();
+        return false;
+    }
+    content.truncate(int(length));
+    return true;
+}
+
+} // namespace Utf8
@@ -0,0 +1,42 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief Fast UTF-8 to UTF-16 decoding for file loading
+ *
+ * scan() validates raw bytes and reports Bengali text before anything is
+ * decoded; decode() writes straight into the destination buffer and
+ * validates while it goes. Runs of ASCII are widened 16 bytes at a
+ * time with SSE2, which is what keeps source files close to memcpy speed.
+ * Unlike QTextCodec, invalid input is reported instead of being replaced,
+ * so callers can fall back to a legacy codec on the same bytes.
+ */
+namespace Utf8 {
+
+struct ScanResult {
+    bool valid = true;        // Well-formed UTF-8 (no overlongs, surrogates or truncation)
+    bool ascii = true;        // Only 7-bit bytes
+    bool hasBengali = false;  // Code points in the Bengali block U+0980..U+09FF
+    qint64 errorOffset = -1;  // Byte offset of the first invalid sequence
+};
+
+// Validates raw bytes without decoding them; stops at the first error
+ScanResult scan(const char *data, qint64 size);
+
+// Upper bound of UTF-16 units produced by decoding size bytes
+inline qint64 maxDecodedLength(qint64 size) { return size; }
+
+// Decodes size bytes into out, which must hold maxDecodedLength(size) units.
+// Returns the number of units written, or -1 at the first invalid,
+// overlong or truncated sequence.
+qint64 decode(const char *data, qint64 size, ushort *out);
+
+// Replaces content with the decoded bytes; false (content cleared) if invalid
+bool decode(const char *data, qint64 size, QString &content);
+
+} // namespace Utf8
+
+#endif // UTF8_H
@@ -0,0 +1,427 @@
+#include "write_pipeline.h"
+#include "copy_strategy.h"
+#include "settings.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+#include <QtConcurrent>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef MANGO_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace {
+// Compresses the requests that ask for it, in parallel; one error per
+// request, empty where it succeeded or nothing was to be done
+QVector<QString> compressAll(QVector<WritePipeline::Request> &requests)
+{
+    QVector<QString> errors(requests.size());
+    QVector<int> indices;
+    for (int i = 0; i < requests.size(); ++i) {
+        if (requests.at(i).compression != Compression::None) {
+            indices.append(i);
+        }
+    }
+    if (indices.isEmpty()) {
+        return errors;
+    }
+
+    // Detach before the workers write to their own elements
+    requests.detach();
+    std::function<void(int &)> compress = [&](int &i) {
+        WritePipeline::Request &request = requests[i];
+        QByteArray compressed;
+        if (Compression::compress(request.data, request.compression, compressed, &errors[i])) {
+            request.data = compressed;
+        } else if (errors[i].isEmpty()) {
+            errors[i] = QStringLiteral("%1 compression failed").arg(Compression::name(request.compression));
+        }
+    };
+    QtConcurrent::blockingMap(indices, compress);
+    return errors;
+}
+
+void makeBackup(const QString &filePath)
+{
+    if (!QFile::exists(filePath)) {
+        return;
+    }
+    // A reflink on btrfs/xfs, so backups cost no data copy; replaces any old .bak
+    const QString backupPath = filePath + ".bak";
+    if (!CopyStrategy::copyFile(filePath, backupPath)) {
+        qWarning() << "Failed to create backup file" << backupPath;
+    }
+}
+
+#ifdef Q_OS_UNIX
+// One file on its way through the pipeline
+struct Job {
+    QByteArray path;      // Encoded target path
+    QByteArray tempPath;  // Empty until the temporary file exists
+    int fd = -1;
+    qint64 written = 0;
+    bool synced = false;
+    QString error;
+};
+
+QString systemError(const char *operation, int error)
+{
+    return QStringLiteral("%1: %2").arg(QLatin1String(operation), QString::fromLocal8Bit(std::strerror(error)));
+}
+
+mode_t defaultMode()
+{
+    // umask can only be read by setting it; done once, before any save runs in parallel
+    static const mode_t mask = []() {
+        const mode_t current = ::umask(0);
+        ::umask(current);
+        return current;
+    }();
+    return 0666 & ~mask;
+}
+
+// Creates the temporary sibling, with the target's owner and permissions
+bool prepare(const WritePipeline::Request &request, Job &job)
+{
+    job.path = QFile::encodeName(request.filePath);
+    // A symlink keeps pointing at the file it named; the rename replaces the
+    // link's target, next to which the temporary file must be created
+    if (char *resolved = ::realpath(job.path.constData(), nullptr)) {
+        job.path = resolved;
+        ::free(resolved);
+    }
+    QByteArray tempPath = job.path + ".mango-save-XXXXXX";
+    job.fd = ::mkstemp(tempPath.data());
+    if (job.fd < 0) {
+        job.error = systemError("create", errno);
+        return false;
+    }
+    job.tempPath = tempPath;
+
+    struct stat info;
+    if (::stat(job.path.constData(), &info) != 0) {
+        ::fchmod(job.fd, defaultMode());
+        return true;
+    }
+    // Before fchmod, which chown may undo for setuid/setgid bits. Only root
+    // can give the file away; the group still carries over for its members.
+    if ((info.st_uid != ::geteuid() || info.st_gid != ::getegid())
+        && ::fchown(job.fd, info.st_uid, info.st_gid) != 0
+        && ::fchown(job.fd, uid_t(-1), info.st_gid) != 0) {
+        qWarning() << "Cannot keep the owner of" << request.filePath << std::strerror(errno);
+    }
+    ::fchmod(job.fd, info.st_mode & 07777);
+    return true;
+}
+
+bool writeRemaining(Job &job, const QByteArray &data)
+{
+    while (job.written < data.size()) {
+        const ssize_t count = ::pwrite(job.fd, data.constData() + job.written,
+                                       size_t(data.size() - job.written), off_t(job.written));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            job.error = systemError("write", errno);
+            return false;
+        }
+        job.written += count;
+    }
+    return true;
+}
+
+bool syncFile(Job &job, WritePipeline::Durability durability)
+{
+    if (job.synced || durability == WritePipeline::NoSync) {
+        return true;
+    }
+#ifdef Q_OS_LINUX
+    const int status = durability == WritePipeline::DataSync ? ::fdatasync(job.fd) : ::fsync(job.fd);
+#else
+    const int status = ::fsync(job.fd);
+#endif
+    if (status != 0) {
+        job.error = systemError("sync", errno);
+        return false;
+    }
+    job.synced = true;
+    return true;
+}
+
+bool commit(Job &job, const WritePipeline::Request &request)
+{
+    const int fd = job.fd;
+    job.fd = -1;
+    if (::close(fd) != 0) {
+        job.error = systemError("close", errno);
+        return false;
+    }
+    if (request.backup) {
+        makeBackup(request.filePath);
+    }
+    if (::rename(job.tempPath.constData(), job.path.constData()) != 0) {
+        job.error = systemError("rename", errno);
+        return false;
+    }
+    job.tempPath.clear();
+    return true;
+}
+
+void discard(Job &job)
+{
+    if (job.fd >= 0) {
+        ::close(job.fd);
+        job.fd = -1;
+    }
+    if (!job.tempPath.isEmpty()) {
+        ::unlink(job.tempPath.constData());
+    }
+}
+
+// Makes the renames themselves durable
+void syncDirectories(const QSet<QString> &directories)
+{
+    for (const QString &directory : directories) {
+        const int fd = ::open(QFile::encodeName(directory).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0 || ::fsync(fd) != 0) {
+            qWarning() << "Failed to sync directory" << directory << std::strerror(errno);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+#ifdef MANGO_HAVE_LIBURING
+const unsigned kRingEntries = 256;
+// Largest write handed to the ring; the rest is finished with pwrite()
+const qint64 kMaxRingWrite = qint64(1) << 30;
+
+/**
+ * Submits every file's write, each linked to its fsync, and reaps all
+ * completions. Short writes break the link; writeRemaining() and
+ * syncFile() finish those afterwards. Returns false if no ring could be
+ * set up, leaving every job untouched.
+ */
+bool writeWithRing(QVector<Job> &jobs, const QVector<WritePipeline::Request> &requests,
+                   WritePipeline::Durability durability)
+{
+    struct io_uring ring;
+    if (io_uring_queue_init(kRingEntries, &ring, 0) < 0) {
+        return false;
+    }
+
+    int inFlight = 0;
+    auto reap = [&]() {
+        while (inFlight > 0) {
+            struct io_uring_cqe *cqe = nullptr;
+            const int status = io_uring_wait_cqe(&ring, &cqe);
+            if (status == -EINTR) {
+                continue;
+            }
+            if (status < 0) {
+                break; // Leaves the remaining jobs to the synchronous path
+            }
+            const quint64 tag = cqe->user_data;
+            Job &job = jobs[int(tag >> 1)];
+            const bool isSync = tag & 1;
+            if (cqe->res < 0 && cqe->res != -ECANCELED) {
+                job.error = systemError(isSync ? "sync" : "write", -cqe->res);
+            } else if (isSync) {
+                job.synced = cqe->res == 0 && job.written == requests.at(int(tag >> 1)).data.size();
+            } else if (cqe->res > 0) {
+                job.written = cqe->res;
+            }
+            io_uring_cqe_seen(&ring, cqe);
+            --inFlight;
+        }
+    };
+
+    const bool linkSync = durability != WritePipeline::NoSync;
+    for (int i = 0; i < jobs.size(); ++i) {
+        if (jobs[i].fd < 0) {
+            continue;
+        }
+        // A write and its fsync must go in the same submission to stay linked
+        if (io_uring_sq_space_left(&ring) < 2 || inFlight + 2 > int(kRingEntries)) {
+            io_uring_submit(&ring);
+            reap();
+        }
+
+        const QByteArray &data = requests.at(i).data;
+        struct io_uring_sqe *write = io_uring_get_sqe(&ring);
+        io_uring_prep_write(write, jobs[i].fd, data.constData(), unsigned(qMin<qint64>(data.size(), kMaxRingWrite)), 0);
+        write->user_data = quint64(i) << 1;
+        ++inFlight;
+
+        // A capped write completes in full and would not break the link, so
+        // the fsync would run before the rest is written by writeRemaining()
+        if (linkSync && data.size() <= kMaxRingWrite) {
+            write->flags |= IOSQE_IO_LINK;
+            struct io_uring_sqe *sync = io_uring_get_sqe(&ring);
+            io_uring_prep_fsync(sync, jobs[i].fd, durability == WritePipeline::DataSync ? IORING_FSYNC_DATASYNC : 0);
+            sync->user_data = (quint64(i) << 1) | 1;
+            ++inFlight;
+        }
+    }
+    io_uring_submit(&ring);
+    reap();
+    io_uring_queue_exit(&ring);
+    return true;
+}
+#endif // MANGO_HAVE_LIBURING
+#endif // Q_OS_UNIX
+} // namespace
+
+// Singleton instance initialization
+WritePipeline* WritePipeline::m_instance = nullptr;
+QMutex WritePipeline::m_instanceMutex;
+
+WritePipeline* WritePipeline::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+    if (!m_instance) {
+        qRegisterMetaType<WritePipeline::Result>();
+        m_instance = new WritePipeline();
+    }
+    return m_instance;
+}
+
+QFuture<QVector<WritePipeline::Result>> WritePipeline::submit(const QVector<Request> &requests, Durability durability)
+{
+    return QtConcurrent::run(&WritePipeline::run, requests, durability);
+}
+
+QFuture<QVector<WritePipeline::Result>> WritePipeline::submit(const QVector<Request> &requests)
+{
+    return submit(requests, defaultDurability());
+}
+
+WritePipeline::Durability WritePipeline::defaultDurability()
+{
+    const QString value = SettingsManager::instance()->get("Core/save_durability", "fdatasync").toString();
+    if (value == "none") {
+        return NoSync;
+    }
+    if (value == "fsync") {
+        return FullSync;
+    }
+    return DataSync;
+}
+
+bool WritePipeline::hasIoUring()
+{
+#ifdef MANGO_HAVE_LIBURING
+    // Kernels without io_uring, or with it disabled, fall back to the thread pool
+    static const bool available = []() {
+        struct io_uring ring;
+        if (io_uring_queue_init(1, &ring, 0) < 0) {
+            return false;
+        }
+        io_uring_queue_exit(&ring);
+        return true;
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+QVector<WritePipeline::Result> WritePipeline::run(QVector<Request> requests, Durability durability)
+{
+    QVector<Result> results(requests.size());
+    for (int i = 0; i < requests.size(); ++i) {
+        results[i].filePath = requests.at(i).filePath;
+    }
+    const QVector<QString> compressionErrors = compressAll(requests);
+
+#ifdef Q_OS_UNIX
+    QVector<Job> jobs(requests.size());
+    for (int i = 0; i < requests.size(); ++i) {
+        // Without a temporary file the job is skipped and reports its error
+        if (compressionErrors.at(i).isEmpty()) {
+            prepare(requests.at(i), jobs[i]);
+        } else {
+            jobs[i].error = compressionErrors.at(i);
+        }
+    }
+
+    bool submitted = false;
+#ifdef MANGO_HAVE_LIBURING
+    submitted = writeWithRing(jobs, requests, durability);
+#endif
+
+    // After the ring this only finishes short writes and renames; without
+    // it, each file is written and synced here
+    std::function<void(int &)> finish = [&](int &i) {
+        Job &job = jobs[i];
+        if (job.fd >= 0 && job.error.isEmpty() && writeRemaining(job, requests.at(i).data)
+            && syncFile(job, durability) && commit(job, requests.at(i))) {
+            results[i].success = true;
+        } else {
+            discard(job);
+            results[i].error = job.error;
+        }
+    };
+    QVector<int> indices(requests.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    if (submitted) {
+        std::for_each(indices.begin(), indices.end(), finish);
+    } else {
+        QtConcurrent::blockingMap(indices, finish);
+    }
+
+    if (durability == FullSync) {
+        // Where the renames happened, behind any symlinks
+        QSet<QString> directories;
+        for (int i = 0; i < results.size(); ++i) {
+            if (results.at(i).success) {
+                directories.insert(QFileInfo(QFile::decodeName(jobs.at(i).path)).absolutePath());
+            }
+        }
+        syncDirectories(directories);
+    }
+#else
+    // QSaveFile gives the same atomic rename; durability is left to the platform
+    Q_UNUSED(durability)
+    QVector<int> indices(requests.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::function<void(int &)> save = [&](int &i) {
+        const Request &request = requests.at(i);
+        if (!compressionErrors.at(i).isEmpty()) {
+            results[i].error = compressionErrors.at(i);
+            return;
+        }
+        if (request.backup) {
+            makeBackup(request.filePath);
+        }
+        QSaveFile file(request.filePath);
+        if (file.open(QIODevice::WriteOnly) && file.write(request.data) == request.data.size() && file.commit()) {
+            results[i].success = true;
+        } else {
+            results[i].error = file.errorString();
+        }
+    };
+    QtConcurrent::blockingMap(indices, save);
+#endif
+
+    for (const Result &result : qAsConst(results)) {
+        if (!result.success) {
+            qWarning() << "File write error:" << result.filePath << result.error;
+        }
+    }
+    return results;
+}
@@ -0,0 +1,71 @@
+#ifndef WRITE_PIPELINE_H
+#define WRITE_PIPELINE_H
+
+#include <QByteArray>
+#include <QFuture>
+#include <QMetaType>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include "compression.h"
+
+/**
+ * @brief Saves batches of files atomically off the UI thread
+ *
+ * Every file is written to a temporary sibling, synced according to the
+ * durability level, and renamed over the original, so a crash leaves
+ * either the old or the new content. A batch (e.g. Save All) is one
+ * submission: on Linux builds with MANGO_HAVE_LIBURING the writes and
+ * their linked fsyncs for all files go to the kernel through a single
+ * io_uring; otherwise the files are written in parallel on the thread
+ * pool. Renames and directory syncs follow once the data is durable.
+ * Requests that ask for compression are compressed in parallel first.
+ */
+class WritePipeline
+{
+public:
+    enum Durability {
+        NoSync,     // Leave flushing to the kernel
+        DataSync,   // fdatasync() each file before the rename
+        FullSync    // fsync() each file, and the directories after the renames
+    };
+
+    struct Request {
+        QString filePath;
+        QByteArray data;      // Already encoded
+        bool backup = false;  // Keep the previous content as filePath + ".bak"
+        Compression::Format compression = Compression::None;  // Applied on the pool before writing
+    };
+
+    struct Result {
+        QString filePath;
+        bool success = false;
+        QString error;
+    };
+
+    // Singleton instance access
+    static WritePipeline* instance();
+
+    WritePipeline(const WritePipeline&) = delete;
+    WritePipeline& operator=(const WritePipeline&) = delete;
+
+    // Results are in request order
+    QFuture<QVector<Result>> submit(const QVector<Request> &requests, Durability durability);
+    QFuture<QVector<Result>> submit(const QVector<Request> &requests);
+
+    // From the Core/save_durability setting: none, fdatasync or fsync
+    static Durability defaultDurability();
+    static bool hasIoUring();
+
+private:
+    WritePipeline() = default;
+
+    static QVector<Result> run(QVector<Request> requests, Durability durability);
+
+    static WritePipeline* m_instance;
+    static QMutex m_instanceMutex;
+};
+
+Q_DECLARE_METATYPE(WritePipeline::Result)
+
+#endif // WRITE_PIPELINE_H
@@ -0,0 +1,176 @@
+/**
+ * MangoEditor - Highlighting Rule Fuzzer
+ * Description: Offline search for lines that make language_defs rules backtrack
+ *
+ * Every rule of every language definition is run against generated lines:
+ * random text over the characters the pattern mentions, and long repetitions
+ * of short seeds (with and without a breaking character at the end), which is
+ * what triggers catastrophic backtracking in practice. Rules run through the
+ * same step limit and line budget as the editor. A rule is reported when it
+ * hits a limit or exceeds the reporting threshold, together with the worst
+ * line found. The exit code is 1 if any rule was reported, so the tool can
+ * gate changes to language_defs in CI.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+#include "syntax/highlighter.h"
+#include "syntax/rule_profiler.h"
+
+namespace {
+struct Finding {
+    qint64 worstNs = 0;
+    QString worstLine;
+    bool hitLimit = false;
+};
+
+QString alphabetFor(const QString &pattern) {
+    QString alphabet = QStringLiteral("a0 _\t");
+    for (const QChar &ch : pattern) {
+        if (ch.unicode() >= 32 && ch.unicode() < 127 && !alphabet.contains(ch)) {
+            alphabet.append(ch);
+        }
+    }
+    return alphabet;
+}
+
+QString randomText(QRandomGenerator &random, const QString &alphabet, int length) {
+    QString text;
+    text.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        text.append(alphabet.at(random.bounded(alphabet.size())));
+    }
+    return text;
+}
+
+QStringList generateLines(QRandomGenerator &random, const QString &pattern, int iterations, int maxLength) {
+    const QString alphabet = alphabetFor(pattern);
+    QStringList lines;
+    for (int i = 0; i < iterations; ++i) {
+        const int length = 1 + random.bounded(maxLength);
+        switch (i % 3) {
+        case 0:
+            lines.append(randomText(random, alphabet, length));
+            break;
+        case 1:
+        case 2: {
+            // Long runs of a short seed, optionally broken at the end
+            const QString seed = randomText(random, alphabet, 1 + random.bounded(4));
+            QString line = seed.repeated(qMax(1, length / seed.size()));
+            if (i % 3 == 2) {
+                line.append(alphabet.at(random.bounded(alphabet.size())));
+            }
+            lines.append(line);
+            break;
+        }
+        }
+    }
+    return lines;
+}
+
+Finding fuzzRule(const QRegularExpression &rule, QRandomGenerator &random, int iterations, int maxLength) {
+    const QRegularExpression pattern = RuleProfiler::guardedPattern(rule);
+    Finding finding;
+    for (const QString &line : generateLines(random, rule.pattern(), iterations, maxLength)) {
+        QElapsedTimer timer;
+        timer.start();
+        const bool completed = RuleProfiler::forEachMatch(pattern, line, 0,
+                                                          [](const QRegularExpressionMatch &) {});
+        const qint64 elapsed = timer.nsecsElapsed();
+        // Once a line hits a limit, only such lines are kept as the example
+        if (!completed && !finding.hitLimit) {
+            finding = {elapsed, line, true};
+        } else if (completed != finding.hitLimit && elapsed > finding.worstNs) {
+            finding.worstNs = elapsed;
+            finding.worstLine = line;
+        }
+    }
+    return finding;
+}
+
+QString excerpt(const QString &line) {
+    const int kMaxExcerpt = 80;
+    QString shown = line.left(kMaxExcerpt);
+    shown.replace('\t', QStringLiteral("\\t"));
+    if (line.size() > kMaxExcerpt) {
+        shown += QStringLiteral("... (%1 chars)").arg(line.size());
+    }
+    return shown;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("mango-rule-fuzzer");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Fuzzes language definition rules for pathological inputs.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("directory", "Directory containing the language definition files.");
+    QCommandLineOption iterationsOption("iterations", "Generated lines per rule.", "count", "300");
+    QCommandLineOption lengthOption("max-length", "Maximum generated line length.", "chars", "4000");
+    QCommandLineOption seedOption("seed", "Random seed, for reproducible runs.", "seed", "1");
+    QCommandLineOption thresholdOption("threshold-ms", "Report rules slower than this per line.", "ms", "1");
+    parser.addOption(iterationsOption);
+    parser.addOption(lengthOption);
+    parser.addOption(seedOption);
+    parser.addOption(thresholdOption);
+    parser.process(app);
+
+    const QStringList positional = parser.positionalArguments();
+    const QDir directory(positional.isEmpty() ? QStringLiteral("src/syntax/language_defs") : positional.first());
+    const int iterations = qMax(1, parser.value(iterationsOption).toInt());
+    const int maxLength = qMax(1, parser.value(lengthOption).toInt());
+    const qint64 thresholdNs = parser.value(thresholdOption).toLongLong() * 1000 * 1000;
+    QRandomGenerator random(parser.value(seedOption).toUInt());
+
+    QTextStream out(stdout);
+    out << "Step limit " << RuleProfiler::matchLimit() << ", line budget "
+        << RuleProfiler::lineBudgetNs() / 1000 << " us\n";
+
+    const QStringList files = directory.entryList({"*.json"}, QDir::Files, QDir::Name);
+    if (files.isEmpty()) {
+        qWarning() << "No language definitions found in" << directory.absolutePath();
+        return 2;
+    }
+
+    int reported = 0;
+    for (const QString &fileName : files) {
+        QFile file(directory.filePath(fileName));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Failed to open language file:" << file.fileName();
+            continue;
+        }
+        SyntaxHighlighter::LanguageRules language;
+        SyntaxHighlighter::loadLanguageRules(QJsonDocument::fromJson(file.readAll()).object(), language);
+
+        out << fileName << ": " << language.rules.size() << " rules\n";
+        for (const SyntaxHighlighter::HighlightRule &rule : qAsConst(language.rules)) {
+            if (!rule.pattern.isValid()) {
+                // Never run by the editor either; not a backtracking problem
+                out << "  INVALID  " << rule.pattern.pattern() << ": " << rule.pattern.errorString() << "\n";
+                continue;
+            }
+
+            const Finding finding = fuzzRule(rule.pattern, random, iterations, maxLength);
+            if (finding.hitLimit || finding.worstNs > thresholdNs) {
+                out << (finding.hitLimit ? "  LIMIT    " : "  SLOW     ") << rule.pattern.pattern() << "\n"
+                    << "           worst " << finding.worstNs / 1000 << " us on: "
+                    << excerpt(finding.worstLine) << "\n";
+                ++reported;
+            }
+        }
+        out.flush();
+    }
+
+    out << reported << " rule(s) reported\n";
+    return reported > 0 ? 1 : 0;
+}
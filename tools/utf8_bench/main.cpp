@@ -0,0 +1,137 @@
+/**
+ * MangoEditor - UTF-8 Validation Benchmark
+ * Description: Throughput of the file loading UTF-8 paths against Qt's
+ *
+ * Each corpus (generated ASCII source, Bengali prose and a mix, or files
+ * given on the command line) is run through memcpy as the upper bound,
+ * Utf8::scan, Utf8::decode, QString::fromUtf8, and the old validation path
+ * (QTextCodec decode, Bengali regex, toUtf8 round trip). Reports MB/s as the
+ * best of several runs.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QTextCodec>
+#include <QTextStream>
+#include <QVector>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+#include "utilities/utf8.h"
+
+namespace {
+struct Corpus {
+    QString name;
+    QByteArray data;
+};
+
+QByteArray repeatTo(const QByteArray &seed, int size) {
+    QByteArray data;
+    data.reserve(size + seed.size());
+    while (data.size() < size) {
+        data += seed;
+    }
+    return data;
+}
+
+QVector<Corpus> generatedCorpora(int size) {
+    const QByteArray source =
+        "for (int i = 0; i < m_lines.size(); ++i) {\n"
+        "    if (m_lines.at(i).startsWith(QLatin1String(\"#include\"))) {\n"
+        "        ++includes; // count them\n"
+        "    }\n"
+        "}\n";
+    const QByteArray bengali = QString::fromUtf8(
+        "আমার সোনার বাংলা, আমি তোমায় ভালোবাসি।\n"
+        "চিরদিন তোমার আকাশ, তোমার বাতাস, আমার প্রাণে বাজায় বাঁশি।\n").toUtf8();
+    const QByteArray mixed = QString::fromUtf8(
+        "// ফাইল খোলার আগে এনকোডিং যাচাই করুন\n"
+        "QString title = tr(\"সংরক্ষণ\"); // save\n"
+        "const int limit = 1024;\n").toUtf8();
+    return {
+        {QStringLiteral("ascii-source"), repeatTo(source, size)},
+        {QStringLiteral("bengali-prose"), repeatTo(bengali, size)},
+        {QStringLiteral("mixed"), repeatTo(mixed, size)},
+    };
+}
+
+double bestMBps(qint64 bytes, int runs, const std::function<void()> &work) {
+    qint64 best = std::numeric_limits<qint64>::max();
+    for (int run = 0; run < runs; ++run) {
+        QElapsedTimer timer;
+        timer.start();
+        work();
+        best = qMin(best, qMax<qint64>(1, timer.nsecsElapsed()));
+    }
+    return double(bytes) / (1024.0 * 1024.0) / (double(best) / 1e9);
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("mango-utf8-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks UTF-8 validation and decoding used when opening files.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("files", "Files to use instead of the generated corpora.", "[files...]");
+    QCommandLineOption sizeOption("size-mb", "Size of each generated corpus.", "MB", "64");
+    QCommandLineOption runsOption("runs", "Runs per measurement; the best is reported.", "count", "5");
+    parser.addOption(sizeOption);
+    parser.addOption(runsOption);
+    parser.process(app);
+
+    const int runs = qMax(1, parser.value(runsOption).toInt());
+    QVector<Corpus> corpora;
+    if (parser.positionalArguments().isEmpty()) {
+        corpora = generatedCorpora(qMax(1, parser.value(sizeOption).toInt()) * 1024 * 1024);
+    } else {
+        for (const QString &path : parser.positionalArguments()) {
+            QFile file(path);
+            if (!file.open(QIODevice::ReadOnly)) {
+                qWarning() << "Failed to open" << path << file.errorString();
+                return 2;
+            }
+            corpora.append({QFileInfo(path).fileName(), file.readAll()});
+        }
+    }
+
+    QTextStream out(stdout);
+    out << qSetFieldWidth(16) << Qt::left << "corpus" << "memcpy" << "Utf8::scan" << "Utf8::decode"
+        << "fromUtf8" << "old path" << qSetFieldWidth(0) << "(MB/s)\n";
+
+    QTextCodec *codec = QTextCodec::codecForName("UTF-8");
+    const QRegularExpression bengaliBlock(QString::fromUtf8("[ঀ-৿]"));
+    for (const Corpus &corpus : qAsConst(corpora)) {
+        const char *data = corpus.data.constData();
+        const qint64 size = corpus.data.size();
+        QByteArray copy(corpus.data.size(), Qt::Uninitialized);
+        QString decoded;
+        Utf8::ScanResult scan;
+
+        const double copyRate = bestMBps(size, runs, [&]() { std::memcpy(copy.data(), data, size_t(size)); });
+        const double scanRate = bestMBps(size, runs, [&]() { scan = Utf8::scan(data, size); });
+        const double decodeRate = bestMBps(size, runs, [&]() { Utf8::decode(data, size, decoded); });
+        const double qtRate = bestMBps(size, runs, [&]() { decoded = QString::fromUtf8(corpus.data); });
+        const double oldRate = bestMBps(size, runs, [&]() {
+            decoded = codec->toUnicode(corpus.data);
+            if (decoded.contains(bengaliBlock)) {
+                QTextCodec::ConverterState state;
+                codec->toUnicode(decoded.toUtf8(), decoded.length(), &state);
+            }
+        });
+
+        out << qSetFieldWidth(16) << corpus.name
+            << QString::number(copyRate, 'f', 0) << QString::number(scanRate, 'f', 0)
+            << QString::number(decodeRate, 'f', 0) << QString::number(qtRate, 'f', 0)
+            << QString::number(oldRate, 'f', 0) << qSetFieldWidth(0)
+            << (scan.valid ? "" : "invalid ") << (scan.hasBengali ? "bengali" : "") << "\n";
+    }
+    return 0;
+}